@@ -0,0 +1,230 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "librtmfp.h"
+#include "LoopbackServer.h"
+#include <cstdio>
+
+using namespace Base;
+using namespace std;
+
+#define GOP_STREAM		"gop"
+#define GOP_WAIT		1000 // time (in msec) to let the frames and the play start go through
+#define GOP_READ_SIZE	0x100000
+#define GOP_CACHE_SIZE	20000 // "gopCacheSize" parameter, in bytes
+#define GOP_FRAME_SIZE	4000 // size of the video frames in bytes
+
+/*************************************************
+GOP cache of a P2P publication : one publisher and
+three players connected to the LoopbackServer, the
+publication starts with the first player.
+- The publisher sends a GOP larger than the cache,
+the first player receives it live and the second
+player joins and must receive nothing from it (the
+GOP is not cached)
+- The publisher sends a smaller GOP, the first two
+players receive it live and the third player joins
+and must receive it at once from the cache (caching
+resumed at the key frame)
+Each video frame carries its index, the program
+exits with 1 if a check fails
+Usage : GOPCacheBenchmark [large] [small]
+- large : number of frames of the GOP larger than the cache (10)
+- small : number of frames of the GOP smaller than the cache (3)
+*/
+static Int64 MicroNow() { return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count(); }
+
+static void OnLog(unsigned int level, const char* fileName, long line, const char* message) {
+	fprintf(stderr, "%s[%ld] %s\n", fileName, line, message);
+}
+
+struct Player : virtual Object {
+	Player() : context(0), streamId(0), joinedAt(0), firstAt(0) {}
+
+	bool join(const char* url, RTMFPConfig& config, const string& peerId) {
+		if (!(context = RTMFP_Connect(url, &config)) || RTMFP_WaitForEvent(context, RTMFP_CONNECTED) <= 0)
+			return false;
+		joinedAt = MicroNow();
+		if (!(streamId = RTMFP_Connect2Peer(context, peerId.c_str(), GOP_STREAM, 1)))
+			return false;
+		reader = thread([this]() {
+			vector<char> buffer(GOP_READ_SIZE);
+			string pending;
+			bool header(true);
+			int read;
+			while ((read = RTMFP_Read(streamId, context, buffer.data(), buffer.size())) > 0) {
+				pending.append(buffer.data(), read);
+				BinaryReader reader(BIN pending.data(), pending.size());
+				if (header) {
+					if (reader.available() < 13)
+						continue;
+					reader.next(13);
+					header = false;
+				}
+				while (reader.available() >= 11) {
+					const UInt8* tag = reader.current();
+					UInt32 tagSize = BinaryReader(tag + 1, 3).read24();
+					if (reader.available() < tagSize + 15)
+						break; // wait the end of the tag
+					reader.next(tagSize + 15);
+					if (*tag != AMF::TYPE_VIDEO || tagSize < 13 || tag[12] != 1)
+						continue; // only the video frames (not the codec infos)
+					lock_guard<mutex> lock(_mutex);
+					if (_frames.empty())
+						firstAt = MicroNow();
+					_frames.emplace_back(BinaryReader(tag + 16, 4).read32());
+				}
+				pending.erase(0, reader.position());
+			}
+		});
+		return true;
+	}
+
+	void close() {
+		if (context)
+			RTMFP_Close(context, 1);
+		if (reader.joinable())
+			reader.join();
+	}
+
+	vector<UInt32> frames() { lock_guard<mutex> lock(_mutex); return _frames; }
+
+	unsigned int		context;
+	unsigned short		streamId;
+	thread				reader;
+	atomic<Int64>		joinedAt;
+	atomic<Int64>		firstAt;
+private:
+	mutex				_mutex;
+	vector<UInt32>		_frames; // indexes of the video frames received
+};
+
+// Check that the player has received exactly the frames [first, first + count)
+static bool Check(const char* step, Player& player, UInt32 first, UInt32 count) {
+	vector<UInt32> frames(player.frames());
+	bool success(frames.size() == count);
+	for (UInt32 i = 0; success && i < count; ++i)
+		success = frames[i] == first + i;
+	printf("%s : %s, %u frames received", step, success ? "OK" : "FAILED", (UInt32)frames.size());
+	if (!frames.empty())
+		printf(" (%u to %u)", frames.front(), frames.back());
+	if (count)
+		printf(", expected %u to %u\n", first, first + count - 1);
+	else
+		printf(", expected none\n");
+	return success;
+}
+
+int main(int argc, char* argv[]) {
+	UInt32 large = (argc > 1) ? (UInt32)atoi(argv[1]) : 10;
+	UInt32 small = (argc > 2) ? (UInt32)atoi(argv[2]) : 3;
+	if (large * (GOP_FRAME_SIZE + 15) <= GOP_CACHE_SIZE || !small || small * (GOP_FRAME_SIZE + 15) > GOP_CACHE_SIZE) {
+		fprintf(stderr, "large must be more than %u frames and small between 1 and %u frames\n", GOP_CACHE_SIZE / (GOP_FRAME_SIZE + 15), GOP_CACHE_SIZE / (GOP_FRAME_SIZE + 15));
+		return 1;
+	}
+
+	LoopbackServer server;
+	UInt16 port = server.start();
+	if (!port) {
+		fprintf(stderr, "Unable to start the loopback server\n");
+		return 1;
+	}
+	char url[64];
+	snprintf(url, sizeof(url), "rtmfp://127.0.0.1:%u/loopback", port);
+
+	RTMFPConfig config;
+	RTMFP_Init(&config, NULL, OnLog, NULL);
+	RTMFP_SetIntParameter("logLevel", LOG_WARN);
+	RTMFP_SetIntParameter("gopCacheSize", GOP_CACHE_SIZE);
+
+	unsigned int publisher(0);
+	string peerId;
+	if (!(publisher = RTMFP_Connect(url, &config)) || RTMFP_WaitForEvent(publisher, RTMFP_CONNECTED) <= 0 || (peerId = server.peerId(0)).empty() || !RTMFP_PublishP2P(publisher, GOP_STREAM, 1, 1, 0)) {
+		fprintf(stderr, "Unable to connect the publisher\n");
+		RTMFP_Terminate();
+		return 1;
+	}
+
+	// Publisher, a GOP is made of the codec infos, a key frame and (count - 1) inter frames
+	UInt8 codecInfos[11 + 9 + 4];
+	BinaryWriter(codecInfos, sizeof(codecInfos)).write8(AMF::TYPE_VIDEO).write24(9).write32(0).write24(0).write(EXPAND("\x17\x00\x00\x00\x00\x01\x42\x00\x1E")).write32(11 + 9);
+	vector<UInt8> tag(11 + GOP_FRAME_SIZE + 4);
+	BinaryWriter(tag.data(), tag.size()).write8(AMF::TYPE_VIDEO).write24(GOP_FRAME_SIZE).write32(0).write24(0).next(GOP_FRAME_SIZE).write32(11 + GOP_FRAME_SIZE);
+	tag[12] = 1; // AVC NALU
+	UInt32 index(0);
+	auto WriteGOP = [&](UInt32 count) {
+		for (UInt32 i = 0; i < count; ++i, ++index) {
+			UInt32 time = index * 40;
+			if (!i) {
+				BinaryWriter(codecInfos + 4, 4).write24(time).write8(time >> 24);
+				if (RTMFP_Write(publisher, STR codecInfos, sizeof(codecInfos)) < 0)
+					return false;
+			}
+			BinaryWriter(tag.data() + 4, 4).write24(time).write8(time >> 24);
+			tag[11] = i ? 0x27 : 0x17;
+			BinaryWriter(tag.data() + 16, 4).write32(index);
+			if (RTMFP_Write(publisher, STR tag.data(), tag.size()) < 0)
+				return false;
+		}
+		this_thread::sleep_for(chrono::milliseconds(GOP_WAIT));
+		return true;
+	};
+
+	int result(1);
+	Player first, second, third;
+	printf("gopCacheSize %u, frames of %u bytes, GOPs of %u and %u frames\n", GOP_CACHE_SIZE, GOP_FRAME_SIZE, large, small);
+	if (!first.join(url, config, peerId) || RTMFP_WaitForEvent(publisher, RTMFP_P2P_PUBLISHED) <= 0)
+		fprintf(stderr, "Unable to connect the first player\n");
+	else if (RTMFP_Write(publisher, "FLV\x01\x01\x00\x00\x00\x09\x00\x00\x00\x00", 13) < 0 || !WriteGOP(large))
+		fprintf(stderr, "Unable to write the large GOP\n");
+	else if (Check("Large GOP, first player", first, 0, large)) {
+		// The large GOP must not be cached
+		if (!second.join(url, config, peerId))
+			fprintf(stderr, "Unable to connect the second player\n");
+		else {
+			this_thread::sleep_for(chrono::milliseconds(GOP_WAIT));
+			if (Check("Large GOP not cached, second player", second, 0, 0)) {
+				// The small GOP must be cached from its key frame
+				if (!WriteGOP(small))
+					fprintf(stderr, "Unable to write the small GOP\n");
+				else if (Check("Small GOP, second player", second, large, small)) {
+					if (!third.join(url, config, peerId))
+						fprintf(stderr, "Unable to connect the third player\n");
+					else {
+						this_thread::sleep_for(chrono::milliseconds(GOP_WAIT));
+						if (Check("Small GOP cached, third player", third, large, small)) {
+							printf("Third player : first frame %.1fms after the play request\n", (third.firstAt - third.joinedAt) / 1000.0);
+							result = 0;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	first.close();
+	second.close();
+	third.close();
+	RTMFP_Close(publisher, 1);
+	RTMFP_Terminate();
+	server.stop();
+	return result;
+}
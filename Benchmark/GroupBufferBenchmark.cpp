@@ -0,0 +1,99 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GroupBuffer.h"
+#include "GroupStream.h"
+#include "NetGroup.h"
+#include "Base/Logs.h"
+#include <cstdio>
+
+using namespace Base;
+using namespace std;
+
+/*************************************************
+Throughput of the GroupBuffer stage : the main
+thread adds the fragments (as the handler thread)
+and the GroupBuffer thread reorders and merges them
+Usage : GroupBufferBenchmark [fragments] [split] [reorder] [window]
+- fragments : number of fragments to add (1000000)
+- split : number of fragments by media packet (4)
+- reorder : if 1 the fragments are added 2 by 2 in reverse order (0)
+- window : number of fragments kept in the buffer (1024)
+*/
+int main(int argc, char* argv[]) {
+	UInt32 fragments = (argc > 1) ? (UInt32)atoi(argv[1]) : 1000000;
+	UInt32 split = (argc > 2) ? (UInt32)atoi(argv[2]) : 4;
+	bool reorder = (argc > 3) && atoi(argv[3]) == 1;
+	UInt32 window = (argc > 4) ? (UInt32)atoi(argv[4]) : 1024;
+	if (!split || split > 0xFF) {
+		fprintf(stderr, "split must be between 1 and 255\n");
+		return 1;
+	}
+	fragments -= fragments % split; // only complete media packets
+	Logs::SetLevel(LOG_WARN);
+
+	shared<Buffer> pPayload(SET, NETGROUP_MAX_PACKET_SIZE);
+	memset(pPayload->data(), 0x17, pPayload->size());
+	Packet payload(pPayload);
+
+	atomic<UInt64> packets(0), bytes(0);
+	GroupBuffer buffer;
+	buffer.onNextPacket = [&](GroupBuffer::Result& result) {
+		UInt64 size(0);
+		for (RTMFP::MediaPacket& packet : result)
+			size += packet.size();
+		bytes += size;
+		packets += result.size();
+	};
+
+	// Create the fragments before measuring
+	vector<shared<GroupFragment>> list;
+	list.reserve(fragments);
+	for (UInt32 id = 1; id <= fragments; ++id) {
+		UInt32 index = (id - 1) % split, rest = split - 1 - index;
+		UInt8 marker = (split == 1) ? GroupStream::GROUP_MEDIA_DATA : (!index ? GroupStream::GROUP_MEDIA_START : (!rest ? GroupStream::GROUP_MEDIA_END : GroupStream::GROUP_MEDIA_NEXT));
+		list.emplace_back(SET, payload, (id - 1) / split, AMF::TYPE_VIDEO, 1000 + id, marker, (UInt8)rest); // not from 1, the id 0 is "no fragment"
+	}
+	if (reorder) {
+		for (UInt32 i = split + 1; i < fragments; i += 2) // the first packet is in order to start
+			swap(list[i - 1], list[i]);
+	}
+
+	Exception ex;
+	auto start = chrono::steady_clock::now();
+	buffer.startProcessing(ex, 1, 1);
+	for (UInt32 i = 0; i < fragments; ++i) {
+		buffer.add(ex, 1, list[i]);
+		// Remove the old fragments like GroupMedia does when the window duration is elapsed
+		if (i >= window && !(i % split))
+			buffer.removeFragments(ex, 1, list[i - window]->id);
+	}
+	auto added = chrono::steady_clock::now();
+	UInt64 expected = fragments / split;
+	while (packets < expected)
+		this_thread::yield();
+	auto end = chrono::steady_clock::now();
+
+	double addTime = chrono::duration<double>(added - start).count(), totalTime = chrono::duration<double>(end - start).count();
+	printf("%u fragments (%u by packet%s) added in %.3fs (%.0f fragments/s)\n", fragments, split, reorder ? ", reordered" : "", addTime, fragments / addTime);
+	printf("%llu packets merged in %.3fs : %.0f fragments/s, %.1f MB/s\n", (unsigned long long)packets.load(), totalTime, fragments / totalTime, bytes / totalTime / 1000000);
+	return 0;
+}
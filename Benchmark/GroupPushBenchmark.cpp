@@ -0,0 +1,68 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GroupMedia.h"
+#include "NetGroup.h"
+#include <cstdio>
+
+using namespace Base;
+using namespace std;
+
+/*************************************************
+Selection of the pusher of a NetGroup push mask :
+a tested peer has pushed NETGROUP_PUSH_SAMPLES
+fragments of the mask and is compared to the current
+pusher on the same fragments
+Each case gives the fragments received first and
+the duplicates of the two peers, the program exits
+with 1 if a decision is wrong
+Usage : GroupPushBenchmark
+*/
+struct PushCase {
+	const char*	name;
+	UInt32		first; // tested peer
+	UInt32		duplicates;
+	UInt32		pusherFirst;
+	UInt32		pusherDuplicates;
+	bool		replace; // expected decision
+};
+
+int main(int argc, char* argv[]) {
+	const PushCase cases[] = {
+		{ "Stalled pusher", NETGROUP_PUSH_SAMPLES, 0, 0, 0, true },
+		{ "Stalled pusher, tested peer late", 0, NETGROUP_PUSH_SAMPLES, 0, 0, true },
+		{ "Pusher slowed down", NETGROUP_PUSH_SAMPLES - 1, 1, 1, 0, true },
+		{ "Pusher faster", NETGROUP_PUSH_SAMPLES / 4, NETGROUP_PUSH_SAMPLES * 3 / 4, NETGROUP_PUSH_SAMPLES * 3 / 4, NETGROUP_PUSH_SAMPLES / 4, false },
+		{ "Same fragments, less duplicates", NETGROUP_PUSH_SAMPLES / 2, NETGROUP_PUSH_SAMPLES / 2, NETGROUP_PUSH_SAMPLES / 2, NETGROUP_PUSH_SAMPLES, true },
+		{ "Same fragments, same duplicates", NETGROUP_PUSH_SAMPLES / 2, NETGROUP_PUSH_SAMPLES / 2, NETGROUP_PUSH_SAMPLES / 2, NETGROUP_PUSH_SAMPLES / 2, false },
+		{ "Both late", 0, NETGROUP_PUSH_SAMPLES, 0, NETGROUP_PUSH_SAMPLES / 2, false }
+	};
+
+	int result(0);
+	for (const PushCase& pushCase : cases) {
+		bool replace = GroupMedia::IsBetterPusher(pushCase.first, pushCase.duplicates, pushCase.pusherFirst, pushCase.pusherDuplicates);
+		printf("%s : %s, tested peer %u/%u received first, pusher %u/%u, %s\n", pushCase.name, (replace == pushCase.replace) ? "OK" : "FAILED",
+			pushCase.first, pushCase.first + pushCase.duplicates, pushCase.pusherFirst, pushCase.pusherFirst + pushCase.pusherDuplicates, replace ? "replaced" : "kept");
+		if (replace != pushCase.replace)
+			result = 1;
+	}
+	return result;
+}
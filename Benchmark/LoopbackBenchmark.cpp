@@ -0,0 +1,243 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "librtmfp.h"
+#include "LoopbackServer.h"
+#include <sys/resource.h>
+#include <algorithm>
+#include <cstdio>
+
+using namespace Base;
+using namespace std;
+
+#define LOOPBACK_STREAM		"loopback"
+#define LOOPBACK_WARMUP		1000 // time (in msec) to send before measuring
+#define LOOPBACK_READ_SIZE	0x100000
+#define LOOPBACK_KEY_PERIOD	25 // number of video frames between each key frame
+
+/*************************************************
+End-to-end throughput and latency on the loopback
+interface : N publishers and M players connected
+to the LoopbackServer through the public API, the
+player i plays the publisher i%N in P2P. Each video
+frame carries its sending time to measure the latency
+from RTMFP_Write to RTMFP_Read
+Usage : LoopbackBenchmark [publishers] [players] [duration] [rate] [size]
+- publishers : number of publishers (1)
+- players : number of players (1)
+- duration : measure duration in seconds, after 1s of warm-up (10)
+- rate : bitrate of each publisher in Mbps (20)
+- size : size of the video frames in bytes (4000)
+*/
+static Int64 MicroNow() { return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count(); }
+
+static double CPUTime() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+static void OnLog(unsigned int level, const char* fileName, long line, const char* message) {
+	fprintf(stderr, "%s[%ld] %s\n", fileName, line, message);
+}
+
+struct Player : virtual Object {
+	Player() : context(0), streamId(0), bytes(0), packets(0) {}
+
+	unsigned int		context;
+	unsigned short		streamId;
+	thread				reader;
+	// Measures (written by the reader thread)
+	UInt64				bytes;
+	UInt64				packets;
+	vector<UInt32>		latencies; // in usec
+};
+
+int main(int argc, char* argv[]) {
+	UInt32 publishers = (argc > 1) ? (UInt32)atoi(argv[1]) : 1;
+	UInt32 players = (argc > 2) ? (UInt32)atoi(argv[2]) : 1;
+	UInt32 duration = (argc > 3) ? (UInt32)atoi(argv[3]) : 10;
+	double rate = (argc > 4) ? atof(argv[4]) : 20;
+	UInt32 size = (argc > 5) ? (UInt32)atoi(argv[5]) : 4000;
+	if (!publishers || !players || !duration || rate <= 0 || size < 16 || size > 0xFFFFFF) {
+		fprintf(stderr, "publishers, players, duration and rate must be positive, size must be between 16 and 16777215\n");
+		return 1;
+	}
+
+	LoopbackServer server;
+	UInt16 port = server.start();
+	if (!port) {
+		fprintf(stderr, "Unable to start the loopback server\n");
+		return 1;
+	}
+	char url[64];
+	snprintf(url, sizeof(url), "rtmfp://127.0.0.1:%u/loopback", port);
+
+	RTMFPConfig config;
+	RTMFP_Init(&config, NULL, OnLog, NULL);
+	RTMFP_SetIntParameter("logLevel", LOG_WARN);
+
+	// Connections
+	vector<unsigned int> publisherContexts(publishers);
+	vector<string> peerIds(publishers);
+	for (UInt32 i = 0; i < publishers; ++i) {
+		if (!(publisherContexts[i] = RTMFP_Connect(url, &config)) || RTMFP_WaitForEvent(publisherContexts[i], RTMFP_CONNECTED) <= 0 || (peerIds[i] = server.peerId(i)).empty() || !RTMFP_PublishP2P(publisherContexts[i], LOOPBACK_STREAM, 1, 1, 0)) {
+			fprintf(stderr, "Unable to connect the publisher %u\n", i);
+			RTMFP_Terminate();
+			return 1;
+		}
+	}
+	vector<Player> listPlayers(players);
+	for (UInt32 i = 0; i < players; ++i) {
+		Player& player = listPlayers[i];
+		if (!(player.context = RTMFP_Connect(url, &config)) || RTMFP_WaitForEvent(player.context, RTMFP_CONNECTED) <= 0 || !(player.streamId = RTMFP_Connect2Peer(player.context, peerIds[i % publishers].c_str(), LOOPBACK_STREAM, 1))) {
+			fprintf(stderr, "Unable to connect the player %u\n", i);
+			RTMFP_Terminate();
+			return 1;
+		}
+	}
+
+	// Readers, the measures start after the warm-up
+	atomic<bool> measuring(false);
+	for (Player& player : listPlayers) {
+		player.latencies.reserve(size_t(rate * 1000000 / 8 / size * duration * 1.2));
+		player.reader = thread([&player, &measuring]() {
+			vector<char> buffer(LOOPBACK_READ_SIZE);
+			string pending;
+			bool header(true);
+			int read;
+			while ((read = RTMFP_Read(player.streamId, player.context, buffer.data(), buffer.size())) > 0) {
+				Int64 now = MicroNow();
+				pending.append(buffer.data(), read);
+				BinaryReader reader(BIN pending.data(), pending.size());
+				if (header) {
+					if (reader.available() < 13)
+						continue;
+					reader.next(13);
+					header = false;
+				}
+				while (reader.available() >= 11) {
+					const UInt8* tag = reader.current();
+					UInt32 tagSize = BinaryReader(tag + 1, 3).read24();
+					if (reader.available() < tagSize + 15)
+						break; // wait the end of the tag
+					reader.next(tagSize + 15);
+					if (*tag != AMF::TYPE_VIDEO || tagSize < 13 || tag[12] != 1 || !measuring)
+						continue; // only the video frames (not the codec infos)
+					player.latencies.emplace_back(UInt32(now - BinaryReader(tag + 16, 8).read64()));
+					player.bytes += tagSize;
+					++player.packets;
+				}
+				pending.erase(0, reader.position());
+			}
+		});
+	}
+
+	// Publishers, they send video frames at a constant rate with the codec infos before each key frame
+	atomic<bool> running(true);
+	vector<thread> writers;
+	for (unsigned int context : publisherContexts) {
+		writers.emplace_back([context, size, rate, &running]() {
+			UInt8 codecInfos[11 + 9 + 4];
+			BinaryWriter(codecInfos, sizeof(codecInfos)).write8(AMF::TYPE_VIDEO).write24(9).write32(0).write24(0).write(EXPAND("\x17\x00\x00\x00\x00\x01\x42\x00\x1E")).write32(11 + 9);
+			vector<UInt8> tag(11 + size + 4);
+			BinaryWriter(tag.data(), tag.size()).write8(AMF::TYPE_VIDEO).write24(size).write32(0).write24(0).next(size).write32(11 + size);
+			tag[12] = 1; // AVC NALU
+			if (RTMFP_Write(context, "FLV\x01\x01\x00\x00\x00\x09\x00\x00\x00\x00", 13) < 0)
+				return;
+
+			chrono::microseconds interval(Int64(size * 8 / rate));
+			auto start = chrono::steady_clock::now();
+			for (UInt32 frame = 0; running; ++frame) {
+				this_thread::sleep_until(start + interval * frame);
+				UInt32 time = UInt32(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+				if (!(frame % LOOPBACK_KEY_PERIOD)) {
+					BinaryWriter(codecInfos + 4, 4).write24(time).write8(time >> 24);
+					if (RTMFP_Write(context, STR codecInfos, sizeof(codecInfos)) < 0)
+						return;
+				}
+				BinaryWriter(tag.data() + 4, 4).write24(time).write8(time >> 24);
+				tag[11] = (frame % LOOPBACK_KEY_PERIOD) ? 0x27 : 0x17;
+				BinaryWriter(tag.data() + 16, 8).write64(MicroNow());
+				if (RTMFP_Write(context, STR tag.data(), tag.size()) < 0)
+					return;
+			}
+		});
+	}
+
+	// Measure
+	auto GetPackets = [&]() {
+		UInt64 packets(0);
+		RTMFPStats stats;
+		for (unsigned int context : publisherContexts) {
+			if (RTMFP_GetStats(context, &stats))
+				packets += stats.packetsReceived;
+		}
+		for (Player& player : listPlayers) {
+			if (RTMFP_GetStats(player.context, &stats))
+				packets += stats.packetsReceived;
+		}
+		return packets;
+	};
+	this_thread::sleep_for(chrono::milliseconds(LOOPBACK_WARMUP));
+	UInt64 packetsStart = GetPackets();
+	double cpuStart = CPUTime();
+	auto start = chrono::steady_clock::now();
+	measuring = true;
+	this_thread::sleep_for(chrono::seconds(duration));
+	measuring = false;
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	double cpu = CPUTime() - cpuStart;
+	UInt64 packets = GetPackets() - packetsStart;
+
+	// Stop the publishers then the players (the publishers keep the library alive while the readers stop)
+	running = false;
+	for (thread& writer : writers)
+		writer.join();
+	for (Player& player : listPlayers) {
+		RTMFP_Close(player.context, 1);
+		player.reader.join();
+	}
+	for (unsigned int context : publisherContexts)
+		RTMFP_Close(context, 1);
+	RTMFP_Terminate();
+	server.stop();
+
+	// Results
+	UInt64 bytes(0), frames(0);
+	vector<UInt32> latencies;
+	for (Player& player : listPlayers) {
+		bytes += player.bytes;
+		frames += player.packets;
+		latencies.insert(latencies.end(), player.latencies.begin(), player.latencies.end());
+	}
+	double mbps = bytes * 8 / elapsed / 1000000;
+	printf("%u publishers, %u players, %.1f Mbps by publisher, frames of %u bytes, %.3fs measured\n", publishers, players, rate, size, elapsed);
+	printf("Received : %.1f Mbps (%.1f%% of the expected rate), %.0f frames/s, %.0f RTMFP packets/s\n", mbps, mbps * 100 / (rate * players), frames / elapsed, packets / elapsed);
+	printf("CPU : %.1f%%, %.2f cores by Gbps received\n", cpu * 100 / elapsed, mbps ? (cpu / elapsed) / (mbps / 1000) : 0);
+	if (latencies.empty()) {
+		printf("Latency : no frame received\n");
+		return 1;
+	}
+	sort(latencies.begin(), latencies.end());
+	printf("Latency : p50 %.3fms, p99 %.3fms, max %.3fms\n", latencies[latencies.size() / 2] / 1000.0, latencies[latencies.size() * 99 / 100] / 1000.0, latencies.back() / 1000.0);
+	return 0;
+}
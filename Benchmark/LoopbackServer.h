@@ -0,0 +1,454 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "RTMFP.h"
+#include "AMFReader.h"
+#include "AMFWriter.h"
+#include "Base/DiffieHellman.h"
+#include "Base/Logs.h"
+#include "Base/Util.h"
+#include <openssl/evp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+using namespace Base;
+
+// Open an UDP socket on 127.0.0.1 with a reception timeout (to stop its thread), return the port (0 if failed)
+static UInt16 LoopbackBind(int& sock) {
+	if ((sock = ::socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return 0;
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t size(sizeof(address));
+	timeval timeout = { 0, 100000 };
+	if (::bind(sock, (sockaddr*)&address, size) < 0 || ::getsockname(sock, (sockaddr*)&address, &size) < 0 || ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+		return 0;
+	return ntohs(address.sin_port);
+}
+
+/*************************************************
+LoopbackServer is a minimal RTMFP server on the
+loopback interface : handshake, NetConnection
+connect and rendezvous service for the P2P handshakes.
+The media is relayed by the P2P publishers
+of the clients, not by the server
+*/
+struct LoopbackServer : virtual Object {
+	LoopbackServer() : _socket(-1), _running(false), _nextId(0) {}
+	~LoopbackServer() { stop(); }
+
+	// Start the server on 127.0.0.1, return the port (0 if failed)
+	UInt16	start() {
+		UInt16 port = LoopbackBind(_socket);
+		if (!port) {
+			stop();
+			return 0;
+		}
+		_running = true;
+		_thread = std::thread([this]() { run(); });
+		return port;
+	}
+
+	void	stop() {
+		_running = false;
+		if (_thread.joinable())
+			_thread.join();
+		if (_socket >= 0)
+			::close(_socket);
+		_socket = -1;
+	}
+
+	// Return the peer ID of the client connected in position index (empty if not yet connected)
+	std::string	peerId(UInt32 index) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return (index < _peerIds.size()) ? _peerIds[index] : std::string();
+	}
+
+	// Get the address of the client connected in position index, return false if not yet connected
+	bool	peerAddress(UInt32 index, sockaddr_in& address) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (index >= _peerKeys.size())
+			return false;
+		address = _peerAddresses[_peerKeys[index]];
+		return true;
+	}
+
+	// Answer the rendezvous of the client in position index with a port on 127.0.0.1 (a LoopbackRelay)
+	void	redirect(UInt32 index, UInt16 port) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (index < _peerKeys.size())
+			_peerAddresses[_peerKeys[index]].sin_port = htons(port);
+	}
+
+private:
+	struct Session : virtual Object {
+		Session(const UInt8* requestKey, const UInt8* responseKey, UInt32 farId, const sockaddr_in& address) : decoder(requestKey), encoder(responseKey), farId(farId), address(address), writerStage(0) {}
+
+		RTMFP::Engine				decoder;
+		RTMFP::Engine				encoder;
+		const UInt32				farId; // id of the client session
+		const sockaddr_in			address;
+		shared<Buffer>				pHandshake78; // response saved for the repeated handshakes 38
+		std::map<UInt64, UInt64>			stages; // last stage received by flow
+		UInt64						writerStage; // last stage sent on the NetConnection flow
+	};
+
+	void	run() {
+		UInt8 data[RTMFP::SIZE_PACKET_MAX];
+		sockaddr_in address;
+		while (_running) {
+			socklen_t size(sizeof(address));
+			ssize_t received = ::recvfrom(_socket, data, sizeof(data), 0, (sockaddr*)&address, &size);
+			if (received >= RTMFP::SIZE_HEADER)
+				receive(data, UInt32(received), address);
+		}
+	}
+
+	void	receive(const UInt8* data, UInt32 size, const sockaddr_in& address) {
+		BinaryReader reader(data, size);
+		UInt32 id = RTMFP::Unpack(reader);
+		Buffer buffer(data + 4, size - 4);
+		Exception ex;
+		if (!id) {
+			if (!RTMFP::Engine::Decode(ex, buffer, _address))
+				return;
+			BinaryReader packet(buffer.data(), buffer.size());
+			if (packet.read8() != 0x0B)
+				return;
+			packet.next(2); // time
+			UInt8 type = packet.read8();
+			packet.shrink(packet.read16());
+			if (type == 0x30)
+				handshake30(packet, address);
+			else if (type == 0x38)
+				handshake38(packet, address);
+			return;
+		}
+		auto itSession = _sessions.find(id);
+		if (itSession == _sessions.end() || !itSession->second->decoder.decode(ex, buffer, _address))
+			return;
+		if (!process(*itSession->second, buffer))
+			_sessions.erase(itSession);
+	}
+
+	void	handshake30(BinaryReader& reader, const sockaddr_in& address) {
+		UInt32 epdSize = reader.read7Bit<UInt32>();
+		const UInt8* epd = reader.current();
+		reader.next(epdSize);
+		if (reader.available() < 16)
+			return;
+		std::string tag(STR reader.current(), 16);
+
+		shared<Buffer> pBuffer;
+		RTMFP::InitBuffer(pBuffer, 0x0B);
+		BinaryWriter writer(*pBuffer);
+		if (epdSize == 0x22 && epd[1] == 0x0F) {
+			// P2P rendezvous : address of the peer
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto itPeer = _peerAddresses.find(std::string(STR epd + 2, PEER_ID_SIZE));
+			if (itPeer == _peerAddresses.end())
+				return; // not connected, the client will repeat the handshake
+			writer.write8(0x71).next(2);
+			writer.write8(16).write(tag);
+			RTMFP::WriteAddress(writer, SocketAddress((const sockaddr&)itPeer->second), RTMFP::ADDRESS_PUBLIC);
+		}
+		else {
+			// Connection : cookie and certificate
+			writer.write8(0x70).next(2);
+			writer.write8(16).write(tag);
+			writer.write8(0x40);
+			writer.writeRandom(0x40);
+			writer.write(EXPAND("\x01\x0A\x41\x0E"));
+			writer.writeRandom(0x40);
+			writer.write(EXPAND("\x02\x15\x02\x02\x15\x05\x02\x15\x0E"));
+		}
+		BinaryWriter(pBuffer->data() + 10, 2).write16(pBuffer->size() - 12);
+		send(RTMFP::Engine::Encode(pBuffer, 0, _address), address);
+	}
+
+	void	handshake38(BinaryReader& reader, const sockaddr_in& address) {
+		UInt32 farId = reader.read32();
+
+		// Repeated handshake?
+		for (auto& itSession : _sessions) {
+			Session& session = *itSession.second;
+			if (session.farId == farId && session.address.sin_port == address.sin_port) {
+				shared<Buffer> pBuffer(SET, session.pHandshake78->data(), session.pHandshake78->size());
+				send(RTMFP::Engine::Encode(pBuffer, farId, _address), address);
+				return;
+			}
+		}
+
+		if (reader.read8() != 0x40)
+			return;
+		reader.next(0x40); // cookie
+		UInt32 idSize = reader.read7Bit<UInt32>();
+		const UInt8* id = reader.current();
+		UInt32 keySize = reader.read7Bit<UInt32>() - 2;
+		if (reader.read16() != 0x1D02)
+			return;
+		const UInt8* key = reader.current();
+		reader.next(keySize);
+		UInt32 nonceSize = reader.read7Bit<UInt32>();
+		const UInt8* nonce = reader.current();
+		if (reader.available() < nonceSize)
+			return;
+
+		// Peer ID of the client
+		UInt8 peerId[PEER_ID_SIZE];
+		EVP_Digest(id, idSize, peerId, NULL, EVP_sha256(), NULL);
+
+		// Keys
+		Exception ex;
+		DiffieHellman diffieHellman;
+		UInt8 secret[DiffieHellman::SIZE];
+		UInt8 secretSize;
+		if (!diffieHellman.computeKeys(ex) || !(secretSize = diffieHellman.computeSecret(ex, key, keySize, secret))) {
+			ERROR("Loopback server, ", ex)
+			return;
+		}
+		shared<Buffer> pNonce(SET, EXPAND("\x03\x1A\x00\x00\x02\x1E\x00\x81\x02\x0D\x02"));
+		pNonce->resize(pNonce->size() + diffieHellman.publicKeySize());
+		diffieHellman.readPublicKey(pNonce->data() + pNonce->size() - diffieHellman.publicKeySize());
+		UInt8 requestKey[Crypto::SHA256_SIZE];
+		UInt8 responseKey[Crypto::SHA256_SIZE];
+		RTMFP::ComputeAsymetricKeys(Buffer(secret, secretSize), nonce, nonceSize, pNonce->data(), pNonce->size(), requestKey, responseKey);
+
+		UInt32 sessionId = ++_nextId;
+		shared<Session>& pSession = _sessions[sessionId];
+		pSession.set(requestKey, responseKey, farId, address);
+
+		RTMFP::InitBuffer(pSession->pHandshake78, 0x0B);
+		BinaryWriter writer(*pSession->pHandshake78);
+		writer.write8(0x78).next(2);
+		writer.write32(sessionId);
+		writer.write7Bit<UInt32>(pNonce->size()).write(*pNonce);
+		writer.write8(0x58);
+		BinaryWriter(pSession->pHandshake78->data() + 10, 2).write16(pSession->pHandshake78->size() - 12);
+		shared<Buffer> pBuffer(SET, pSession->pHandshake78->data(), pSession->pHandshake78->size());
+		send(RTMFP::Engine::Encode(pBuffer, farId, _address), address);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_peerAddresses[std::string(STR peerId, PEER_ID_SIZE)] = address;
+		_peerKeys.emplace_back(STR peerId, PEER_ID_SIZE);
+		_peerIds.emplace_back();
+		String::Assign(_peerIds.back(), String::Hex(peerId, PEER_ID_SIZE));
+	}
+
+	// Process a session packet, return false if the session is closed
+	bool	process(Session& session, const Buffer& buffer) {
+		BinaryReader reader(buffer.data(), buffer.size());
+		UInt8 marker = reader.read8();
+		reader.next((marker & 0x04) ? 4 : 2); // time and echo time
+
+		shared<Buffer> pBuffer;
+		RTMFP::InitBuffer(pBuffer, 0x4A);
+		BinaryWriter writer(*pBuffer);
+		UInt32 headerSize = pBuffer->size();
+		bool closed(false);
+		std::set<UInt64> acks;
+		UInt64 flowId(0), stage(0);
+		UInt8 flags(0);
+
+		UInt8 type = reader.available() ? reader.read8() : 0xFF;
+		while (type != 0xFF && reader.available() >= 2) {
+			UInt16 size = reader.read16();
+			BinaryReader chunk(reader.current(), size);
+			reader.next(size);
+
+			switch (type) {
+			case 0x10:
+				flags = chunk.read8();
+				flowId = chunk.read7Bit<UInt64>();
+				stage = chunk.read7Bit<UInt64>() - 1;
+				chunk.read7Bit<UInt64>(); // delta NAck
+				if (flags & RTMFP::MESSAGE_OPTIONS) {
+					chunk.next(chunk.read8()); // signature
+					for (UInt8 length = chunk.read8(); length && chunk.available(); length = chunk.read8())
+						chunk.next(length);
+				}
+			case 0x11:
+				++stage;
+				if (type == 0x11)
+					flags = chunk.read8();
+				if (stage > session.stages[flowId])
+					session.stages[flowId] = stage;
+				acks.emplace(flowId);
+				if (!(flags & RTMFP::MESSAGE_WITH_BEFOREPART) && chunk.available() > 5 && chunk.read8() == AMF::TYPE_INVOCATION) {
+					chunk.next(4); // time
+					std::string name;
+					double callback(0);
+					AMFReader amfReader(Packet(chunk.current(), chunk.available()));
+					if (amfReader.readString(name) && name == "connect" && amfReader.readNumber(callback) && !session.writerStage)
+						writeConnectResult(session, writer, flowId, callback);
+				}
+				break;
+			case 0x01: // keepalive
+				writer.write8(0x41).write16(0);
+				break;
+			case 0x6e: // path MTU probe
+				writer.write8(0x6f).write16(2).write16(chunk.read16());
+				break;
+			case 0x0c: // close
+				writer.write8(0x4c).write16(0);
+				closed = true;
+				break;
+			default:
+				break;
+			}
+			type = reader.available() ? reader.read8() : 0xFF;
+		}
+
+		// Acknowledgments (no loss on loopback, only the last stage)
+		for (UInt64 id : acks) {
+			writer.write8(0x51);
+			UInt32 sizePos = pBuffer->size();
+			writer.next(2);
+			writer.write7Bit<UInt64>(id).write7Bit<UInt64>(0x7F).write7Bit<UInt64>(session.stages[id]);
+			BinaryWriter(pBuffer->data() + sizePos, 2).write16(pBuffer->size() - sizePos - 2);
+		}
+		if (pBuffer->size() > headerSize)
+			send(session.encoder.encode(pBuffer, session.farId, _address), session.address);
+		return !closed;
+	}
+
+	// Write the "_result" of the NetConnection connect on the server NetConnection flow (id 2)
+	void	writeConnectResult(Session& session, BinaryWriter& writer, UInt64 flowRef, double callback) {
+		Buffer& buffer(writer.buffer());
+		writer.write8(0x10);
+		UInt32 sizePos = buffer.size();
+		writer.next(2);
+		writer.write8(RTMFP::MESSAGE_OPTIONS).write7Bit<UInt64>(2).write7Bit<UInt64>(++session.writerStage).write7Bit<UInt64>(1);
+		writer.write8(5).write(EXPAND("\x00\x54\x43\x04\x00"));
+		UInt32 refPos = buffer.size();
+		writer.next(1);
+		writer.write8(0x0A).write7Bit<UInt64>(flowRef);
+		buffer.data()[refPos] = UInt8(buffer.size() - refPos - 1);
+		writer.write8(0); // end of the options
+
+		writer.write8(AMF::TYPE_INVOCATION).write32(0);
+		AMFWriter amfWriter(buffer, true);
+		amfWriter.writeString(EXPAND("_result"));
+		amfWriter.writeNumber(callback);
+		amfWriter.writeNull();
+		amfWriter.beginObject();
+		amfWriter.writeStringProperty("level", "status");
+		amfWriter.writeStringProperty("code", "NetConnection.Connect.Success");
+		amfWriter.writeStringProperty("description", "Connection succeeded");
+		amfWriter.writeNumberProperty("objectEncoding", 3);
+		amfWriter.endObject();
+		BinaryWriter(buffer.data() + sizePos, 2).write16(buffer.size() - sizePos - 2);
+	}
+
+	void	send(const shared<Buffer>& pBuffer, const sockaddr_in& address) {
+		::sendto(_socket, pBuffer->data(), pBuffer->size(), 0, (const sockaddr*)&address, sizeof(address));
+	}
+
+	int								_socket;
+	std::atomic<bool>					_running;
+	std::thread						_thread;
+	const SocketAddress				_address; // wildcard, to not dump the packets
+	UInt32							_nextId;
+	std::map<UInt32, shared<Session>>	_sessions;
+
+	std::mutex						_mutex; // for the peers (read by the benchmark thread)
+	std::map<std::string, sockaddr_in>		_peerAddresses; // binary peer ID to address
+	std::vector<std::string>					_peerKeys; // binary peer IDs in the order of the connections
+	std::vector<std::string>					_peerIds; // peer IDs in the order of the connections
+};
+
+/*************************************************
+LoopbackRelay forwards the packets between a peer
+and the first other address which sends to it.
+The rendezvous of the peer is redirected to it
+(LoopbackServer::redirect) to drop the packets of
+its P2P session : blackout (all the packets) or
+random loss
+*/
+struct LoopbackRelay : virtual Object {
+	LoopbackRelay() : blackout(false), loss(0), forwarded(0), dropped(0), _socket(-1), _running(false) {}
+	~LoopbackRelay() { stop(); }
+
+	// Start to relay the packets to target, return the port of the relay on 127.0.0.1 (0 if failed)
+	UInt16	start(const sockaddr_in& target) {
+		_target = target;
+		UInt16 port = LoopbackBind(_socket);
+		if (!port) {
+			stop();
+			return 0;
+		}
+		_running = true;
+		_thread = std::thread([this]() { run(); });
+		return port;
+	}
+
+	void	stop() {
+		_running = false;
+		if (_thread.joinable())
+			_thread.join();
+		if (_socket >= 0)
+			::close(_socket);
+		_socket = -1;
+	}
+
+	std::atomic<bool>		blackout; // drop all the packets
+	std::atomic<UInt8>		loss; // percentage of the packets dropped randomly
+	std::atomic<UInt64>		forwarded;
+	std::atomic<UInt64>		dropped;
+
+private:
+	void	run() {
+		UInt8 data[RTMFP::SIZE_PACKET_MAX];
+		sockaddr_in address, client;
+		bool connected(false);
+		while (_running) {
+			socklen_t size(sizeof(address));
+			ssize_t received = ::recvfrom(_socket, data, sizeof(data), 0, (sockaddr*)&address, &size);
+			if (received <= 0)
+				continue;
+			bool fromTarget(address.sin_port == _target.sin_port && address.sin_addr.s_addr == _target.sin_addr.s_addr);
+			if (!fromTarget && !connected) {
+				client = address;
+				connected = true;
+			} else if (fromTarget && !connected)
+				continue;
+			if (blackout || (loss && (Util::Random<UInt32>() % 100) < loss)) {
+				++dropped;
+				continue;
+			}
+			++forwarded;
+			::sendto(_socket, data, received, 0, (const sockaddr*)(fromTarget ? &client : &_target), sizeof(sockaddr_in));
+		}
+	}
+
+	int					_socket;
+	std::atomic<bool>	_running;
+	std::thread			_thread;
+	sockaddr_in			_target;
+};
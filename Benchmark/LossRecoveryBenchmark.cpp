@@ -0,0 +1,273 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "librtmfp.h"
+#include "LoopbackServer.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace Base;
+using namespace std;
+
+#define RECOVERY_STREAM		"recovery"
+#define RECOVERY_WARMUP		2000 // time (in msec) to send before each blackout and before the random loss
+#define RECOVERY_READ_SIZE	0x100000
+#define RECOVERY_KEY_PERIOD	25 // number of video frames between each key frame
+
+/*************************************************
+Recovery of a P2P session after blackouts and
+under random loss : one publisher and one player
+connected to the LoopbackServer, the P2P packets
+go through a LoopbackRelay which drops them.
+- Blackouts : all the packets are dropped (packets
+and acknowledgments of the whole sending window),
+the flow has recovered when the player receives a
+video frame sent after the blackout. Exit with 1 if
+it has not recovered before the timeout
+- Random loss : a percentage of the packets is
+dropped in both directions, the frames delivered,
+their latency and the recovery work (repeats,
+abandons, drops) are measured, with or without the
+forward error correction of the publication
+Usage : LossRecoveryBenchmark [blackout] [count] [timeout] [rate] [size] [loss] [duration] [fecBlock] [fecParities] [reliable]
+- blackout : duration of each blackout in msec (1000)
+- count : number of blackouts, 0 to skip them (3)
+- timeout : maximum time to recover after a blackout in seconds (10)
+- rate : bitrate of the publisher in Mbps (2)
+- size : size of the video frames in bytes (4000)
+- loss : percentage of the packets dropped randomly, 0 to skip the measure (5)
+- duration : duration of the random loss measure in seconds (10)
+- fecBlock : number of media stages protected by the FEC parities, 0 to disable (0)
+- fecParities : number of FEC parities by block (1)
+- reliable : 1 to publish the media reliable, 0 to publish it unreliable (the frames lost are abandoned) (1)
+*/
+static Int64 MicroNow() { return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count(); }
+
+static void OnLog(unsigned int level, const char* fileName, long line, const char* message) {
+	fprintf(stderr, "%s[%ld] %s\n", fileName, line, message);
+}
+
+int main(int argc, char* argv[]) {
+	UInt32 blackout = (argc > 1) ? (UInt32)atoi(argv[1]) : 1000;
+	UInt32 count = (argc > 2) ? (UInt32)atoi(argv[2]) : 3;
+	UInt32 timeout = (argc > 3) ? (UInt32)atoi(argv[3]) : 10;
+	double rate = (argc > 4) ? atof(argv[4]) : 2;
+	UInt32 size = (argc > 5) ? (UInt32)atoi(argv[5]) : 4000;
+	UInt32 loss = (argc > 6) ? (UInt32)atoi(argv[6]) : 5;
+	UInt32 duration = (argc > 7) ? (UInt32)atoi(argv[7]) : 10;
+	UInt32 fecBlock = (argc > 8) ? (UInt32)atoi(argv[8]) : 0;
+	UInt32 fecParities = (argc > 9) ? (UInt32)atoi(argv[9]) : 1;
+	UInt16 reliable = (argc > 10) ? (UInt16)atoi(argv[10]) : 1;
+	if (!blackout || !timeout || rate <= 0 || size < 29 || size > 0xFFFFFF || loss > 100 || !duration || fecBlock > 255 || !fecParities || fecParities > 255) {
+		fprintf(stderr, "blackout, timeout, rate and duration must be positive, size must be between 29 and 16777215, loss between 0 and 100, fecBlock between 0 and 255, fecParities between 1 and 255\n");
+		return 1;
+	}
+
+	LoopbackServer server;
+	UInt16 port = server.start();
+	if (!port) {
+		fprintf(stderr, "Unable to start the loopback server\n");
+		return 1;
+	}
+	char url[64];
+	snprintf(url, sizeof(url), "rtmfp://127.0.0.1:%u/loopback", port);
+
+	RTMFPConfig config;
+	RTMFP_Init(&config, NULL, OnLog, NULL);
+	RTMFP_SetIntParameter("logLevel", LOG_WARN);
+	RTMFP_SetIntParameter("fecBlock", fecBlock);
+	RTMFP_SetIntParameter("fecParities", fecParities);
+
+	// Publisher, its P2P session goes through the relay
+	LoopbackRelay relay;
+	sockaddr_in address;
+	string peerId;
+	unsigned int publisher(0), player(0);
+	unsigned short streamId(0);
+	UInt16 relayPort(0);
+	if (!(publisher = RTMFP_Connect(url, &config)) || RTMFP_WaitForEvent(publisher, RTMFP_CONNECTED) <= 0 || (peerId = server.peerId(0)).empty()
+		|| !server.peerAddress(0, address) || !(relayPort = relay.start(address)) || !RTMFP_PublishP2P(publisher, RECOVERY_STREAM, reliable, reliable, 0)) {
+		fprintf(stderr, "Unable to connect the publisher\n");
+		RTMFP_Terminate();
+		return 1;
+	}
+	server.redirect(0, relayPort);
+	if (!(player = RTMFP_Connect(url, &config)) || RTMFP_WaitForEvent(player, RTMFP_CONNECTED) <= 0 || !(streamId = RTMFP_Connect2Peer(player, peerId.c_str(), RECOVERY_STREAM, 1))) {
+		fprintf(stderr, "Unable to connect the player\n");
+		RTMFP_Terminate();
+		return 1;
+	}
+
+	// Reader, it saves the reception time of the first frame sent after the end of the blackout
+	// and the latency of the frames marked by the writer during the random loss measure
+	atomic<Int64> blackoutEnd(0), recoveredAt(0);
+	atomic<bool> measuring(false);
+	atomic<UInt64> frames(0);
+	atomic<UInt32> firstFrame(0); // index of the first frame received (the frames sent before the play start are not counted)
+	vector<UInt32> latencies; // in usec, read after the end of the reader
+	latencies.reserve(size_t(rate * 1000000 / 8 / size * duration * 1.2));
+	thread reader([&]() {
+		vector<char> buffer(RECOVERY_READ_SIZE);
+		string pending;
+		bool header(true);
+		int read;
+		while ((read = RTMFP_Read(streamId, player, buffer.data(), buffer.size())) > 0) {
+			Int64 now = MicroNow();
+			pending.append(buffer.data(), read);
+			BinaryReader reader(BIN pending.data(), pending.size());
+			if (header) {
+				if (reader.available() < 13)
+					continue;
+				reader.next(13);
+				header = false;
+			}
+			while (reader.available() >= 11) {
+				const UInt8* tag = reader.current();
+				UInt32 tagSize = BinaryReader(tag + 1, 3).read24();
+				if (reader.available() < tagSize + 15)
+					break; // wait the end of the tag
+				reader.next(tagSize + 15);
+				if (*tag != AMF::TYPE_VIDEO || tagSize < 13 || tag[12] != 1)
+					continue; // only the video frames (not the codec infos)
+				if (!frames++)
+					firstFrame = BinaryReader(tag + 25, 4).read32();
+				Int64 time(BinaryReader(tag + 16, 8).read64()), end(blackoutEnd);
+				if (end && !recoveredAt && time >= end)
+					recoveredAt = now;
+				if (tag[24])
+					latencies.emplace_back(UInt32(now - time)); // sent during the random loss measure
+			}
+			pending.erase(0, reader.position());
+		}
+	});
+
+	// Publisher, it sends video frames at a constant rate with the codec infos before each key frame
+	atomic<bool> running(true);
+	atomic<UInt64> sent(0), measureSent(0);
+	thread writer([&]() {
+		UInt8 codecInfos[11 + 9 + 4];
+		BinaryWriter(codecInfos, sizeof(codecInfos)).write8(AMF::TYPE_VIDEO).write24(9).write32(0).write24(0).write(EXPAND("\x17\x00\x00\x00\x00\x01\x42\x00\x1E")).write32(11 + 9);
+		vector<UInt8> tag(11 + size + 4);
+		BinaryWriter(tag.data(), tag.size()).write8(AMF::TYPE_VIDEO).write24(size).write32(0).write24(0).next(size).write32(11 + size);
+		tag[12] = 1; // AVC NALU
+		if (RTMFP_Write(publisher, "FLV\x01\x01\x00\x00\x00\x09\x00\x00\x00\x00", 13) < 0)
+			return;
+
+		chrono::microseconds interval(Int64(size * 8 / rate));
+		auto start = chrono::steady_clock::now();
+		for (UInt32 frame = 0; running; ++frame) {
+			this_thread::sleep_until(start + interval * frame);
+			UInt32 time = UInt32(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+			if (!(frame % RECOVERY_KEY_PERIOD)) {
+				BinaryWriter(codecInfos + 4, 4).write24(time).write8(time >> 24);
+				if (RTMFP_Write(publisher, STR codecInfos, sizeof(codecInfos)) < 0)
+					return;
+			}
+			BinaryWriter(tag.data() + 4, 4).write24(time).write8(time >> 24);
+			tag[11] = (frame % RECOVERY_KEY_PERIOD) ? 0x27 : 0x17;
+			BinaryWriter(tag.data() + 16, 8).write64(MicroNow());
+			tag[24] = measuring ? 1 : 0; // mark the frames of the random loss measure, to count the same frames on both sides
+			BinaryWriter(tag.data() + 25, 4).write32(frame);
+			if (RTMFP_Write(publisher, STR tag.data(), tag.size()) < 0)
+				return;
+			++sent;
+			if (tag[24])
+				++measureSent;
+		}
+	});
+
+	int result(0);
+	printf("%.1f Mbps, frames of %u bytes, %s media, FEC %u/%u\n", rate, size, reliable ? "reliable" : "unreliable", fecBlock, fecParities);
+
+	// Blackouts
+	for (UInt32 i = 0; i < count && !result; ++i) {
+		UInt64 received(frames);
+		this_thread::sleep_for(chrono::milliseconds(RECOVERY_WARMUP));
+		if (frames == received) {
+			printf("Blackout %u : no frame received before the blackout\n", i + 1);
+			result = 1;
+			break;
+		}
+		UInt64 dropped(relay.dropped);
+		recoveredAt = 0;
+		relay.blackout = true;
+		this_thread::sleep_for(chrono::milliseconds(blackout));
+		relay.blackout = false;
+		blackoutEnd = MicroNow();
+		Int64 limit(blackoutEnd + Int64(timeout) * 1000000);
+		while (!recoveredAt && MicroNow() < limit)
+			this_thread::sleep_for(chrono::milliseconds(10));
+		if (!recoveredAt) {
+			printf("Blackout %u of %ums : not recovered after %us (%llu packets dropped)\n", i + 1, blackout, timeout, (unsigned long long)(relay.dropped - dropped));
+			result = 1;
+		} else
+			printf("Blackout %u of %ums : recovered in %.1fms (%llu packets dropped)\n", i + 1, blackout, (recoveredAt - blackoutEnd) / 1000.0, (unsigned long long)(relay.dropped - dropped));
+		blackoutEnd = 0;
+	}
+
+	// Random loss
+	RTMFPStats statsStart, statsEnd;
+	UInt64 forwarded(0), dropped(0);
+	if (loss && !result) {
+		this_thread::sleep_for(chrono::milliseconds(RECOVERY_WARMUP));
+		RTMFP_GetStats(publisher, &statsStart);
+		forwarded = relay.forwarded;
+		dropped = relay.dropped;
+		relay.loss = UInt8(loss);
+		measuring = true;
+		this_thread::sleep_for(chrono::seconds(duration));
+		measuring = false;
+		relay.loss = 0;
+		forwarded = relay.forwarded - forwarded;
+		dropped = relay.dropped - dropped;
+		this_thread::sleep_for(chrono::milliseconds(RECOVERY_WARMUP)); // the last frames can still be repeated
+		RTMFP_GetStats(publisher, &statsEnd);
+	}
+
+	// Stop the publisher and let the last frames be delivered, to count all the frames lost
+	running = false;
+	writer.join();
+	Int64 limit(MicroNow() + RECOVERY_WARMUP * 1000);
+	while (frames < (sent - firstFrame) && MicroNow() < limit)
+		this_thread::sleep_for(chrono::milliseconds(10));
+	RTMFP_Close(player, 1);
+	reader.join();
+	RTMFP_Close(publisher, 1);
+	RTMFP_Terminate();
+	relay.stop();
+	server.stop();
+
+	if (loss && !result) {
+		UInt64 total(measureSent);
+		printf("Random loss of %u%% during %us : %.2f%% of the packets dropped\n", loss, duration, (forwarded + dropped) ? dropped * 100.0 / (forwarded + dropped) : 0);
+		printf("Frames sent during the random loss : %llu delivered / %llu (%.2f%%)\n", (unsigned long long)latencies.size(), (unsigned long long)total, total ? latencies.size() * 100.0 / total : 0);
+		printf("Publisher : %llu packets sent, %llu repeated, %llu abandons, %llu frames dropped before sending\n", statsEnd.packetsSent - statsStart.packetsSent,
+			statsEnd.retransmissions - statsStart.retransmissions, statsEnd.abandons - statsStart.abandons, statsEnd.drops - statsStart.drops);
+		if (!latencies.empty()) {
+			sort(latencies.begin(), latencies.end());
+			printf("Latency : p50 %.3fms, p99 %.3fms, max %.3fms\n", latencies[latencies.size() / 2] / 1000.0, latencies[latencies.size() * 99 / 100] / 1000.0, latencies.back() / 1000.0);
+		} else
+			printf("Latency : no frame received\n");
+	}
+	UInt64 received(frames), total(sent - firstFrame);
+	printf("Frames of the whole run, from the first one received : %llu delivered / %llu sent (%.2f%%)\n", (unsigned long long)received, (unsigned long long)total, total ? received * 100.0 / total : 0);
+	return result;
+}
@@ -307,6 +307,12 @@ int main(int argc, char* argv[]) {
 			RTMFP_SetParameter("socketReceiveSize", argv[i] + 20);
 		else if (strlen(argv[i]) > 17 && strnicmp(argv[i], "--socketSendSize=", 17) == 0) // set the socketSendSize value
 			RTMFP_SetParameter("socketSendSize", argv[i] + 17);
+		else if (strlen(argv[i]) > 11 && strnicmp(argv[i], "--fecBlock=", 11) == 0) // for publish mode, forward error correction of the media (librtmfp peers only)
+			RTMFP_SetParameter("fecBlock", argv[i] + 11);
+		else if (strlen(argv[i]) > 14 && strnicmp(argv[i], "--fecParities=", 14) == 0) // for publish mode, number of parities by FEC block
+			RTMFP_SetParameter("fecParities", argv[i] + 14);
+		else if (strlen(argv[i]) > 16 && strnicmp(argv[i], "--lossInjection=", 16) == 0) // percentage of outgoing packets dropped (loss simulation, librtmfp compiled with LOSS=1)
+			RTMFP_SetParameter("lossInjection", argv[i] + 16);
 		else if (strlen(argv[i]) > 18 && strnicmp(argv[i], "--timeoutFallback=", 18) == 0) // for NetGroup mode, set the timeout for the unicast fallback
 			RTMFP_SetParameter("timeoutFallback", argv[i] + 18);
 		else if (strlen(argv[i]) > 15 && strnicmp(argv[i], "--updatePeriod=", 15) == 0) // for NetGroup mode (multicastAvailabilityUpdatePeriod)
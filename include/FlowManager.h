@@ -41,7 +41,7 @@ lists of RTMFPFlow and RTMFPWriter
 It is the base class of RTMFPSession and P2PSession
 */
 struct FlowManager : RTMFP::Output, BandWriter {
-	FlowManager(bool responder, Invoker& invoker, OnStatusEvent pOnStatusEvent);
+	FlowManager(bool responder, Invoker& invoker, OnStatusEvent pOnStatusEvent, const Base::shared<RTMFP::Stats>& pStats);
 
 	virtual ~FlowManager();
 
@@ -56,8 +56,27 @@ struct FlowManager : RTMFP::Output, BandWriter {
 
 	RTMFP::SessionStatus			status; // Session status (stopped, connecting, connected or failed)
 
-	// Latency (ping / 2)
-	Base::UInt16					latency() { return _ping >> 1; }
+	// Latency (ping / 2), from the packets RTT samples if available
+	Base::UInt16					latency() { return srtt() ? Base::UInt16(srtt() / 2000) : (_ping >> 1); }
+
+	// Smoothed round-trip time measured on acknowledged packets (in usec, 0 if no sample)
+	Base::UInt32					srtt() const { return _pSendSession ? _pSendSession->srtt.load() : 0; }
+
+	// Minimum round-trip time measured on acknowledged packets (in usec, 0 if no sample)
+	Base::UInt32					minRtt() const { return _pSendSession ? _pSendSession->minRtt.load() : 0; }
+
+	bool							deltaReports; // True if the peer reads the delta Group Reports (librtmfp only)
+
+	// Return the statistics of the connection (shared by the P2P sessions)
+	const Base::shared<RTMFP::Stats>&	stats() const { return _pStats; }
+
+	// Return the size of the messages partially received on the flows
+	Base::UInt64					fragmentation() const;
+
+	// Values of the sending session (0 if not connected)
+	double							sendLostRate() const { return _pSendSession ? _pSendSession->sendLostRate() : 0; }
+	Base::UInt64					sendByteRate() const { return _pSendSession ? _pSendSession->sendByteRate() : 0; }
+	Base::UInt64					sendQueueing() const { return _pSendSession ? _pSendSession->queueing.load() : 0; }
 
 	// Return true if the session has failed (we will not send packets anymore)
 	virtual bool					failed() { return (status == RTMFP::FAILED && _closeTime.isElapsed(19000)) || ((status == RTMFP::NEAR_CLOSED) && _closeTime.isElapsed(90000)); }
@@ -99,11 +118,15 @@ struct FlowManager : RTMFP::Output, BandWriter {
 
 
 	/* Implementation of RTMFPOutput */
-	Base::UInt32							rto() const { return _rto; }
+	// Retransmission timeout, from the packets RTT samples if available, otherwise from the ping
+	Base::UInt32							rto() const { return (_pSendSession && _pSendSession->rto) ? _pSendSession->rto.load() : _rto; }
 	// Send function used by RTMFPWriter to send packet with header
 	void									send(Base::shared<RTMFPSender>&& pSender);
 	virtual Base::UInt64					queueing() const { return 0; }
 
+	// Return the size of the media received and waiting to be read by the application (to compute the receiver window)
+	virtual Base::UInt64					readQueueSize() { return 0; }
+
 protected:
 
 	Base::Buffer&				write(Base::UInt8 type, Base::UInt16 size);
@@ -165,10 +188,13 @@ protected:
 	bool												_responder; // is responder?
 	Base::shared<Handshake>							_pHandshake; // Handshake object if not connected
 
+	const Base::shared<RTMFP::Stats>					_pStats; // statistics of the connection
 	Base::Packet										_sharedSecret; // shared secret for crypted communication
 	Base::shared<Base::Buffer>						_farNonce; // far nonce (saved for p2p group key building)
 	Base::shared<Base::Buffer>						_nonce; // Our Nonce for key exchange, can be of size 0x4C or 0x49 for responder
 
+	Base::UInt8											_deltaRequests; // number of delta Group Reports requests (0x6b) still to send to know if the peer reads them
+
 private:
 
 	// Remove all messages from the writers (before closing)
@@ -186,6 +212,19 @@ private:
 	// Send the waiting messages
 	void												flushWriters();
 
+	// Send the waiting acknowledgments, bundled in the minimum of packets
+	void												flushAcks();
+
+	// Send the chunk written with write() alone in a packet, outside of the sending session
+	// Required for the chunks unknown by the other implementations (librtmfp only), they ignore the rest of a packet after an unknown chunk
+	void												sendAlone();
+
+	// Send a padded probe of _probeSize bytes (path MTU discovery)
+	void												sendProbe();
+
+	// Compute the next size to probe (0 if the discovery is finished)
+	void												nextProbe();
+
 	// Update the ping value
 	void												setPing(Base::UInt16 time, Base::UInt16 timeEcho);
 
@@ -210,6 +249,27 @@ private:
 	Base::shared<RTMFPSender::Session>										_pSendSession; // session for sending packets
 	Base::UInt16																_threadSend; // Thread used to send last message
 
+	// acknowledgments members
+	std::map<Base::UInt64, Base::UInt64>										_waitingAcks; // Map of flow id to last stage received waiting acknowledgment
+	Base::UInt32																_ackPackets; // Number of data packets received since the last acknowledgment
+	Base::Time																	_ackTime; // Time of the first acknowledgment waiting
+	const Base::UInt32															_maxAckPackets; // Number of data packets to receive before acknowledging ("ackPackets" parameter)
+	const Base::UInt32															_maxAckDelay; // Maximum delay before acknowledging ("ackDelay" parameter)
+
+	// path MTU discovery members
+	Base::UInt32																_probeSize; // size of the current probe (0 if the discovery is finished)
+	Base::UInt32																_probeMin; // largest size acknowledged
+	Base::UInt32																_probeMax; // smallest size lost
+	Base::UInt8																	_probeCount; // number of probes sent with the current size
+	Base::Time																	_probeTime; // time of the last probe
+
+	// forward error correction members
+	Base::UInt8																	_fecRequests; // number of FEC requests (0x6c) still to send to know if the peer decodes the parities
+	Base::Time																	_fecTime; // time of the last FEC request
+
+	// delta Group Reports members
+	Base::Time																	_deltaTime; // time of the last delta Group Reports request
+
 	// writers members
 	std::map<Base::UInt64, Base::shared<RTMFPWriter>>						_flowWriters; // Map of writers identified by id
 	Base::UInt64																_nextRTMFPWriterId; // Writer id to use for the next writer to create
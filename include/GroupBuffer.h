@@ -24,14 +24,23 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "Base/Thread.h"
 #include "PeerMedia.h"
 
+#define GROUPBUFFER_REQUESTS		4096	// capacity of the requests ring (power of 2)
+
 /************************************************************************
 GroupBuffer is a thread class used to queue fragments for unfragmenting 
 It reorder the packets and merge splitted fragments and then
 push the media packets to the invoker.
-
+The requests are queued without lock (the producer is always the handler
+thread) and processed by batch at each wake up.
 */
 struct GroupBuffer : private Base::Thread {
-	struct Result : std::deque<RTMFP::MediaPacket>, virtual Base::Object {
+	// Media packet ready for reading, with the id of the media which has subscribed to the stream
+	struct MediaPacket : RTMFP::MediaPacket, virtual Base::Object {
+		MediaPacket(Base::UInt16 mediaId, const Base::Packet& packet, Base::UInt32 time, AMF::Type type) : RTMFP::MediaPacket(packet, time, type), mediaId(mediaId) {}
+
+		const Base::UInt16 mediaId;
+	};
+	struct Result : std::deque<MediaPacket>, virtual Base::Object {
 		Result() {}
 	};
 	typedef Base::Event<void(Result&)>		ON(NextPacket); // Called when at least one media packet is ready for reading
@@ -49,7 +58,9 @@ struct GroupBuffer : private Base::Thread {
 	bool	removeFragments(Base::Exception& ex, Base::UInt32 groupMediaId, Base::UInt64 fragmentId);
 
 	// Start processing a GroupMedia fragments (after receiving the first pull fragment)
-	bool	startProcessing(Base::Exception& ex, Base::UInt32 groupMediaId);
+	// mediaId : id of the media to which the packets are forwarded
+	// firstFragment : if not 0 the fragments before are ignored (fast join)
+	bool	startProcessing(Base::Exception& ex, Base::UInt32 groupMediaId, Base::UInt16 mediaId, Base::UInt64 firstFragment=0);
 
 private:
 	bool	run(Base::Exception&, const volatile bool& requestStop);
@@ -62,33 +73,62 @@ private:
 			REMOVE_BUFFER
 		};
 
-		WaitRequest(Command command, Base::UInt32 groupMediaId, const Base::shared<GroupFragment>& pFragment=nullptr, Base::UInt64 fragmentId=0) :
-			pFragment(pFragment), fragmentId(fragmentId), groupMediaId(groupMediaId), command(command) {}
+		WaitRequest() : fragmentId(0), groupMediaId(0), mediaId(0), command(START_PROCESSING) {}
+		WaitRequest(Command command, Base::UInt32 groupMediaId, const Base::shared<GroupFragment>& pFragment=nullptr, Base::UInt64 fragmentId=0, Base::UInt16 mediaId=0) :
+			pFragment(pFragment), fragmentId(fragmentId), groupMediaId(groupMediaId), mediaId(mediaId), command(command) {}
 
 		Base::shared<GroupFragment>					pFragment; // current fragment
-		Base::UInt64								fragmentId; // Current fragment Id of the current GroupMedia for deletion of old fragments
+		Base::UInt64								fragmentId; // Current fragment Id of the current GroupMedia for deletion of old fragments (or first fragment to process)
 		Base::UInt32								groupMediaId; // Current stream key
+		Base::UInt16								mediaId; // Media to which the packets are forwarded (start processing)
 		Command										command; // request command
 	};
+	// Ring of requests for one producer and one consumer
+	struct Requests : virtual Object {
+		Requests() : _requests(GROUPBUFFER_REQUESTS), _tail(0), _headCache(0), _head(0), _read(0) {}
+
+		// Producer : add a request, return false if the ring is full
+		// wasEmpty is set to true if the consumer has read all the previous requests (it can be waiting)
+		bool			push(const WaitRequest& request, bool& wasEmpty);
+
+		// Consumer : return the number of requests available from at(0) (the batch)
+		Base::UInt32	available() const { return _tail.load() - _read; }
+		WaitRequest&	at(Base::UInt32 index) { return _requests[(_read + index) & (GROUPBUFFER_REQUESTS - 1)]; }
+		// Consumer : release the count first requests
+		void			pop(Base::UInt32 count);
+	private:
+		std::vector<WaitRequest>	_requests;
+		// producer members
+		std::atomic<Base::UInt32>	_tail; // index of the next request to write
+		Base::UInt32				_headCache; // last index read by the producer of the next request to read
+		char						_padding[64]; // producer and consumer members on different cache lines
+		// consumer members
+		std::atomic<Base::UInt32>	_head; // index of the next request to read
+		Base::UInt32				_read; // _head of the consumer
+	};
+
+	// Queue the request for the thread (start it if needed)
+	bool	queue(const WaitRequest& request);
+
 	// Process request
-	void	processRequest(std::deque<RTMFP::MediaPacket>& result, WaitRequest& request);
+	void	processRequest(Result& result, WaitRequest& request);
 
 	struct MediaBuffer : MAP_FRAGMENTS, virtual Base::Object {
-		MediaBuffer() : currentId(0), started(false) {}
+		MediaBuffer() : currentId(0), started(false), mediaId(0) {}
 
 		Base::UInt64	currentId; // current fragment id (last fragment sent)
 		bool			started; // true if we can process the fragments (a pull fragment has been received)
+		Base::UInt16	mediaId; // media to which the packets are forwarded
 	};
 	// Process one fragment
-	bool	processFragment(std::deque<RTMFP::MediaPacket>& result, Base::UInt32 groupMediaId, MediaBuffer& buffer, MAP_FRAGMENTS_ITERATOR& itFragment);
+	bool	processFragment(Result& result, Base::UInt32 groupMediaId, MediaBuffer& buffer, MAP_FRAGMENTS_ITERATOR& itFragment);
 
 	// Remove the fragments & try to process remaining fragments
-	void	processRemoveFragments(const std::map<Base::UInt32, MediaBuffer>::iterator& itBuffer, std::deque<RTMFP::MediaPacket>& result, WaitRequest& request);
+	void	processRemoveFragments(const std::map<Base::UInt32, MediaBuffer>::iterator& itBuffer, Result& result, WaitRequest& request);
 
 	// Add the fragment & try to process
-	void	processAddFragment(std::map<Base::UInt32, MediaBuffer>::iterator& itBuffer, std::deque<RTMFP::MediaPacket>& result, WaitRequest& request);
+	void	processAddFragment(std::map<Base::UInt32, MediaBuffer>::iterator& itBuffer, Result& result, WaitRequest& request);
 
-	std::mutex								_mutex;
 	std::map<Base::UInt32, MediaBuffer>		_mapGroupMedia2fragments; // GroupMedia id to map of fragments
-	std::deque<WaitRequest>					_waitingRequests; // Fragments waiting to be added
+	Requests								_requests; // Requests waiting to be processed
 };
@@ -34,7 +34,7 @@ from a NetGroup connection
 struct GroupMedia : virtual Base::Object {
 	typedef Base::Event<void(Base::UInt32 groupMediaId, const Base::shared<GroupFragment>& pFragment)>	ON(NewFragment); // called on reception of a new fragment
 	typedef Base::Event<void(Base::UInt32 groupMediaId, Base::UInt64 fragmentId)>							ON(RemovedFragments); // called when removing a group of fragments
-	typedef Base::Event<void(Base::UInt32 groupMediaId)>													ON(StartProcessing); // called when the first pull fragment is received, we can start processing fragments
+	typedef Base::Event<void(Base::UInt32 groupMediaId, Base::UInt64 firstFragment)>						ON(StartProcessing); // called when the first pull fragment is received, we can start processing fragments (from firstFragment if not 0)
 	typedef Base::Event<void(Base::UInt32 groupMediaId)>													ON(PullTimeout); // called when the pull congestion timeout is reached
 
 	GroupMedia(const std::string& name, const std::string& key, const Base::shared<RTMFPGroupConfig>& parameters, bool audioReliable, bool videoReliable);
@@ -42,6 +42,9 @@ struct GroupMedia : virtual Base::Object {
 
 	void						printStats();
 
+	// Update the NetGroup values of the stream statistics
+	void						updateStats(RTMFP::StreamStats& stats);
+
 	// Close the Group Media (when receiving onClosedMedia notification)
 	void						close(Base::UInt64 lastFragment);
 
@@ -61,9 +64,21 @@ struct GroupMedia : virtual Base::Object {
 	// Return true if we have at least one fragment
 	bool						hasFragments() { return !_fragments.empty(); }
 
+	// Return the stream name
+	const std::string&			stream() const { return _stream; }
+
+	// Return the number of fragments received from the peers, the number of duplicates and their size
+	Base::UInt64				fragmentsIn() const { return _fragmentsIn; }
+	Base::UInt64				duplicatesIn() const { return _duplicatesIn; }
+	Base::UInt64				duplicateBytesIn() const { return _duplicateBytesIn; }
+
 	// Create a new fragment that will call a function
 	void						callFunction(const std::string& function, std::queue<std::string>& arguments);
 
+	// Return true if a tested peer must replace the pusher of a push mask, both counted on the same fragments (from the start of the test)
+	// A pusher which has sent nothing (stalled) or less fragments received first is replaced
+	static bool					IsBetterPusher(Base::UInt32 first, Base::UInt32 duplicates, Base::UInt32 pusherFirst, Base::UInt32 pusherDuplicates);
+
 	GroupListener::OnMedia						onMedia; // Create a new fragment from a media packet
 	GroupListener::OnFlush						onFlush; // Flush the listeners
 
@@ -75,8 +90,90 @@ private:
 	#define MAP_PEERS_INFO_TYPE std::map<std::string, Base::shared<PeerMedia>>
 	#define MAP_PEERS_INFO_ITERATOR_TYPE std::map<std::string, Base::shared<PeerMedia>>::iterator
 
+	/**********************************************
+	Circular store of the fragments indexed by id,
+	the oldest fragments are evicted by time from the head
+	and a presence bitmap is maintained on each change
+	*/
+	struct FragmentStore : virtual Base::Object {
+		FragmentStore();
+
+		bool							empty() const { return !_count; }
+		Base::UInt32					size() const { return _count; }
+		Base::UInt32					capacity() const { return (Base::UInt32)_slots.size(); }
+		Base::UInt64					first() const { return _first; } // oldest fragment id (0 if empty)
+		Base::UInt64					last() const { return _last; } // newest fragment id (0 if empty)
+		// Return true if the fragments before the head have already been evicted
+		bool							evicted() const { return _evicted; }
+		bool							has(Base::UInt64 id) const { return _count && id >= _first && id <= _last && ((_bits[(id & _mask) >> 6] >> (id & 63)) & 1); }
+		// Return the first fragment id >= id not present (skipping the fragments present by words)
+		Base::UInt64					nextMissing(Base::UInt64 id) const;
+		// Return the fragment or null if not present
+		const Base::shared<GroupFragment>&	get(Base::UInt64 id) const;
+
+		// Return true if the fragment id is in the range that the store can hold with the fragments already stored
+		bool							accepts(Base::UInt64 id) const;
+		// Add a fragment not present and accepted, return the fragment added
+		const Base::shared<GroupFragment>&	add(Base::UInt64 id, const Base::Packet& packet, Base::UInt32 time, Base::UInt8 mediaType, Base::UInt8 marker, Base::UInt8 splitedNumber);
+		// Evict the fragments before the first media (DATA or START fragment) received after time
+		// Return the new first fragment id, 0 if nothing is evicted
+		Base::UInt64					evict(Base::Int64 time);
+		// Write the presence bits of the fragments last-1 to first (fragments map format)
+		void							writeMap(Base::BinaryWriter& writer) const;
+
+		bool							changed; // true if the fragments have changed since the last fragments map
+
+	private:
+		struct Slot {
+			Slot() : time(0) {}
+			Base::shared<GroupFragment>	pFragment;
+			Base::Int64					time; // reception time if it is a time reference (newest DATA or START fragment), 0 otherwise
+		};
+		// Increase the capacity to store the fragments from first to last
+		void							reserve(Base::UInt64 first, Base::UInt64 last);
+		// Return the presence bits of the fragments id to id+63 (bit 0 is the fragment id)
+		Base::UInt64					read64(Base::UInt64 id) const;
+
+		std::vector<Slot>				_slots; // fragments indexed by id modulo the capacity (power of 2)
+		std::vector<Base::UInt64>		_bits; // presence bits, indexed like the slots (only the fragments present are set)
+		Base::UInt64					_mask; // capacity - 1
+		Base::UInt64					_first;
+		Base::UInt64					_last;
+		Base::UInt32					_count;
+		Base::UInt64					_lastReference; // id of the last time reference
+		bool							_evicted;
+	};
+
+	// Push statistics of a peer for one push mask
+	struct PushStats {
+		PushStats() : first(0), duplicates(0), backoff(0), retry(0) {}
+
+		Base::UInt32				first; // fragments pushed by the peer and received first since the last comparison
+		Base::UInt32				duplicates; // fragments pushed by the peer and already received (or too old) since the last comparison
+		Base::UInt32				backoff; // delay before testing again the peer after a back off (in msec, doubled at each back off)
+		Base::Int64					retry; // time when the peer can be tested again
+	};
+	// Pushers of one push mask (fragment id modulo 8)
+	struct PushMask {
+		PushMask() : duplicates(0) {}
+
+		std::string								pusher; // peer id of the fastest pusher (empty if none)
+		Base::UInt64							duplicates; // total of the pushed fragments of this mask already received
+		std::map<std::string, PushStats>		peers; // statistics of the peers tested for this mask
+	};
+
+	// Pull request waiting for a fragment
+	struct PullRequest : virtual Base::Object {
+		PullRequest() : pPeer(NULL), timeout(0), tries(0) {}
+
+		Base::Time					time; // time of the last request
+		PeerMedia*					pPeer; // peer requested (null if it has been removed)
+		Base::UInt32				timeout; // delay before sending back the request to another peer (in msec)
+		Base::UInt8					tries; // number of requests sent
+	};
+
 	// Add a new fragment to the map _fragments
-	void						addFragment(MAP_FRAGMENTS_ITERATOR& itFragment, bool reliable, PeerMedia* pPeer, Base::UInt8 marker, Base::UInt64 fragmentId, Base::UInt8 splitedNumber, Base::UInt8 mediaType, Base::UInt32 time, const Base::Packet& packet, bool flush);
+	void						addFragment(bool reliable, PeerMedia* pPeer, Base::UInt8 marker, Base::UInt64 fragmentId, Base::UInt8 splitedNumber, Base::UInt8 mediaType, Base::UInt32 time, const Base::Packet& packet, bool flush);
 
 	// Update the fragment map
 	// Return 0 if there is no fragments, otherwise the last fragment number
@@ -88,19 +185,36 @@ private:
 	// Calculate the push play mode balance and send the requests if needed
 	void						sendPushRequests();
 
+	// Count the fragment pushed by the peer and compare it to the current pusher of the mask when it has enough samples
+	void						updatePushers(PeerMedia& peer, const std::string& peerId, Base::UInt64 fragmentId, bool duplicate);
+
+	// Stop the push of the mask by the peer and delay its next test
+	void						backOffPusher(PeerMedia& peer, Base::UInt8 mask, PushStats& stats);
+
 	// Send the Pull requests if needed
 	void						sendPullRequests();
 
+	// Fast join : pull the latest fragments without waiting the fetch period, and the older ones by batches until receiving the video codec infos
+	// return : False when the fetch period is elapsed (the normal pull requests can start)
+	bool						sendJoinRequests();
+
+	// Send back the timed out requests (or requests of removed peers) to another peer
+	void						resendPullRequests();
+
 	// Send the fragments Map to one random peer or all peers
 	void						sendFragmentsMap();
 
-	// Go to the next peer for pull or push
+	// Go to the next peer for push or fragments map
 	// idFragment : if > 0 it will test the availability of the fragment
 	// ascending : order of the research
 	bool						getNextPeer(MAP_PEERS_INFO_ITERATOR_TYPE& itPeer, bool ascending, Base::UInt64 idFragment, Base::UInt8 mask);
 
-	// Send the fragment pull request to the next available peer
-	bool						sendPullToNextPeer(Base::UInt64 idFragment);
+	// Send the fragment pull request to the peer with the lowest pull cost having the fragment and not at its pull limit
+	// pExcluded : peer which has timed out, used only if no other peer is available
+	bool						sendPullToBestPeer(Base::UInt64 idFragment, PeerMedia* pExcluded = NULL);
+
+	// Send the fragment pull request to the peer and save the request
+	void						sendPull(Base::UInt64 idFragment, PeerMedia& peer);
 
 	// Remove the peer from the map
 	void						removePeer(const std::string& peerId);
@@ -124,8 +238,13 @@ private:
 	Base::Time													_lastFragment; // last time we received a fragment
 	bool														_pullPaused; // True if no fragments have been received since fetch period
 
-	MAP_FRAGMENTS												_fragments;
-	std::map<Base::Int64, Base::UInt64>							_mapTime2Fragment; // Map of time to fragment (only START and DATA fragments are referenced)
+	FragmentStore												_fragments;
+	Base::UInt64												_fragmentsMapLast; // last fragment id of the fragments map buffer (0 if not generated)
+
+	// duplicates members
+	Base::UInt64												_fragmentsIn; // number of fragments received
+	Base::UInt64												_duplicatesIn; // number of fragments received and already known (or too old)
+	Base::UInt64												_duplicateBytesIn; // size of the duplicate fragments received
 	Base::UInt64												_fragmentCounter; // Current fragment counter (only for publisher)
 
 	Base::Buffer												_fragmentsMapBuffer; // General buffer for fragments map
@@ -141,18 +260,21 @@ private:
 	LIST_PEERS_INFO_TYPE										_listPeers; // list of peers in order of connection for sending fragments
 	MAP_PEERS_INFO_ITERATOR_TYPE								_itFragmentsPeer; // Current peer for fragments map requests
 	MAP_PEERS_INFO_ITERATOR_TYPE								_itPushPeer; // Current peer for push request
-	MAP_PEERS_INFO_ITERATOR_TYPE								_itPullPeer; // Current peer for pull request
 
 	// Pushers calculation
 	Base::UInt8													_currentPushMask; // current mask analyzed
-	std::map<Base::UInt8, std::pair<std::string, Base::UInt64>>	_mapPushMasks; // Map of push IN mask to a pair of peerId/fragmentId
+	PushMask													_pushMasks[8]; // Pushers and push statistics by push IN mask index
 
-	std::map<Base::UInt64, Base::Time>							_mapWaitingFragments; // Map of waiting fragments in Pull requests to the time of the request
+	std::map<Base::UInt64, PullRequest>							_mapWaitingFragments; // Map of waiting fragments to their pull request
 	std::map<Base::Int64, Base::UInt64>							_mapPullTime2Fragment; // Map of reception time to fragments map id (used for pull requests)
 	Base::UInt64												_lastFragmentMapId; // Last Fragments map Id received (used for pull requests)
 	Base::UInt64												_currentPullFragment; // Current pull fragment index
 	bool														_firstPullReceived; // True if we have received the first pull fragment => we can start writing
 
-	bool														_pullLimitReached; // True if the netgroup pull limit has been reached
-	Base::Time													_pullTimeout; // time of the pull limit reached event, used to release the onPullTimeout event
+	// fast join members
+	bool														_joining; // True until the fetch period is elapsed after the first fragments map if the fast join is enabled
+	Base::UInt64												_joinFragment; // first fragment pulled by the fast join (0 if not started)
+	Base::UInt64												_joinAnchor; // fragment of the video codec infos from which the reading starts (0 if not found)
+
+	Base::Time													_lastPullAnswer; // last time a pull request has been answered (or started waiting), used to release the onPullTimeout event
 };
@@ -0,0 +1,155 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Base/Mona.h"
+#include "RTMFP.h"
+#include <deque>
+
+#define HEARDLIST_MIN_CAPACITY			64	// initial size of the hash index (power of 2)
+
+// Group Address of a peer (sha256 of its raw peer ID), ordered as its hexadecimal format
+struct GroupAddress {
+	bool			operator<(const GroupAddress& other) const { return memcmp(value, other.value, PEER_ID_SIZE) < 0; }
+	bool			operator==(const GroupAddress& other) const { return memcmp(value, other.value, PEER_ID_SIZE) == 0; }
+	bool			operator!=(const GroupAddress& other) const { return !operator==(other); }
+
+	// Return the first 64 bits of the address (to estimate the peers count)
+	Base::UInt64	prefix() const { return Base::BinaryReader(value, sizeof(Base::UInt64)).read64(); }
+
+	Base::UInt8		value[PEER_ID_SIZE];
+};
+
+/**************************************************
+HeardList is the table of the peers known by a
+NetGroup (heard list and died peers).
+Each peer has a fixed size slot, found by binary
+peer ID with an open addressing hash index, and
+the peers are ordered by the time of their last
+Group Report in a min-heap to expire them
+*/
+struct HeardList : virtual Base::Object {
+
+	// Address of a peer, saved as in the Group Report (type, host and port)
+	struct Address {
+		Address() { data[0] = 0; }
+
+		bool				operator==(const Address& other) const { return ((data[0] ^ other.data[0]) & 0x80) == 0 && memcmp(data + 1, other.data + 1, size() - 1) == 0; }
+		bool				operator!=(const Address& other) const { return !operator==(other); }
+
+		// Return true if no address is set
+		bool				empty() const { return !data[0]; }
+		void				clear() { data[0] = 0; }
+
+		// Return the size of the address in a Group Report
+		Base::UInt8			size() const { return (data[0] & 0x80) ? 19 : 7; }
+
+		// Return the address type (unspecified if the address is a wildcard)
+		RTMFP::AddressType	type() const;
+
+		// Read the address from a Group Report, return false if there is no complete address to read
+		bool				read(Base::BinaryReader& reader);
+		void				write(Base::BinaryWriter& writer) const { writer.write(data, size()); }
+
+		void				set(const Base::SocketAddress& address, RTMFP::AddressType type);
+		Base::SocketAddress& get(Base::SocketAddress& address) const;
+
+		Base::UInt8			data[19]; // type (0x80 flag for IPv6), host and port
+	};
+
+	// Peer instance in the heard list
+	struct Peer {
+		// Return the binary peer ID (without the 210F header)
+		const Base::UInt8*	id() const { return rawId + 2; }
+
+		// Add a public or local address, return false if it is already known or if the slots are full
+		bool				addAddress(const Address& address);
+		bool				addAddress(const Base::SocketAddress& address, RTMFP::AddressType type);
+
+		// Set the host address (empty address to remove it)
+		void				setHostAddress(const Base::SocketAddress& address);
+
+		// Read the addresses of a Group Report, onNewAddress is called for each new address (can be null)
+		void				readAddresses(Base::BinaryReader& reader, const std::function<void(const Base::SocketAddress&, RTMFP::AddressType)>& onNewAddress);
+
+		// Write the size and the addresses for a Group Report
+		void				writeAddresses(Base::BinaryWriter& writer) const;
+
+		// Return the host address and the addresses in the format expected to connect to the peer
+		void				getAddresses(PEER_LIST_ADDRESS_TYPE& addresses, Base::SocketAddress& hostAddress) const;
+
+		Base::UInt8			rawId[PEER_ID_SIZE + 2]; // peer ID in binary format + header (210f)
+		GroupAddress		groupAddress;
+		Address				hostAddress; // address of the rendezvous service (redirection address)
+		Address				addresses[RTMFP_MAX_ADDRESSES];
+		Base::UInt8			addressesCount;
+		Base::UInt32		version; // incremented when the addresses change (delta Group Reports)
+		bool				died; // True if the peer has been disconnected, it is kept until its expiration
+		Base::Int64			lastGroupReport; // Time in msec of last Group report received (call HeardList::update to change it)
+
+	private:
+		friend struct HeardList;
+
+		Base::UInt32		_slot; // index in the table
+		Base::UInt32		_expiration; // position in the expiration heap
+	};
+
+	HeardList();
+
+	// Return the number of peers (alive and died)
+	Base::UInt32	count() const { return _count; }
+
+	// Return the peer with this binary ID (without header), NULL if unknown
+	Peer*			find(const Base::UInt8* id);
+
+	// Return the peer with this peer ID in hexadecimal format, NULL if unknown
+	Peer*			find(const std::string& peerId);
+
+	// Add a new peer (the raw ID must not be already known)
+	Peer&			add(const char* rawId, Base::Int64 lastGroupReport);
+
+	// Remove a peer from the table
+	void			remove(Peer& peer);
+
+	// Update the time of the last Group Report received from a peer
+	void			update(Peer& peer, Base::Int64 lastGroupReport);
+
+	// Return the peer with the oldest Group Report, NULL if the table is empty
+	Peer*			oldest() { return _expirations.empty() ? NULL : &_peers[_expirations[0]]; }
+
+private:
+	// Return the position of an ID in the hash index
+	Base::UInt32	position(const Base::UInt8* id) const;
+
+	// Resize the hash index and insert again all the peers
+	void			rehash(Base::UInt32 capacity);
+
+	// Move the peer of an heap position up or down until its place is found
+	void			siftUp(Base::UInt32 position);
+	void			siftDown(Base::UInt32 position);
+
+	std::deque<Peer>					_peers; // slots of the peers (deque to keep their address)
+	std::vector<Base::UInt32>			_freeSlots; // slots of the deleted peers
+	std::vector<Base::UInt32>			_index; // open addressing hash index of slot + 1 (0 if empty)
+	std::vector<Base::UInt32>			_expirations; // min-heap of slots ordered by last Group Report
+	Base::UInt32						_count;
+};
@@ -40,6 +40,9 @@ struct RTMFPSession;
 class RTMFPLogger;
 struct RTMFPGroupConfig;
 struct RTMFPConfig;
+struct RTMFPStats;
+struct RTMFPStreamStats;
+struct RTMFPHistogram;
 struct Invoker : private Base::Thread {
 
 	// Create the Invoker
@@ -101,6 +104,21 @@ struct Invoker : private Base::Thread {
 	// Bufferize an input packet from a stream/session pair (Thread-safe)
 	void			bufferizeMedia(Base::UInt32 RTMFPcontext, Base::UInt16 mediaId, Base::UInt32 time, const Base::Packet& packet, double lostRate, AMF::Type type);
 
+	// Return the size of the media packets waiting to be read on session RTMFPcontext (Thread-safe)
+	Base::UInt64	readQueueSize(Base::UInt32 RTMFPcontext);
+
+	// Fill the statistics of the session RTMFPcontext (Thread-safe, the values are read without locking the sessions)
+	// return: False if the session is not found
+	bool			getStats(Base::UInt32 RTMFPcontext, RTMFPStats& stats);
+
+	// Fill the statistics of the stream streamId of the session RTMFPcontext (Thread-safe)
+	// return: False if the stream is not found
+	bool			getStreamStats(Base::UInt32 RTMFPcontext, Base::UInt16 streamId, RTMFPStreamStats& stats);
+
+	// Fill the latency histogram of a stage of the session RTMFPcontext, reset it if reset is true (Thread-safe)
+	// return: False if the session is not found or if the histograms are not compiled (LIBRTMFP_HISTOGRAMS)
+	bool			getHistogram(Base::UInt32 RTMFPcontext, int stage, RTMFPHistogram& histogram, bool reset);
+
 	// Called by a connection to start decoding a packet from target
 	void			decode(int idConnection, Base::UInt32 idSession, const Base::SocketAddress& address, const Base::shared<RTMFP::Engine>& pEngine, Base::shared<Base::Buffer>& pBuffer, Base::UInt16& threadRcv);
 
@@ -284,13 +302,19 @@ private:
 	std::map<Base::UInt32, ConnectionBuffer>						_connection2Buffer; // map of connection ID to readding media buffers
 	std::mutex														_mutexRead; // mutex for read
 
+	/* Statistics of the sessions (RTMFP_GetStats) */
+	std::map<Base::UInt32, Base::shared<RTMFP::Stats>>			_mapStats; // map of connection ID to statistics
+	std::mutex														_mutexStats; // mutex for statistics, never locked by the sessions
+
 	/* MediaPacket temporary structure waiting buffering */
 	struct ReadPacket : Base::Runner, RTMFP::MediaPacket {
 		ReadPacket(Invoker& invoker, Base::UInt32 RTMFPcontext, Base::UInt16 mediaId, Base::UInt32 time, const Base::Packet& packet, double lostRate, AMF::Type type) :
 			invoker(invoker), idConn(RTMFPcontext), idMedia(mediaId), lostRate(lostRate), Base::Runner("ReadPacket"), RTMFP::MediaPacket(packet, time, type) {}
 
 		bool run(Base::Exception& ex) {
+			HISTOGRAM_ORIGIN(origin)
 			invoker.bufferizeMedia(idConn, idMedia, time, *this, lostRate, type);
+			HISTOGRAM_ORIGIN(0)
 			return true;
 		}
 
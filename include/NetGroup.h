@@ -27,6 +27,7 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "GroupListener.h"
 #include "GroupMedia.h"
 #include "GroupBuffer.h"
+#include "HeardList.h"
 #include <set>
 
 #define NETGROUP_MAX_REPORT_SIZE		20000 // max size used for NetGroup Report messages
@@ -35,10 +36,12 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #define NETGROUP_BEST_LIST_DELAY		10000	// delay between each best list calculation (in msec)
 #define NETGROUP_REPORT_DELAY			10000	// delay between each NetGroup Report (in msec)
 #define NETGROUP_PUSH_DELAY				2000	// delay between each push request (in msec)
+#define NETGROUP_PUSH_SAMPLES			16		// number of fragments pushed by a peer for a mask before comparing it to the current pusher
+#define NETGROUP_PUSH_BACKOFF_MAX		128000	// maximum delay before testing again a peer backed off for a push mask (in msec)
 #define NETGROUP_PULL_DELAY				100		// delay between each pull request (in msec)
 #define NETGROUP_PEER_TIMEOUT			300000	// number of msec since the last report known before we delete a peer from the heard list
 #define NETGROUP_DISCONNECT_DELAY		90000	// delay between each try to disconnect from a peer
-#define NETGROUP_MEDIA_TIMEOUT			300000	// number of msec before we delete a GroupMedia after being closed
+#define NETGROUP_MEDIA_TIMEOUT			300000	// number of msec before we delete a GroupMedia after being closed (or not subscribed and not announced anymore)
 #define NETGROUP_PROCESS_FGMT_TIMEOUT	50		// number of msec before exiting the processFragments function
 #define NETGROUP_MIN_PEERS_TIMEOUT		6		// number of p2p connections tries to reach before saying that a peer is p2p unable
 #define NETGROUP_TIMEOUT_P2PABLE		100000	// number of msec since the 6th connection try before closing the connection when it's p2p unable
@@ -46,14 +49,18 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #define NETGROUP_CLEAN_DELAY			19000	// delay betwen each Heard List clean (in msec)
 #define NETGROUP_TIMEOUT_P2PRATE		30000	// delay before disconnecting if p2p connection rate is too low (in msec)
 #define NETGROUP_RATE_MIN				3		// minimum rate of p2p connection to keep connection open
-#define NETGROUP_PULL_TIMEOUT			30000	// delay before disconnecting if a pull congestion is detected (in msec)
-#define NETGROUP_PULL_LIMIT				300		// maximum number of pull request after which we start the pull timeout count
+#define NETGROUP_PULL_TIMEOUT			30000	// delay without any pull request answered before disconnecting (pull congestion, in msec)
+#define NETGROUP_PULL_PEER_LIMIT		64		// maximum number of pull requests waiting for an answer from one peer
+#define NETGROUP_PULL_MIN_TIMEOUT		200		// minimum delay before sending back a pull request to another peer (in msec)
+#define NETGROUP_JOIN_BATCH				64		// number of older fragments pulled at each step of the fast join, until finding the video codec infos
 
 /**************************************
 NetGroup is the class that manage
 a NetGroup connection related to an
 RTMFPSession.
-It is composed of GroupMedia objects
+It is composed of GroupMedia objects,
+a player can subscribe to several streams
+sharing the same peers connections
 */
 struct NetGroup : FlashHandler, virtual Base::Object {
 public:
@@ -75,6 +82,14 @@ public:
 	// Close the NetGroup
 	void			close();
 
+	// Subscribe to another stream of the NetGroup (only for a player), the stream will be read with mediaId
+	// return false if we are publisher or if the stream is already subscribed
+	bool			addStream(Base::UInt16 mediaId, const std::string& streamName, bool audioReliable, bool videoReliable);
+
+	// Unsubscribe from the stream read with mediaId
+	// return false if the stream is not found or if we are publisher
+	bool			removeStream(Base::UInt16 mediaId);
+
 	// Add a peer to the Heard List
 	// param update : if set to True we will recalculate the best list after
 	void			addPeer2HeardList(const std::string& peerId, const char* rawId, const PEER_LIST_ADDRESS_TYPE& listAddresses, const Base::SocketAddress& hostAddress, Base::UInt64 timeElapsed=0);
@@ -91,6 +106,9 @@ public:
 	// Manage the netgroup peers and send the recurrent requests
 	bool			manage(Base::Exception& ex, Base::Int64 now);
 
+	// Update the NetGroup values of the connection and streams statistics
+	void			updateStats(RTMFP::Stats& stats);
+
 	// Call a function on the peer side
 	// return 0 if it fails, 1 otherwise
 	unsigned int	callFunction(const std::string& function, std::queue<std::string>& arguments);
@@ -113,7 +131,6 @@ public:
 	
 	const std::string					idHex;	// Group ID in hex format
 	const std::string					idTxt;	// Group ID in plain text (without final zeroes)
-	const std::string					stream;	// Stream name
 
 protected:
 	// FlashHandler messageHandler implementation
@@ -127,11 +144,38 @@ private:
 	struct P2PRate : NetGroupException { P2PRate() { code = RTMFP::P2P_RATE; } };
 	struct P2PPullTimeout : NetGroupException { P2PPullTimeout() { code = RTMFP::P2P_PULL_TIMEOUT; } };
 
+	// Stream subscribed (or published) in the NetGroup
+	struct Stream {
+		Stream(Base::UInt16 mediaId, bool audioReliable, bool videoReliable) : mediaId(mediaId), audioReliable(audioReliable), videoReliable(videoReliable) {}
+
+		Base::UInt16		mediaId; // id of the media read by the application
+		bool				audioReliable; // if False we do not send back audio packets
+		bool				videoReliable; // if False we do not send back video packets
+		Base::shared<RTMFP::StreamStats>	pStats; // statistics of the stream (null until the first update)
+	};
+
+	// Group Media announced by a peer for a stream not subscribed
+	struct AvailableMedia {
+		AvailableMedia(const std::string& stream, const Base::shared<RTMFPGroupConfig>& pParameters) : stream(stream), pParameters(pParameters), time(Base::Time::Now()) {}
+
+		std::string						stream; // stream name
+		Base::shared<RTMFPGroupConfig>	pParameters; // parameters of the Group Media
+		Base::Int64						time; // time of the last announcement (deleted after NETGROUP_MEDIA_TIMEOUT)
+	};
+
+	// Group Address of a peer in the heard list
+	struct GroupEntry {
+		GroupEntry(HeardList::Peer& peer) : address(peer.groupAddress), pPeer(&peer) {}
+
+		GroupAddress		address;
+		HeardList::Peer*	pPeer;
+	};
+
 	// Static function to read group config parameters sent in a Media Subscription message
 	static void					ReadGroupConfig(const Base::shared<RTMFPGroupConfig>& parameters, Base::BinaryReader& packet);
 
 	// Return the Group Address calculated from a Peer ID
-	static const std::string&	GetGroupAddressFromPeerId(const char* rawId, std::string& groupAddress);
+	static const GroupAddress&	GetGroupAddressFromPeerId(const char* rawId, GroupAddress& groupAddress);
 
 	// Return the size of peer addresses for Group Report 
 	static Base::UInt32			AddressesSize(const Base::SocketAddress& host, const PEER_LIST_ADDRESS_TYPE& addresses);
@@ -145,6 +189,10 @@ private:
 	// Remove a peer from the connected peer list
 	void						removePeer(MAP_PEERS_ITERATOR_TYPE itPeer);
 
+	// Create the Group Media of a subscribed stream and send its infos to the connected peers (except peerId)
+	std::map<std::string, GroupMedia>::iterator	createGroupMedia(std::map<std::string, GroupMedia>::iterator itGroupMedia, const std::string& streamKey, const std::map<std::string, Stream>::iterator& itStream,
+		const Base::shared<RTMFPGroupConfig>& pParameters, const std::string& peerId);
+
 	// Build the Group Report for the peer in parameter
 	// Return false if the peer is not found
 	void						sendGroupReport(P2PSession* pPeer, bool initiator);
@@ -152,8 +200,14 @@ private:
 	// Update our NetGroup Best List
 	void						updateBestList();
 
+	// Return the index of the first Group Address not lower than the one in parameter (size of the list if none)
+	Base::UInt32				findGroupAddress(const GroupAddress& groupAddress);
+
+	// Remove a Group Address from the sorted list
+	void						removeGroupAddress(const GroupAddress& groupAddress);
+
 	// Calculate the Best list from a group address
-	void						buildBestList(const std::string& groupAddress, const std::string& peerId, std::set<std::string>& bestList);
+	void						buildBestList(const GroupAddress& groupAddress, const std::string& peerId, std::set<HeardList::Peer*>& bestList);
 
 	// Connect and disconnect peers to fit the best list
 	void						manageBestConnections(const std::set<std::string>& oldList);
@@ -161,20 +215,11 @@ private:
 	// Clean the Heard List
 	void						cleanHeardList();
 
-	// Peer instance in the heard list
-	struct GroupNode : virtual Base::Object {
-		GroupNode(const char* rawPeerId, const std::string& groupId, const PEER_LIST_ADDRESS_TYPE& listAddresses, const Base::SocketAddress& host, Base::UInt64 timeElapsed) :
-			rawId(rawPeerId, PEER_ID_SIZE + 2), groupAddress(groupId), addresses(listAddresses), hostAddress(host), lastGroupReport(((Base::UInt64)Base::Time::Now()) - (timeElapsed * 1000)) {}
-
-		std::string rawId;
-		std::string groupAddress;
-		PEER_LIST_ADDRESS_TYPE addresses;
-		Base::SocketAddress hostAddress;
-		Base::Int64 lastGroupReport; // Time in msec of last Group report received
-	};
+	// Add a new peer to the Heard List and to the Group Addresses
+	HeardList::Peer&			addHeardPeer(const char* rawId, Base::UInt64 timeElapsed);
 
 	// Read the group report and return true if at least a new peer has been found
-	bool						readGroupReport(const std::map<std::string, Base::shared<GroupNode>>::iterator& itNode, Base::BinaryReader& packet);
+	bool						readGroupReport(HeardList::Peer& peer, Base::BinaryReader& packet);
 
 	P2PSession::OnPeerGroupReport							_onGroupReport; // called when receiving a Group Report message from the peer
 	P2PSession::OnNewMedia									_onNewMedia; // called when a new PeerMedia is called (new stream available for the peer)
@@ -194,15 +239,14 @@ private:
 	Base::unique<GroupBuffer>								_pGroupBuffer; // Group fragments buffer, order all fragment in a thread and forward them
 	Base::unique<RTMFPGroupConfig>							_pGroupParameters; // NetGroup parameters
 
-	std::string												_myGroupAddress; // Our Group Address (peer identifier into the NetGroup)
+	GroupAddress											_myGroupAddress; // Our Group Address (peer identifier into the NetGroup)
 	PEER_LIST_ADDRESS_TYPE									_myAddresses; // Our public ip addresses for Group Report
 	
-	bool													_audioReliable; // if False we do not send back audio packets
-	bool													_videoReliable; // if False we do not send back video packets
+	std::map<std::string, Stream>							_streams; // streams subscribed (or published) by name, the GroupMedia keep a reference to the name
+	std::map<std::string, AvailableMedia>					_availableMedias; // map of stream key to the Group Medias announced for the streams not subscribed
 
-	std::map<std::string, Base::shared<GroupNode>>		_mapDiedPeers; // Map of peer ID to died Peers GroupNode
-	std::map<std::string, Base::shared<GroupNode>>		_mapHeardList; // Map of peer ID to Group address and info from Group Report
-	std::map<std::string,std::string>						_mapGroupAddress; // Map of Group Address to peer ID (same as heard list)
+	HeardList												_heardList; // Peers known (from Group Reports) and died peers
+	std::vector<GroupEntry>									_groupAddresses; // Group Addresses of the heard list peers, sorted (same as heard list)
 	std::set<std::string>									_bestList; // Last best list calculated
 	MAP_PEERS_TYPE											_mapPeers; // Map of peers ID to p2p connections
 	GroupListener*											_pListener; // Listener of the main publication (only one by intance)
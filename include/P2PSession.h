@@ -82,7 +82,7 @@ struct P2PSession : FlowManager, virtual Base::Object {
 
 	/*** NetGroup functions ***/
 
-	// Write the Group publication infos
+	// Return the PeerMedia of a stream key, create it if it is unknown or closed
 	Base::shared<PeerMedia>&		getPeerMedia(const std::string& streamKey);
 
 	// Send the group report (message 0A)
@@ -109,6 +109,9 @@ struct P2PSession : FlowManager, virtual Base::Object {
 
 	// Return the diffie hellman object (related to main session)
 	virtual Base::DiffieHellman&	diffieHellman();
+
+	// Return the size of the media received and waiting to be read by the application (related to main session)
+	virtual Base::UInt64			readQueueSize();
 	
 	// Add host or address when receiving address
 	// Update handhsake if present
@@ -123,6 +126,7 @@ struct P2PSession : FlowManager, virtual Base::Object {
 	// NetGroup members
 	bool							groupFirstReportSent; // True if the first group report has been sent
 	bool							groupReportInitiator; // True if we are the initiator of last Group Report (to avoid endless exchanges)
+	std::map<std::string, std::pair<Base::Int64, Base::UInt32>>	reportedPeers; // Peers of the last delta Group Report sent (binary peer ID to time of last report and version)
 
 protected:
 
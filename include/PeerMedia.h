@@ -63,6 +63,9 @@ struct PeerMedia : public virtual Base::Object {
 	// Close the PeerMedia object
 	void close(bool abrupt);
 
+	// Return true if the PeerMedia is closed
+	bool closed() const { return _closed; }
+
 	// Called by P2PSession to close the media writer
 	void closeMediaWriter(bool abrupt);
 
@@ -106,6 +109,21 @@ struct PeerMedia : public virtual Base::Object {
 	// Send a pull request (2B)
 	void sendPull(Base::UInt64 index);
 
+	// Return the expected delay of a pull request answer (in msec), from the delays observed or from the latency
+	Base::UInt32 pullDelay() const;
+
+	// Return the cost of a new pull request to this peer : expected delay weighted by the success rate and the pull requests waiting
+	double pullCost() const;
+
+	// Called when a pull request sent to this peer has been answered after delay (in msec)
+	void pullAnswered(Base::UInt32 delay);
+
+	// Called when a pull request sent to this peer has timed out
+	void pullTimedOut();
+
+	// Called when a pull request sent to this peer is not waited anymore (received from another peer or deleted)
+	void pullCanceled() { if (pullsWaiting) --pullsWaiting; }
+
 	// Handle a pull request
 	void handlePlayPull(Base::UInt64 index, bool flush);
 
@@ -118,6 +136,10 @@ struct PeerMedia : public virtual Base::Object {
 	const std::string*				pStreamKey; // pointer to the streamKey index in the map P2PSession::_mapStream2PeerMedia
 	Base::UInt8						pushInMode; // Group Play Push mode
 	bool							groupMediaSent; // True if the Group Media infos have been sent
+	Base::UInt32					pullsWaiting; // Number of pull requests sent to this peer and not answered
+	Base::UInt64					fragmentsIn; // Number of fragments received from this peer
+	Base::UInt64					duplicatesIn; // Number of fragments received from this peer and already received before (or too old)
+	Base::UInt64					duplicateBytesIn; // Size of the duplicate fragments received from this peer
 
 private:
 	// Return true if the new fragment is pushable (according to the Group push mode)
@@ -127,9 +149,11 @@ private:
 	bool							_closed; // closed state
 
 	Base::UInt8						_pushOutMode; // Group Publish Push mode
-	Base::Buffer					_fragmentsMap; // Last Fragments Map received
+	std::vector<Base::UInt64>		_fragmentsMap; // Last Fragments Map received, in words (bit i is the fragment _idFragmentsMapIn-1-i)
 	Base::UInt64					_idFragmentsMapIn; // Last ID received from the Fragments Map
 	Base::UInt64					_idFragmentsMapOut; // Last ID sent in the Fragments map
+	Base::UInt32					_pullDelay; // Smoothed delay of the pull requests answers (in msec, 0 if no answer)
+	double							_pullSuccess; // Smoothed rate of pull requests answered before the timeout
 	Base::shared<RTMFPWriter>	_pMediaReportWriter; // Media Report writer used to send report messages from the current media
 	Base::shared<RTMFPWriter>	_pMediaWriter; // Writer for media packets
 };
@@ -58,6 +58,9 @@ struct Publisher : virtual Base::Object {
 	const Base::Packet&		audioCodecBuffer() const { return _audioCodec; }
 	const Base::Packet&		videoCodecBuffer() const { return _videoCodec; }
 
+	// Send the media cached since the last key frame to a new listener (the codec infos are sent by the listener before the key frame)
+	void					sendGOP(Listener& listener) const;
+
 	// Functions called by RTMFPSession
 	void pushAudio(Base::UInt32 time, const Base::Packet& packet);
 	void pushVideo(Base::UInt32 time, const Base::Packet& packet);
@@ -69,6 +72,9 @@ private:
 	// Update and check the time synchronization variables
 	void updateTime(AMF::Type type, Base::UInt32 time, Base::UInt32 size);
 
+	// Save the media packet in the GOP cache if a key frame has been received (the cache is cleared if it is too large)
+	void cacheMedia(AMF::Type type, Base::UInt32 time, const Base::Packet& packet);
+
 	bool publishAudio;
 	bool publishVideo;
 
@@ -84,6 +90,17 @@ private:
 	Base::Packet						_videoCodec;
 	bool								_new; // True if there is at list a packet to send
 
+	// GOP cache, media packets since the last key frame for the new listeners
+	struct Media {
+		Media(AMF::Type type, Base::UInt32 time, const Base::Packet& packet) : type(type), time(time), packet(std::move(packet)) {}
+		AMF::Type		type;
+		Base::UInt32	time;
+		Base::Packet	packet;
+	};
+	std::deque<Media>					_gop;
+	Base::UInt32						_gopSize; // size of the GOP cache in bytes
+	const Base::UInt32					_gopMaxSize; // maximum size of the GOP cache ("gopCacheSize" parameter, 0 to disable)
+
 	// Synchronisation checks
 	Base::UInt32						_lastTime; // last time received
 	Base::Time							_lastSyncWarn; // Time since last synchronisation issue
@@ -34,6 +34,7 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "AMFWriter.h"
 #include "Base/Logs.h"
 #include <map>
+#include <mutex>
 
 #define RTMFP_LIB_VERSION	0x020F0003	// (2.15.3)
 
@@ -50,7 +51,10 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 
 #define PEER_LIST_ADDRESS_TYPE	std::map<Base::SocketAddress, RTMFP::AddressType>
 
+#define HISTOGRAM_BUCKETS		240 // 8 sub-buckets by power of 2 up to 2^32 usec
+
 struct RTMFPSender;
+struct RTMFPHistogram;
 struct RTMFP : virtual Base::Static {
 
 	enum AddressType {
@@ -71,13 +75,45 @@ struct RTMFP : virtual Base::Static {
 
 	enum { TIMESTAMP_SCALE = 4 };
 	enum { SENDABLE_MAX = 6 }; // Number of packet max to send before receiving an ack
+	enum { DUPACK_THRESHOLD = 3 }; // Number of acks reporting a packet missing before repeating it (fast repeat)
+	enum { WINDOW_MAX = 0xFF7F * 1024 }; // Maximum receiver buffer advertised in acknowledgments (in bytes, 1024 bytes blocks)
+	enum { ERTO_MIN = 250 }; // Minimum retransmission timeout computed from RTT samples (see https://tools.ietf.org/html/rfc7016#section-3.5.2.2)
 
 	enum {
 		SIZE_HEADER = 11,
-		SIZE_PACKET = 1192,
+		SIZE_PACKET = 1192, // default maximum packet size (Flash compatibility)
+		SIZE_PACKET_MAX = 9000, // maximum packet size probed with path MTU discovery (jumbo frames)
 		SIZE_COOKIE = 0x40
 	};
 
+	// Path MTU discovery (librtmfp only, Flash ignores the probes and stays at SIZE_PACKET)
+	enum {
+		PROBE_COUNT = 3, // number of probes lost before considering the size as too big
+		PROBE_PRECISION = 32 // the discovery ends when the largest size acknowledged is this close to the smallest size lost
+	};
+
+	// Forward error correction of the unreliable media flows (librtmfp only)
+	enum {
+		FEC_REQUESTS = 3, // number of FEC requests (0x6c) sent before considering that the peer does not decode the parities
+		FEC_OVERHEAD = 12, // bytes reserved in the media packets to keep the parity chunks under the packet size
+		FEC_BLOCK_MAX = 255, // maximum number of stages of a FEC block (8-bit count)
+		FEC_TIMEOUT = 5000 // time (in msec) without parity before the receiver releases the fragments kept for the FEC blocks
+	};
+
+	// Delta Group Reports (librtmfp only), the peers already reported are sent only if they have been heard since and without their addresses
+	enum {
+		DELTA_REQUESTS = 3 // number of delta requests (0x6b) sent before considering that the peer does not read the delta Group Reports
+	};
+
+	// Sending priority of the writers, the queues are served with a weighted round robin (8/4/2/1 packets) to not starve the lower priorities
+	enum Priority {
+		PRIORITY_CONTROL = 0, // commands, reports... (default)
+		PRIORITY_AUDIO,
+		PRIORITY_VIDEO,
+		PRIORITY_GROUP, // NetGroup fragments
+		PRIORITY_COUNT
+	};
+
 	enum {
 		MESSAGE_OPTIONS = 0x80,
 		MESSAGE_WITH_BEFOREPART = 0x20,
@@ -122,6 +158,7 @@ struct RTMFP : virtual Base::Static {
 
 		const Base::UInt32 time;
 		const AMF::Type type;
+		const Base::Int64 origin = Origin; // origin time of the packet in the current thread (latency histograms)
 	};
 
 	struct Engine : virtual Base::Object {
@@ -166,6 +203,100 @@ struct RTMFP : virtual Base::Static {
 		const std::map<Base::UInt64, Base::Packet>	acks; // ack + fails
 	};*/
 
+	// Stages of the latency histograms (RTMFPHistogramStage), latency from the socket reception or from RTMFP_Write
+	// The histograms and the origin members are always declared, only their measure depends on LIBRTMFP_HISTOGRAMS,
+	// so the layout of the structures is the same for the library and the programs including its headers
+	enum HistogramStage {
+		HISTOGRAM_DECODE = 0,
+		HISTOGRAM_DEQUEUE,
+		HISTOGRAM_RECEIVE,
+		HISTOGRAM_FLOW,
+		HISTOGRAM_GROUP,
+		HISTOGRAM_BUFFER,
+		HISTOGRAM_READ,
+		HISTOGRAM_WRITE,
+		HISTOGRAM_SEND,
+		HISTOGRAM_COUNT
+	};
+
+	// Latency histogram in usec (RTMFPHistogram), HDR-style buckets : exact values under 8 usec
+	// then 8 sub-buckets by power of 2 (precision of 12.5%), written with relaxed atomics
+	struct Histogram : virtual Base::Object {
+		Histogram() : _sum(0), _max(0) { for (std::atomic<Base::UInt32>& bucket : _buckets) bucket = 0; }
+
+		// Add a latency value (in usec)
+		void	add(Base::Int64 value);
+
+		// Fill the count, mean, max and percentiles, the values are reset if reset is true
+		void	read(RTMFPHistogram& histogram, bool reset);
+
+	private:
+		// Return the highest value of a bucket
+		static Base::UInt64	Highest(Base::UInt16 bucket);
+
+		std::atomic<Base::UInt32>	_buckets[HISTOGRAM_BUCKETS];
+		std::atomic<Base::UInt64>	_sum;
+		std::atomic<Base::UInt64>	_max;
+	};
+
+	// Origin time (in usec, 0 if unknown) of the packet processed by the current thread, read by the next stages
+	static thread_local Base::Int64	Origin;
+	// Origin time (in usec, 0 if unknown) of the media written by the current thread, kept by the messages to send
+	static thread_local Base::Int64	WriteOrigin;
+
+	// Statistics of a stream read or published by the application (RTMFPStreamStats)
+	struct StreamStats : virtual Base::Object {
+		StreamStats() : readQueue(0), readPackets(0), groupPeers(0), groupFragments(0), groupPullsWaiting(0), groupPushers(0), groupFragmentsIn(0), groupDuplicatesIn(0), groupDuplicateBytesIn(0) {}
+
+		std::atomic<Base::UInt64>	readQueue; // size of the media waiting to be read
+		std::atomic<Base::UInt32>	readPackets; // number of media packets waiting to be read
+		// NetGroup stream, updated at each manage
+		std::atomic<Base::UInt32>	groupPeers;
+		std::atomic<Base::UInt32>	groupFragments;
+		std::atomic<Base::UInt32>	groupPullsWaiting;
+		std::atomic<Base::UInt32>	groupPushers;
+		std::atomic<Base::UInt64>	groupFragmentsIn;
+		std::atomic<Base::UInt64>	groupDuplicatesIn;
+		std::atomic<Base::UInt64>	groupDuplicateBytesIn;
+	};
+
+	// Statistics of a connection and its P2P sessions (RTMFPStats)
+	// The values are written with relaxed atomics in the sending and receiving threads, they can be read from any thread without lock
+	struct Stats : virtual Base::Object {
+		Stats() : bytesSent(0), packetsSent(0), bytesReceived(0), packetsReceived(0), retransmissions(0), abandons(0), drops(0), sendLostRate(0), sendByteRate(0), srtt(0), rto(0),
+			queueing(0), fragmentation(0), p2pSessions(0), groupPeers(0) {}
+
+		// Return the statistics of the stream mediaId (created if unknown)
+		Base::shared<StreamStats>	stream(Base::UInt16 mediaId);
+
+		// Call function for each stream statistics
+		void						streams(const std::function<void(Base::UInt16 mediaId, const StreamStats& stats)>& function);
+
+		// Counters of all the sessions
+		std::atomic<Base::UInt64>	bytesSent;
+		std::atomic<Base::UInt64>	packetsSent;
+		std::atomic<Base::UInt64>	bytesReceived;
+		std::atomic<Base::UInt64>	packetsReceived;
+		std::atomic<Base::UInt64>	retransmissions; // packets repeated (timeout or fast repeat)
+		std::atomic<Base::UInt64>	abandons; // abandon messages sent
+		std::atomic<Base::UInt64>	drops; // media packets dropped before sending (deadline exceeded or waiting a key frame)
+		// Server session values, updated at each manage
+		std::atomic<double>			sendLostRate;
+		std::atomic<Base::UInt32>	sendByteRate;
+		std::atomic<Base::UInt32>	srtt; // in usec
+		std::atomic<Base::UInt32>	rto; // in msec
+		std::atomic<Base::UInt64>	queueing;
+		// All the sessions, updated at each manage
+		std::atomic<Base::UInt64>	fragmentation; // size of the messages partially received
+		std::atomic<Base::UInt32>	p2pSessions; // P2P sessions connected
+		std::atomic<Base::UInt32>	groupPeers; // NetGroup peers connected
+		Histogram					histograms[HISTOGRAM_COUNT]; // latencies of the packets by stage (measured only with LIBRTMFP_HISTOGRAMS)
+
+	private:
+		std::mutex											_mutex; // only for the streams map
+		std::map<Base::UInt16, Base::shared<StreamStats>>	_streams;
+	};
+
 	struct Output : virtual Base::Object {
 
 		virtual Base::UInt32	rto() const = 0;
@@ -180,12 +311,25 @@ struct RTMFP : virtual Base::Static {
 	static void						Pack(Base::Buffer& buffer,Base::UInt32 farId);
 
 	static bool						Send(Base::Socket& socket, const Base::Packet& packet, const Base::SocketAddress& address);
+#if defined(LIBRTMFP_LOSS_INJECTION)
+	static std::atomic<Base::UInt8>	LossInjection; // percentage of the packets randomly dropped by Send (loss simulation, "lossInjection" parameter)
+#endif
 	static Base::Buffer&			InitBuffer(Base::shared<Base::Buffer>& pBuffer, Base::UInt8 marker);
 	static Base::Buffer&			InitBuffer(Base::shared<Base::Buffer>& pBuffer, std::atomic<Base::Int64>& initiatorTime, Base::UInt8 marker);
 	static void						ComputeAsymetricKeys(const Base::Binary& sharedSecret, const Base::UInt8* initiatorNonce,Base::UInt32 initNonceSize, const Base::UInt8* responderNonce,Base::UInt32 respNonceSize, Base::UInt8* requestKey, Base::UInt8* responseKey);
 
 	static Base::UInt16				TimeNow() { return Time(Base::Time::Now()); }
 	static Base::UInt16				Time(Base::Int64 timeVal) { return (timeVal / RTMFP::TIMESTAMP_SCALE)&0xFFFF; }
+	// Monotonic time in usec (for RTT measures)
+	static Base::Int64				MicroNow() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	// XOR a fragment (flags, 16-bit size and data) into a FEC parity, the parity is extended with zeros if shorter
+	static void						XORFragment(Base::Buffer& parity, Base::UInt8 flags, const Base::UInt8* data, Base::UInt32 size);
+
+	// Reverse the bits of a 64-bit word (bit 0 becomes bit 63)
+	static Base::UInt64				ReverseBits(Base::UInt64 value);
+	// Return the index of the lowest bit set (value must not be 0)
+	static Base::UInt8				LowestBit(Base::UInt64 value);
 
 	static bool						IsKeyFrame(const Base::UInt8* data, Base::UInt32 size) { return size>0 && (*data & 0xF0) == 0x10; }
 
@@ -248,6 +392,14 @@ private:
 	struct Config : virtual Base::Object, Base::Parameters {
 		Config() {
 			setNumber("timeoutFallback", 8000); // time to wait before connecting to fallback connection (Netgroup=>Unicast switch)
+			setNumber("ackPackets", 2); // number of data packets received before sending the acknowledgments (1 to acknowledge each packet)
+			setNumber("ackDelay", 50); // maximum time (in msec) to delay the acknowledgments (the real delay depends on the manage period)
+			setNumber("mediaDeadline", 0); // delay (in msec) after which a non-key media frame not sent is dropped (0 to disable, by default)
+			setNumber<Base::UInt32>("maxPacketSize", SIZE_PACKET); // maximum packet size to probe with path MTU discovery (SIZE_PACKET to disable)
+			setNumber("fecBlock", 0); // number of media stages protected by the FEC parities of a publication (0 to disable, librtmfp peers only)
+			setNumber("fecParities", 1); // number of FEC parities sent after each block of media stages
+			setNumber("deltaReports", 0); // 1 to send and accept the delta Group Reports with the librtmfp peers of a NetGroup (0 by default)
+			setNumber("gopCacheSize", 0); // maximum size (in bytes) of the media cached since the last key frame of a publication to start the new P2P listeners (0 to disable, by default)
 		}
 	};
 
@@ -255,3 +407,16 @@ public:
 	static Config& Parameters() { static Config parameters; return parameters; }// global parameter
 };
 
+#if defined(LIBRTMFP_HISTOGRAMS)
+#define HISTOGRAM_NOW()							RTMFP::MicroNow()
+#define HISTOGRAM_ORIGIN(ORIGIN)				{ RTMFP::Origin = (ORIGIN); }
+#define HISTOGRAM_WRITE_ORIGIN(ORIGIN)			{ RTMFP::WriteOrigin = (ORIGIN); }
+#define HISTOGRAM_ADD(STATS, STAGE, ORIGIN, TIME)	{ Base::Int64 __origin(ORIGIN); if (__origin) (STATS).histograms[RTMFP::STAGE].add((TIME) - __origin); }
+#define HISTOGRAM(STATS, STAGE)					HISTOGRAM_ADD(STATS, STAGE, RTMFP::Origin, RTMFP::MicroNow())
+#else
+#define HISTOGRAM_NOW()							0
+#define HISTOGRAM_ORIGIN(ORIGIN)
+#define HISTOGRAM_WRITE_ORIGIN(ORIGIN)
+#define HISTOGRAM_ADD(STATS, STAGE, ORIGIN, TIME)
+#define HISTOGRAM(STATS, STAGE)
+#endif
@@ -35,6 +35,8 @@ struct RTMFPDecoder : Runner, virtual Object{
 		const SocketAddress		address;
 		int								idConnection;
 		UInt32					idSession;
+		const Int64				origin = RTMFP::Origin; // reception time by the socket (in usec)
+		const Int64				decodeTime = origin ? RTMFP::MicroNow() : 0;
 	};
 	typedef Event<void(Decoded& decoded)> ON(Decoded);
 
@@ -44,8 +46,11 @@ struct RTMFPDecoder : Runner, virtual Object{
 private:
 	bool run(Exception& ex) {
 		bool decoded;
-		if ((decoded = _pDecoder->decode(ex, *_pBuffer, _address)))
+		if ((decoded = _pDecoder->decode(ex, *_pBuffer, _address))) {
+			HISTOGRAM_ORIGIN(_origin)
 			_handler.queue(onDecoded, _idConnection, _idSession, _address, _pBuffer);
+			HISTOGRAM_ORIGIN(0)
+		}
 		return decoded;
 	}
 	Base::shared<RTMFP::Engine>	_pDecoder;
@@ -54,4 +59,5 @@ private:
 	const Handler&			_handler;
 	int								_idConnection;
 	UInt32					_idSession;
+	const Int64				_origin = RTMFP::Origin; // reception time by the socket (in usec)
 };
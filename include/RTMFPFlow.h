@@ -43,11 +43,21 @@ public:
 	// Handle fragments received
 	void	input(Base::UInt64 stage, Base::UInt8 flags, const Base::Packet& packet, bool lastFragment);
 
+	// Handle a FEC parity of the stages first+index, first+index+parities... (before first+count)
+	// The stage missing is rebuilt if it is the only one
+	void	inputParity(Base::UInt64 first, Base::UInt8 count, Base::UInt8 parities, Base::UInt8 index, const Base::Packet& parity);
+
 	// Build acknowledgment
 	Base::UInt64	buildAck(std::vector<Base::UInt64>& losts, Base::UInt16& size);
 
 	bool			consumed() { return _stageEnd && _fragments.empty() && _completeTime.isElapsed(120000); } // Wait 120s before closing the flow definetly
 
+	// Return true if some fragments are waiting for missing stages
+	bool			hasGap() const { return !_fragments.empty(); }
+
+	// Return the size of the data received and not delivered yet (fragments + message incomplete)
+	Base::UInt32	bufferedSize() const { return fragmentation + (_pBuffer ? _pBuffer->size() : 0); }
+
 	Base::UInt32	fragmentation;
 
 private:
@@ -71,4 +81,10 @@ private:
 	Base::shared<Base::Buffer>		_pBuffer;
 	Base::UInt32						_lost;
 	std::map<Base::UInt64, Fragment>	_fragments; // map of all fragments received and not handled for now
+
+	// Forward error correction
+	Base::UInt64						_fecFirst; // first stage of the last FEC block received (0 if no parity received)
+	std::map<Base::UInt64, Fragment>	_fecFragments; // fragments of the FEC blocks in progress, to rebuild a stage lost
+	Base::Time							_fecTime; // reception time of the last parity
+	Base::UInt32						_fecRebuilt; // number of stages rebuilt
 };
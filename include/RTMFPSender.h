@@ -29,25 +29,65 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "Base/Congestion.h"
 
 struct RTMFPSender : Base::Runner, virtual Base::Object {
+	// Stages received out of order by the peer, [first, last] ranges after the cumulative ack stage
+	typedef std::vector<std::pair<Base::UInt64, Base::UInt64>> Ranges;
+
+	// Chunks of one writer (without RTMFP header), bundled with other chunks of the session at sending
 	struct Packet : Base::Packet, virtual Base::Object {
-		Packet(Base::shared<Base::Buffer>& pBuffer, Base::UInt32 fragments, bool reliable) : fragments(fragments), Base::Packet(pBuffer), reliable(reliable), _sizeSent(0) {}
-		void setSent() {
+		Packet(Base::shared<Base::Buffer>& pBuffer, Base::UInt32 fragments, bool reliable, Base::Int64 deadline = 0, bool dependent = false, bool key = false) : fragments(fragments), Base::Packet(pBuffer), reliable(reliable),
+			deadline(deadline), dependent(dependent), key(key), acked(false), missed(0), repeated(false), _sizeSent(0), _sendTime(0), _packet(0) {}
+		void setSent(Base::UInt64 packet) {
 			if (_sizeSent)
 				return;
 			_sizeSent = size();
+			_packet = packet;
+			_sendTime = RTMFP::MicroNow();
 			if (!reliable)
 				Base::Packet::reset(); // release immediatly an unreliable packet!
 		}
-		const bool   reliable;
+		bool				reliable; // can become unreliable if dropped
 		const Base::UInt32	fragments;
+		const Base::Int64	deadline; // time after which the packet can be dropped (0 if it must be sent)
+		const bool			dependent; // contains an inter video frame, useless if a previous frame has been dropped
+		const bool			key; // contains a video key frame, the next inter frames are decodable again
+		bool				expired(Base::Int64 now) const { return deadline && deadline < now; }
 		Base::UInt32		sizeSent() const { return _sizeSent; }
+		Base::Int64			sendTime() const { return _sendTime; } // time of the first sending (in usec)
+		Base::UInt64		packet() const { return _packet; } // index of the session packet of the first sending (from 1, the chunks of several writers can share a packet)
+		// used by RTMFPAcquiter & RTMFPRepeater
+		bool				acked; // acknowledged out of order (SACK), must not be repeated
+		Base::UInt8			missed; // number of acks reporting a later stage while this packet is missing
+		bool				repeated; // True if sent more than once (no RTT sample then, Karn's rule)
+		Base::Int64			origin = 0; // earliest RTMFP_Write time of the media in the packet (in usec, 0 if unknown)
 	private:
 		Base::UInt32		_sizeSent;
+		Base::Int64			_sendTime;
+		Base::UInt64		_packet;
+	};
+	// Forward error correction of a flow (librtmfp only), XOR parities sent after each block of stages
+	// With several parities the stages are interleaved (parity i protects the stages first+i, first+i+parities...) to recover bursts of losses
+	struct FEC : virtual Base::Object {
+		FEC(Base::UInt8 block, Base::UInt8 parities);
+
+		const Base::UInt8	block; // number of stages protected by the parities
+		const Base::UInt8	parities; // number of parities sent after each block
+
+		// Add the fragment of a stage to the block in progress, return true if the block is complete
+		bool add(Base::UInt64 stage, Base::UInt8 flags, const Base::UInt8* data, Base::UInt32 size);
+		// Write the parity chunks (0x6d) of the block in progress (one buffer by parity) and start a new block
+		void flush(Base::UInt64 flowId, std::vector<Base::shared<Base::Buffer>>& chunks);
+
+	private:
+		Base::UInt64								_first; // first stage of the block in progress
+		Base::UInt8									_count; // number of stages in the block in progress
+		std::vector<Base::shared<Base::Buffer>>	_parities;
 	};
+	struct Queue;
 	struct Session : virtual Base::Object {
-		Session(Base::UInt32 farId, const Base::shared<RTMFP::Engine>& pEncoder, const Base::shared<Base::Socket>& pSocket, Base::Int64 time) :
-			sendable(RTMFP::SENDABLE_MAX), socket(*pSocket), pEncoder(SET, *pEncoder), farId(farId), initiatorTime(time),
-			queueing(0), sendingSize(0), _pSocket(pSocket), sendLostRate(sendByteRate), sendTime(0), congested(false) {}
+		Session(Base::UInt32 farId, const Base::shared<RTMFP::Engine>& pEncoder, const Base::shared<Base::Socket>& pSocket, Base::Int64 time, const Base::shared<RTMFP::Stats>& pStats) :
+			sendable(RTMFP::SENDABLE_MAX), socket(*pSocket), pEncoder(SET, *pEncoder), farId(farId), initiatorTime(time), pStats(pStats),
+			queueing(0), sendingSize(0), _pSocket(pSocket), sendLostRate(sendByteRate), sendTime(0), congested(false), srtt(0), rttvar(0), minRtt(0), rto(0), pending(0), packetSize(RTMFP::SIZE_PACKET), fec(false),
+			ackPackets(RTMFP::Parameters().getNumber<Base::UInt32>("ackPackets")), packets(0), _marker(0), _credits() {}
 
 		bool isCongested() {
 			Base::UInt64 queueSize(queueing);
@@ -57,6 +97,20 @@ struct RTMFPSender : Base::Runner, virtual Base::Object {
 			return queueSize && _congestion(Base::Net::RTO_MAX);
 		}
 
+		// Update the round-trip time estimation with a sample (in usec) taken on an acknowledged packet
+		void setRTT(Base::Int64 rtt);
+
+		// Add chunks to the current packet, sending it before if the chunks can't be bundled with it
+		// return False if the sending has failed
+		bool write(const Base::Packet& chunks, Base::UInt8 marker, const Base::SocketAddress& address);
+		// Send the current packet
+		bool flush(const Base::SocketAddress& address);
+
+		// Add a queue with packets waiting to be sent
+		void schedule(const Base::shared<Queue>& pQueue);
+		// Send the packets waiting in the scheduled queues by priority
+		void sendQueues(Base::UInt8 marker, const Base::SocketAddress& address);
+
 		Base::UInt32					farId;
 		std::atomic<Base::Int64>		initiatorTime;
 		Base::shared<RTMFP::Engine>	pEncoder;
@@ -68,13 +122,33 @@ struct RTMFPSender : Base::Runner, virtual Base::Object {
 		std::atomic<Base::UInt64>		sendingSize;
 		Base::UInt8						sendable;
 		std::atomic<bool>				congested;
+		std::atomic<Base::UInt32>		srtt; // smoothed round-trip time (in usec), 0 while no sample
+		std::atomic<Base::UInt32>		rttvar; // round-trip time variation (in usec)
+		std::atomic<Base::UInt32>		minRtt; // minimum round-trip time (in usec)
+		std::atomic<Base::UInt32>		rto; // retransmission timeout (in msec), 0 while no sample
+		std::atomic<Base::UInt32>		pending; // senders queued and not run yet, the current packet is sent by the last one
+		std::atomic<Base::UInt32>		packetSize; // maximum packet size (raised by the path MTU discovery)
+		std::atomic<bool>				fec; // the peer decodes the FEC parities (librtmfp)
+		const Base::UInt32				ackPackets; // packets acknowledged at once by the peer ("ackPackets" of librtmfp), an ack of less packets may have been delayed
+		Base::UInt64					packets; // number of packets sent
+		const Base::shared<RTMFP::Stats>	pStats; // statistics of the connection
 	private:
 		Base::shared<Base::Socket>	_pSocket; // to keep the socket open
 		Base::Congestion				_congestion;
+		Base::shared<Base::Buffer>		_pBuffer; // current packet (bundle of chunks from several senders)
+		Base::UInt8						_marker; // marker of the current packet
+
+		// Send the next packet of the queue, return false if the queue can't send anymore
+		bool sendPacket(Queue& queue, Base::UInt8 marker, Base::Int64 now, const Base::SocketAddress& address);
+
+		std::deque<Base::shared<Queue>>	_queues[RTMFP::PRIORITY_COUNT]; // queues scheduled by priority
+		std::deque<Base::weak<Queue>>	_paused[RTMFP::PRIORITY_COUNT]; // queues waiting when the sending paused, weak to let their writers repeat
+		Base::UInt8						_credits[RTMFP::PRIORITY_COUNT]; // packets still sendable by priority in the current round
 	};
 	struct Queue : virtual Base::Object, std::deque<Base::shared<Packet>> {
 		template<typename SignatureType>
-		Queue(Base::UInt64 id, Base::UInt64 flowId, const SignatureType& signature) : id(id), stage(0), stageSending(0), stageAck(0), signature(STR signature.data(), signature.size()), flowId(flowId) {}
+		Queue(Base::UInt64 id, Base::UInt64 flowId, const SignatureType& signature) : id(id), stage(0), stageSending(0), stageAck(0), stageReceived(0), signature(STR signature.data(), signature.size()), flowId(flowId),
+			sendingSize(0), window(RTMFP::WINDOW_MAX), shedding(false), priority(RTMFP::PRIORITY_CONTROL), scheduled(false) {}
 
 		const Base::UInt64					id;
 		const Base::UInt64					flowId;
@@ -83,8 +157,15 @@ struct RTMFPSender : Base::Runner, virtual Base::Object {
 		/// stageAck <= stageSending <= stage
 		Base::UInt64						stage;
 		Base::UInt64						stageSending;
-		Base::UInt64						stageAck;
+		Base::UInt64						stageAck; // stage acknowledged or abandoned (unreliable packets are not buffered)
+		Base::UInt64						stageReceived; // last stage acknowledged by the peer
 		std::deque<Base::shared<Packet>>	sending;
+		Base::UInt64						sendingSize; // bytes sent and not acknowledged yet
+		Base::UInt64						window; // buffer available advertised by the receiver (in bytes)
+		bool								shedding; // a video frame has been dropped, drop the inter frames until the next key frame
+		std::atomic<Base::UInt8>			priority; // sending priority (RTMFP::Priority)
+		bool								scheduled; // true if the queue is in the session scheduler
+		Base::shared<FEC>					pFEC; // forward error correction (null if disabled)
 	};
 
 	// Flush usage!
@@ -100,6 +181,9 @@ protected:
 	Base::shared<Queue>	pQueue;
 	Base::UInt8				_marker;
 
+	// Abandon the stages of pQueue until stage (included)
+	void	sendAbandon(Base::UInt64 stage);
+
 private:
 	bool		 run(Base::Exception& ex);
 	virtual void run() {}
@@ -113,36 +197,51 @@ private:
 	Base::UInt8	_cmd;
 };
 
+struct RTMFPChunkSender : RTMFPSender, virtual Base::Object {
+	// Send raw chunks (acknowledgments...) in the current packet of the session
+	RTMFPChunkSender(Base::UInt8 marker, Base::shared<Base::Buffer>& pChunks) : RTMFPSender("RTMFPChunkSender", marker), _chunks(pChunks) {}
+	// Just release the current packet of the session (send it if no more sender is pending)
+	RTMFPChunkSender(Base::UInt8 marker) : RTMFPSender("RTMFPChunkSender", marker) {}
+private:
+	void	run();
+
+	Base::Packet	_chunks;
+};
+
 struct RTMFPAcquiter : RTMFPSender, virtual Base::Object {
-	RTMFPAcquiter(Base::UInt8 marker, const Base::shared<RTMFPSender::Queue>& pQueue, Base::UInt64 stageAck) : RTMFPSender("RTMFPAcquiter", marker, pQueue), _stageAck(stageAck) {}
+	RTMFPAcquiter(Base::UInt8 marker, const Base::shared<RTMFPSender::Queue>& pQueue, Base::UInt64 stageAck, Base::UInt64 window, RTMFPSender::Ranges&& ranges) : RTMFPSender("RTMFPAcquiter", marker, pQueue), _stageAck(stageAck), _window(window), _ranges(std::move(ranges)), _time(RTMFP::MicroNow()) {}
 private:
 	void	run();
 
 	Base::UInt64	_stageAck;
+	Base::UInt64	_window;
+	Ranges			_ranges;
+	Base::Int64		_time; // reception time of the ack (in usec)
 };
 
 struct RTMFPRepeater : RTMFPSender, virtual Base::Object {
-	RTMFPRepeater(Base::UInt8 marker, const Base::shared<RTMFPSender::Queue>& pQueue, Base::UInt8 fragments = 0) : RTMFPSender("RTMFPRepeater", marker, pQueue), _fragments(fragments) {}
+	RTMFPRepeater(Base::UInt8 marker, const Base::shared<RTMFPSender::Queue>& pQueue) : RTMFPSender("RTMFPRepeater", marker, pQueue) {}
 private:
 	void	run();
-	void	sendAbandon(Base::UInt64 stage);
-
-	Base::UInt8	_fragments;
 };
 
 
 struct RTMFPMessenger : RTMFPSender, virtual Base::Object {
-	RTMFPMessenger(Base::UInt8 marker, const shared<RTMFPSender::Queue>& pQueue) : RTMFPSender("RTMFPMessenger", marker, pQueue), _flags(0), _fragments(0) {} // _flags must be initialized to 0!
+	RTMFPMessenger(Base::UInt8 marker, const shared<RTMFPSender::Queue>& pQueue) : RTMFPSender("RTMFPMessenger", marker, pQueue), _flags(0), _fragments(0), _deadline(0), _dependent(false), _key(false), _packetSize(RTMFP::SIZE_PACKET) {} // _flags must be initialized to 0!
 
-	AMFWriter&	newMessage(bool reliable, const Base::Packet& packet) { _messages.emplace_back(reliable, packet); return _messages.back().writer; }
+	AMFWriter&	newMessage(bool reliable, const Base::Packet& packet, Base::Int64 deadline = 0, bool dependent = false, bool key = false) { _messages.emplace_back(reliable, packet, deadline, dependent, key); return _messages.back().writer; }
 
 private:
 	struct Message : private Base::shared<Base::Buffer>, virtual Base::Object {
 		NULLABLE(!packet && !writer)
-		Message(bool reliable, const Base::Packet& packet) : Base::shared<Base::Buffer>(SET), reliable(reliable), packet(std::move(packet)), writer(*self) {}
+		Message(bool reliable, const Base::Packet& packet, Base::Int64 deadline, bool dependent, bool key) : Base::shared<Base::Buffer>(SET), reliable(reliable), packet(std::move(packet)), writer(*self), deadline(deadline), dependent(dependent), key(key) {}
 		bool				reliable;
+		Base::Int64			deadline; // time after which the message can be dropped (0 if it must be sent)
+		bool				dependent; // inter video frame
+		bool				key; // video key frame
 		AMFWriter			writer; // data
 		Base::Packet		packet; // footer
+		const Base::Int64	origin = RTMFP::WriteOrigin; // RTMFP_Write time of the media (in usec, 0 if unknown)
 	};
 	Base::UInt32	headerSize();
 	void			run();
@@ -155,4 +254,9 @@ private:
 	Base::shared<Base::Buffer>	_pBuffer;
 	Base::UInt32					_fragments;
 	Base::UInt8						_flags;
+	Base::Int64						_deadline; // deadline of the current buffer (the earliest, 0 if one message must be sent)
+	bool							_dependent; // the current buffer contains an inter video frame
+	bool							_key; // the current buffer contains a video key frame
+	Base::UInt32					_packetSize; // maximum packet size of the session
+	Base::Int64						_origin = 0; // origin of the current buffer (the earliest, 0 if unknown)
 };
@@ -66,14 +66,15 @@ struct RTMFPSession : public FlowManager {
 	bool connect2Peer(const std::string& peerId, const std::string& streamName, const PEER_LIST_ADDRESS_TYPE& addresses, const Base::SocketAddress& hostAddress, bool delay, Base::UInt16 mediaId=0);
 
 	// Connect to the NetGroup with netGroup ID (in the form G:...)
-	// return : True if the group has been added
+	// If the group is already connected the stream is subscribed with the same peers (player only)
+	// return : True if the group (or the stream) has been added
 	bool connect2Group(const std::string& streamName, RTMFPGroupConfig* parameters, bool audioReliable, bool videoReliable, const std::string& groupHex, const std::string& groupTxt, const std::string& groupName, Base::UInt16 mediaCount);
 
 	// Create a stream (play/publish/p2pPublish) in the main stream
 	// return : True if the stream has been added
 	bool addStream(Base::UInt8 mask, const std::string& streamName, bool audioReliable, bool videoReliable, Base::UInt16 mediaCount);
 
-	// Close a stream
+	// Close a stream (or unsubscribe from a NetGroup stream)
 	// return : True if the stream has been closed
 	bool closeStream(Base::UInt16 mediaCount);
 
@@ -129,6 +130,9 @@ struct RTMFPSession : public FlowManager {
 	// Return the name of the session
 	virtual const std::string&		name() { return _host; }
 
+	// Return the size of the media received and waiting to be read by the application
+	virtual Base::UInt64			readQueueSize();
+
 	// Return the raw url of the session (for RTMFPConnection)
 	virtual const Base::Binary&		epd() { return *_rawUrl; }
 
@@ -207,6 +211,9 @@ private:
 	// Send handshake for group connection
 	void sendGroupConnection(const std::string& netGroup);
 
+	// Update the statistics values of the sessions and of the NetGroup (RTMFP_GetStats)
+	void updateStats();
+
 	static Base::UInt32												RTMFPSessionCounter; // Global counter for generating incremental sessions id
 
 	const Base::UInt32												_id; // RTMFPSession ID set by the Invoker
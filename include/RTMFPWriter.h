@@ -41,7 +41,12 @@ struct RTMFPWriter : FlashWriter, virtual Base::Object {
 	RTMFPWriter(Base::UInt8 marker, Base::UInt64 id, Base::UInt64 flowId, const Base::Packet& signature, RTMFP::Output& output);
 
 	Base::UInt64		queueing() const { return _output.queueing(); }
-	void		acquit(Base::UInt64 stageAck, Base::UInt32 lostCount);
+	// Set the sending priority of the writer (RTMFP::Priority)
+	void				setPriority(RTMFP::Priority priority) { _pQueue->priority = priority; }
+	// Send FEC parities after each block of stages (librtmfp peers only, must be called before writing)
+	void				setFEC(Base::UInt8 block, Base::UInt8 parities) { _pQueue->pFEC.set(block, parities); }
+	// Handle an acknowledgment, window is the receiver buffer available (in bytes)
+	void		acquit(Base::UInt64 stageAck, Base::UInt64 window, RTMFPSender::Ranges&& ranges);
 	bool		consumed() { return closed() && !_pSender && _pQueue.unique() && _pQueue->empty() && _closeTime.isElapsed(130000); } // Wait 130s before closing the writer definetly
 
 	template <typename ...Args>
@@ -89,8 +94,8 @@ struct RTMFPWriter : FlashWriter, virtual Base::Object {
 
 private:
 
-	void				repeatMessages(Base::UInt32 lostCount = 0); // fragments=0 means all possible!
-	AMFWriter&			newMessage(bool reliable, const Base::Packet& packet);
+	void				repeatMessages();
+	AMFWriter&			newMessage(bool reliable, const Base::Packet& packet, Base::Int64 deadline = 0, bool dependent = false, bool key = false);
 	AMFWriter&			write(AMF::Type type, Base::UInt32 time = 0, RTMFP::DataType packetType = RTMFP::TYPE_AMF, const Base::Packet& packet = Base::Packet::Null(), bool reliable = true);
 
 
@@ -98,9 +103,11 @@ private:
 	Base::shared<RTMFPSender>				_pSender;
 	Base::shared<RTMFPSender::Queue>		_pQueue;
 	Base::UInt64							_stageAck;
-	Base::UInt32							_lostCount;
+	Base::UInt64							_window; // last receiver window received
 	Base::UInt32							_repeatDelay;
 	Base::Time								_repeatTime;
+	const Base::UInt32						_mediaDeadline; // delay to drop a non-key media frame ("mediaDeadline" parameter)
+	Base::Int64								_timeRef; // time of the media timestamp 0 (to compute the deadlines)
 
 private:
 
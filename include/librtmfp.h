@@ -47,6 +47,7 @@ LIBRTMFP_API typedef struct RTMFPGroupConfig {
 
 	char			disableRateControl; // False by default, if True the p2p rate control is disabled (no disconnection if rate is < to 5% of P2P connection success)
 	char			disablePullTimeout; // False by default, if True the pull congestion timeout is disabled
+	char			fastJoin; // True by default, if True a new viewer pulls at once the latest fragments from the peers and starts reading from the last video codec infos, instead of waiting the fetch period
 } RTMFPGroupConfig;
 
 LIBRTMFP_API typedef struct RTMFPConfig {
@@ -63,6 +64,65 @@ LIBRTMFP_API typedef struct RTMFPConfig {
 	void*			interruptArg; // interrupt callback argument for interrupt function
 } RTMFPConfig;
 
+LIBRTMFP_API typedef struct RTMFPStats {
+	unsigned long long	bytesSent; // bytes sent by the connection and its P2P sessions (RTMFP packets before encryption)
+	unsigned long long	packetsSent; // RTMFP packets sent by the connection and its P2P sessions
+	unsigned long long	bytesReceived; // bytes received by the connection and its P2P sessions (after decryption)
+	unsigned long long	packetsReceived; // RTMFP packets received by the connection and its P2P sessions
+	unsigned long long	retransmissions; // packets repeated after a timeout or a fast repeat
+	unsigned long long	abandons; // abandon messages sent for the lost unreliable (or too late) packets
+	unsigned long long	drops; // media packets dropped before sending (deadline exceeded or waiting a key frame)
+	double				sendLostRate; // rate of the bytes lost by the server session (0 to 1)
+	unsigned int		sendByteRate; // bytes per second sent by the server session
+	unsigned int		srtt; // smoothed round-trip time of the server session (in usec, 0 if no sample)
+	unsigned int		rto; // retransmission timeout of the server session (in msec)
+	unsigned long long	queueing; // bytes waiting to be sent by the server session
+	unsigned long long	fragmentation; // bytes of the messages partially received by the connection and its P2P sessions
+	unsigned long long	readQueue; // bytes of media waiting to be read by RTMFP_Read (all the streams)
+	unsigned int		p2pSessions; // number of P2P sessions connected
+	unsigned int		groupPeers; // number of NetGroup peers connected
+	unsigned int		groupPullsWaiting; // number of NetGroup pull requests waiting an answer (all the streams)
+	unsigned int		groupPushers; // number of NetGroup push masks with a pusher (all the streams)
+} RTMFPStats;
+
+LIBRTMFP_API typedef struct RTMFPStreamStats {
+	unsigned long long	readQueue; // bytes of media waiting to be read by RTMFP_Read
+	unsigned int		readPackets; // number of media packets waiting to be read by RTMFP_Read
+	// NetGroup stream only (0 otherwise)
+	unsigned int		groupPeers; // number of peers of the stream
+	unsigned int		groupFragments; // number of fragments buffered
+	unsigned int		groupPullsWaiting; // number of pull requests waiting an answer
+	unsigned int		groupPushers; // number of push masks with a pusher (0 to 8)
+	unsigned long long	groupFragmentsIn; // fragments received from the peers
+	unsigned long long	groupDuplicatesIn; // fragments received from the peers and already received (or too old)
+	unsigned long long	groupDuplicateBytesIn; // bytes of the duplicate fragments
+} RTMFPStreamStats;
+
+// Stages of the latency histograms, each histogram measures the latency from the reception of the packet
+// (socket event handled by the main thread) or from RTMFP_Write for the sending stages, to the stage
+LIBRTMFP_API typedef enum {
+	RTMFP_HISTOGRAM_DECODE = 0, // packet decrypted by the thread pool
+	RTMFP_HISTOGRAM_DEQUEUE, // decoded packet dequeued by the main thread
+	RTMFP_HISTOGRAM_RECEIVE, // packet received by the session
+	RTMFP_HISTOGRAM_FLOW, // message delivered by the flow
+	RTMFP_HISTOGRAM_GROUP, // NetGroup media delivered in order by the fragments buffer
+	RTMFP_HISTOGRAM_BUFFER, // media buffered for RTMFP_Read
+	RTMFP_HISTOGRAM_READ, // media read by RTMFP_Read
+	RTMFP_HISTOGRAM_WRITE, // media written with RTMFP_Write and dequeued by the main thread
+	RTMFP_HISTOGRAM_SEND, // media written with RTMFP_Write and sent to the socket
+	RTMFP_HISTOGRAM_COUNT
+} RTMFPHistogramStage;
+
+LIBRTMFP_API typedef struct RTMFPHistogram {
+	unsigned long long	count; // number of packets measured
+	unsigned long long	mean; // mean latency (in usec)
+	unsigned long long	max; // maximum latency (in usec)
+	unsigned long long	p50; // percentiles of the latency (in usec, precision of 12.5%)
+	unsigned long long	p90;
+	unsigned long long	p99;
+	unsigned long long	p999;
+} RTMFPHistogram;
+
 LIBRTMFP_API typedef enum {
 	RTMFP_UNDEFINED			= 0x00,
 	RTMFP_CONNECTED			= 0x01,
@@ -100,6 +160,8 @@ LIBRTMFP_API unsigned short RTMFP_Connect2Peer(unsigned int RTMFPcontext, const
 // param audioReliable if True all audio packets losts are repeated, otherwise audio packets are not repeated
 // param videoReliable if True all video packets losts are repeated, otherwise video packets are not repeated
 // param fallbackUrl [optional] an rtmfp unicast url used if no data is coming from the NetGroup (be careful to use the same stream codecs to avoid undefined behavior)
+// NOTE: A player can call it again with the same NetGroup to subscribe to another stream (rendition), the peers connections are shared by all the streams,
+// call RTMFP_CloseStream with the id returned to unsubscribe
 // return the id of the stream (to call with RTMFP_Read) or 0 if an error occurs 
 LIBRTMFP_API unsigned short RTMFP_Connect2Group(unsigned int RTMFPcontext, const char* streamName, RTMFPConfig* parameters, RTMFPGroupConfig* groupParameters, unsigned short audioReliable, unsigned short videoReliable, const char* fallbackUrl);
 
@@ -152,6 +214,20 @@ LIBRTMFP_API unsigned int RTMFP_CallFunction(unsigned int RTMFPcontext, const ch
 // return: True if the event happened, False if an error occurs
 LIBRTMFP_API char RTMFP_WaitForEvent(unsigned int RTMFPcontext, RTMFPMask mask);
 
+// Fill the statistics of the connection RTMFPcontext and its P2P sessions (lock-free, can be polled from any thread)
+// return : 1 if the connection is found, 0 otherwise
+LIBRTMFP_API char RTMFP_GetStats(unsigned int RTMFPcontext, RTMFPStats* stats);
+
+// Fill the statistics of the stream streamId of the connection RTMFPcontext (lock-free, can be polled from any thread)
+// return : 1 if the stream is found, 0 otherwise
+LIBRTMFP_API char RTMFP_GetStreamStats(unsigned int RTMFPcontext, unsigned short streamId, RTMFPStreamStats* stats);
+
+// Fill the latency histogram of a stage (RTMFPHistogramStage) of the connection RTMFPcontext and its P2P sessions
+// The histograms are only available if librtmfp is compiled with LIBRTMFP_HISTOGRAMS defined (make HISTOGRAMS=1)
+// reset : if not 0 the histogram is reset after reading (the next call returns the latencies measured since this one)
+// return : 1 if the histogram is found, 0 otherwise
+LIBRTMFP_API char RTMFP_GetHistogram(unsigned int RTMFPcontext, int stage, RTMFPHistogram* histogram, int reset);
+
 // Retrieve publication name and url from original uri
 LIBRTMFP_API void RTMFP_GetPublicationAndUrlFromUri(const char* uri, char** publication);
 
@@ -160,6 +236,16 @@ LIBRTMFP_API void RTMFP_GetPublicationAndUrlFromUri(const char* uri, char** publ
 // - logLevel (int) : log level of the application
 // - socketReceiveSize (int) : socket size limit to be used with input packets
 // - socketSendSize (int) : socket size limit to be used with output packets
+// - timeoutFallback (int) : time to wait (in msec) before starting the unicast fallback connection of a NetGroup
+// - ackPackets (int) : number of data packets received before acknowledging them (2 by default, gaps are always acknowledged immediatly)
+// - ackDelay (int) : maximum time (in msec) to delay the acknowledgments (50 by default, effective delay is a multiple of the management period)
+// - mediaDeadline (int) : delay (in msec) after the media timestamp to drop a non-key audio/video frame not sent yet, following video frames are dropped until the next key frame (0 by default to disable, 2000 is a good value for live)
+// - maxPacketSize (int) : maximum packet size to probe with path MTU discovery, only librtmfp peers answer the probes (1192 by default to disable the discovery, 9000 maximum)
+// - fecBlock (int) : number of audio/video stages protected by forward error correction parities, read at each publication, only for librtmfp peers (0 by default to disable, 255 maximum)
+// - fecParities (int) : number of XOR parities sent after each block of stages, the stages are interleaved to recover the bursts of losses (1 by default)
+// - deltaReports (int) : 1 to exchange delta Group Reports with the librtmfp peers of a NetGroup, the peers not heard since the last report are not sent again (0 by default, both peers must enable it)
+// - gopCacheSize (int) : maximum size (in bytes) of the media cached since the last key frame of a publication, sent at once to the new direct P2P and NetGroup listeners (0 by default to disable, 2097152 for 2MB)
+// - lossInjection (int) : percentage of the outgoing packets dropped randomly, to test the loss recovery (0 by default, only if librtmfp is compiled with LIBRTMFP_LOSS_INJECTION defined, make LOSS=1)
 LIBRTMFP_API void RTMFP_SetParameter(const char* parameter, const char* value);
 
 // Set an integer Global Parameter to the requested value (int version)
@@ -31,9 +31,13 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 using namespace Base;
 using namespace std;
 
-FlowManager::FlowManager(bool responder, Invoker& invoker, OnStatusEvent pOnStatusEvent) : _invoker(invoker), _pOnStatusEvent(pOnStatusEvent), 
+FlowManager::FlowManager(bool responder, Invoker& invoker, OnStatusEvent pOnStatusEvent, const shared<RTMFP::Stats>& pStats) : _invoker(invoker), _pOnStatusEvent(pOnStatusEvent), _pStats(pStats), 
 	status(RTMFP::STOPPED), _tag(16, '\0'), _sessionId(0), _pListener(NULL), _mainFlowId(0), _initiatorTime(-1), _responder(responder), _nextRTMFPWriterId(2), _farId(0), _threadSend(0), _ping(0), _waitClose(false),
-	_rttvar(0), _rto(Net::RTO_INIT) {
+	_rttvar(0), _rto(Net::RTO_INIT), _ackPackets(0), _maxAckPackets(RTMFP::Parameters().getNumber<UInt32>("ackPackets")), _maxAckDelay(RTMFP::Parameters().getNumber<UInt32>("ackDelay")),
+	_probeCount(0), _probeMin(RTMFP::SIZE_PACKET), _probeMax(min<UInt32>(RTMFP::Parameters().getNumber<UInt32>("maxPacketSize"), RTMFP::SIZE_PACKET_MAX) + 1),
+	_fecRequests(RTMFP::Parameters().getNumber<UInt32>("fecBlock") ? RTMFP::FEC_REQUESTS : 0), deltaReports(false), _deltaRequests(0) {
+
+	_probeSize = (_probeMax > (RTMFP::SIZE_PACKET + RTMFP::PROBE_PRECISION)) ? RTMFP::SIZE_PACKET : 0; // first probe to know if the peer answers
 
 	_pMainStream.set();
 	_pMainStream->onStatus = [this](const string& code, const string& description, UInt16 streamId, UInt64 flowId, double cbHandler) {
@@ -97,6 +101,10 @@ void FlowManager::clearWriters() {
 
 void FlowManager::flushWriters() {
 
+	// Hold the current packet of the session while raising the writers to bundle their chunks in the same packets
+	if (_pSendSession)
+		++_pSendSession->pending;
+
 	// Raise RTMFPWriter
 	auto it = _flowWriters.begin();
 	while (it != _flowWriters.end()) {
@@ -109,6 +117,58 @@ void FlowManager::flushWriters() {
 		}
 		++it;
 	}
+
+	// Send the waiting acknowledgments if the maximum delay is reached
+	if (!_waitingAcks.empty() && _ackTime.isElapsed(_maxAckDelay))
+		flushAcks();
+
+	// Release the current packet
+	if (_pSendSession) {
+		shared<RTMFPSender> pSender(make_shared<RTMFPChunkSender>(0x89 + _responder));
+		pSender->address = _address;
+		pSender->pSession = _pSendSession;
+		_invoker.threadPool.queue(_threadSend, move(pSender));
+	}
+}
+
+void FlowManager::sendProbe() {
+	if (_probeCount++ == RTMFP::PROBE_COUNT) {
+		// lost!
+		if (_probeSize == RTMFP::SIZE_PACKET) {
+			DEBUG("No answer to the probes from ", name(), ", packet size stays at ", RTMFP::SIZE_PACKET)
+			_probeSize = 0;
+			return;
+		}
+		_probeMax = _probeSize;
+		nextProbe();
+		if (!_probeSize)
+			return;
+		++_probeCount;
+	}
+	_probeTime.update();
+
+	// Padded probe, chunk size is written after the padding
+	Buffer& buffer = write(0x6e, 0);
+	UInt32 size = buffer.size();
+	BinaryWriter(buffer).write16(_probeSize);
+	buffer.resize(_probeSize);
+	memset(buffer.data() + size + 2, 0, _probeSize - size - 2);
+	BinaryWriter(buffer.data() + size - 2, 2).write16(_probeSize - size);
+	sendAlone(); // the peer may not know the probes
+}
+
+void FlowManager::sendAlone() {
+	RTMFP::Send(*socket(_address.family()), Packet(_pEncoder->encode(_pBuffer, _farId, _address)), _address);
+}
+
+void FlowManager::nextProbe() {
+	_probeCount = 0;
+	if ((_probeMax - _probeMin) <= RTMFP::PROBE_PRECISION) {
+		INFO("Packet size of session ", name(), " is ", _probeMin, " bytes")
+		_probeSize = 0;
+		return;
+	}
+	_probeSize = (_probeMin + _probeMax) / 2;
 }
 
 void FlowManager::sendCloseChunk(bool abrupt) {
@@ -129,7 +189,7 @@ void FlowManager::close(bool abrupt, RTMFP::CLOSE_REASON reason) {
 		// Trick to know the close reason
 		if (reason != RTMFP::SESSION_CLOSED) {
 			BinaryWriter(write(0x4d, 1)).write8(reason);
-			RTMFP::Send(*socket(_address.family()), Packet(_pEncoder->encode(_pBuffer, _farId, _address)), _address);
+			sendAlone();
 		}
 		sendCloseChunk(abrupt);
 	}
@@ -163,6 +223,7 @@ void FlowManager::receive(const Packet& packet) {
 	UInt8 flags;
 	RTMFPFlow* pFlow = NULL;
 	UInt64 stage = 0;
+	bool ackNow = false; // True to acknowledge immediatly (gap or unknown flow)
 
 	BinaryReader reader(packet.data(), packet.size());
 	UInt8 type = reader.available()>0 ? reader.read8() : 0xFF, nextType(0xFF);
@@ -213,6 +274,67 @@ void FlowManager::receive(const Packet& packet) {
 		case 0x41:
 			_lastKeepAlive.update();
 			break;
+		case 0x6e: { // Path MTU probe (librtmfp only), answer with the size received
+			if (status != RTMFP::CONNECTED)
+				break;
+			shared<Buffer> pChunk(SET);
+			BinaryWriter(*pChunk).write8(0x6f).write16(2).write16(message.read16());
+			send(make_shared<RTMFPChunkSender>(0x89 + _responder, pChunk));
+			break;
+		}
+		case 0x6f: { // Path MTU probe acknowledgment
+			UInt16 size = message.read16();
+			if (!_probeSize || size != _probeSize)
+				break; // obsolete
+			_probeMin = size;
+			if (_pSendSession)
+				_pSendSession->packetSize = size;
+			DEBUG("Probe of ", size, " bytes acknowledged on session ", name())
+			nextProbe();
+			if (_probeSize)
+				sendProbe();
+			break;
+		}
+
+		case 0x6c: { // FEC request (0) or answer (1), the peer is a librtmfp peer which decodes the parities
+			if (status != RTMFP::CONNECTED || !_pSendSession)
+				break;
+			if (!_pSendSession->fec)
+				DEBUG("FEC enabled on session ", name())
+			_pSendSession->fec = true;
+			_fecRequests = 0;
+			if (message.read8())
+				break;
+			shared<Buffer> pChunk(SET);
+			BinaryWriter(*pChunk).write8(0x6c).write16(1).write8(1);
+			send(make_shared<RTMFPChunkSender>(0x89 + _responder, pChunk));
+			break;
+		}
+		case 0x6b: { // Delta Group Reports request (0) or answer (1), the peer is a librtmfp peer which reads them
+			if (status != RTMFP::CONNECTED || !RTMFP::Parameters().getNumber<UInt32>("deltaReports"))
+				break;
+			if (!deltaReports)
+				DEBUG("Delta Group Reports enabled on session ", name())
+			deltaReports = true;
+			_deltaRequests = 0;
+			if (message.read8())
+				break;
+			shared<Buffer> pChunk(SET);
+			BinaryWriter(*pChunk).write8(0x6b).write16(1).write8(1);
+			send(make_shared<RTMFPChunkSender>(0x89 + _responder, pChunk));
+			break;
+		}
+		case 0x6d: { // FEC parity (librtmfp only)
+			auto itFlow = _flows.find(message.read7Bit<UInt64>());
+			if (itFlow == _flows.end())
+				break;
+			UInt64 first = message.read7Bit<UInt64>();
+			UInt8 count = message.read8();
+			UInt8 parities = message.read8();
+			UInt8 index = message.read8();
+			itFlow->second->inputParity(first, count, parities, index, Packet(packet, message.current(), message.available()));
+			break;
+		}
 
 		case 0x5e : {
 			// RTMFPWriter exception!
@@ -236,38 +358,41 @@ void FlowManager::receive(const Packet& packet) {
 		case 0x51: {
 			/// Acknowledgment
 			UInt64 id = message.read7Bit<UInt64>();
-			UInt64 bufferSize = message.read7Bit<UInt64>();
+			UInt64 bufferSize = message.read7Bit<UInt64>(); // buffer available in 1024 bytes blocks
 			shared<RTMFPWriter> pWriter;
 			if (writer(id, pWriter)) {
-				if (bufferSize) {
+				{
 					UInt64 ackStage(message.read7Bit<UInt64>());
-					UInt32 lostCount(0);
-					if (message.available()) {
-						++lostCount;
-						if (type == 0x50) {
-							UInt8 i;
-							do {
-								UInt8 bits(message.read8());
-								for (i = 0; i < 8; ++i) {
-									if (bits & 1)
-										break;
-									++lostCount;
-									bits >>= 1;
-								}
-
-							} while (i == 8 && message.available());
+					RTMFPSender::Ranges ranges; // stages received out of order (SACK)
+					UInt64 current(ackStage + 1); // first stage missing
+					if (type == 0x50) {
+						// bitfield, each bit set is a stage received after the first stage missing
+						while (message.available()) {
+							UInt8 bits(message.read8());
+							for (UInt8 i = 0; i < 8; ++i, bits >>= 1) {
+								++current;
+								if (!(bits & 1))
+									continue;
+								if (!ranges.empty() && ranges.back().second == (current - 1))
+									ranges.back().second = current;
+								else
+									ranges.emplace_back(current, current);
+							}
+						}
+					}
+					else {
+						// ranges, lost count - 1 followed by received count - 1
+						while (message.available()) {
+							UInt64 first(current + message.read7Bit<UInt64>() + 1);
+							current = first + message.read7Bit<UInt64>();
+							ranges.emplace_back(first, current++);
 						}
-						else
-							lostCount += UInt32(message.read7Bit<UInt64>());
 					}
-					pWriter->acquit(ackStage, lostCount);
+					// No more place on receiver side => the writer waits for it (flow control)
+					if (!bufferSize && !pWriter->closed())
+						DEBUG("RTMFPWriter ", id, " receiver buffer full on session ", name());
+					pWriter->acquit(ackStage, bufferSize * 1024, move(ranges));
 				}
-				else if (!pWriter->closed()) {
-					// no more place to write, reliability broken
-					WARN("RTMFPWriter ", id, " can't deliver its data, buffer full on session ", name());
-					close(false, RTMFP::SESSION_CLOSED);
-					return;
-				} // else ack on a closed writer, ignored
 			}
 			break;
 		}
@@ -333,9 +458,11 @@ void FlowManager::receive(const Packet& packet) {
 
 			// Process request
 			if (pFlow && (status != RTMFP::FAILED)) {
+				if (pFlow->hasGap())
+					ackNow = true; // can fill a gap, acknowledge immediatly
 				pFlow->input(stage, flags, Packet(packet, message.current(), message.available()), nextType==0xFF);
 
-				// Read congestion management (reliable mode)
+				// Read congestion management (reliable mode), last resort if the peer does not respect our window
 				if (pFlow->fragmentation > Net::GetRecvBufferSize()) {
 					if (status < RTMFP::NEAR_CLOSED) {
 						WARN("Session ", name(), " input is congested (", pFlow->fragmentation, " > ", Net::GetRecvBufferSize(),")")
@@ -356,27 +483,61 @@ void FlowManager::receive(const Packet& packet) {
 
 		// Commit RTMFPFlow (pFlow means 0x11 or 0x10 message)
 		if (stage && (status != RTMFP::FAILED) && type != 0x11) {
-			if (pFlow) {
-				vector<UInt64> losts;
-				stage = pFlow->buildAck(losts, size = 0);
-				size += Binary::Get7BitSize<UInt64>(pFlow->id) + Binary::Get7BitSize<UInt64>(0xFF7Fu) + Binary::Get7BitSize<UInt64>(stage);
-				BinaryWriter writer(write(0x51, size));
-				writer.write7Bit<UInt64>(pFlow->id).write7Bit<UInt64>(0xFF7F).write7Bit<UInt64>(stage);
-				for (UInt64 lost : losts)
-					writer.write7Bit<UInt64>(lost);
-				if (pFlow->consumed())
-					removeFlow(pFlow);
-				pFlow = NULL;
-			}
-			else // commit everything (flow unknown)
-				BinaryWriter(write(0x51, 1 + Binary::Get7BitSize<UInt64>(flowId) + Binary::Get7BitSize<UInt64>(stage))).write7Bit<UInt64>(flowId).write7Bit<UInt64>(0).write7Bit<UInt64>(stage);
-			if (_pBuffer) {
-				TRACE("Sending ack ", stage)
-				RTMFP::Send(*socket(_address.family()), Packet(_pEncoder->encode(_pBuffer, _farId, _address)), _address);
-			}
+			if (!pFlow || pFlow->hasGap())
+				ackNow = true; // unknown flow or gap, acknowledge immediatly
+			if (_waitingAcks.empty())
+				_ackTime.update();
+			_waitingAcks[pFlow ? pFlow->id : flowId] = stage;
+			pFlow = NULL;
 			stage = 0;
 		}
 	}
+
+	// Acknowledge every "ackPackets" data packets (or later in manage)
+	if (!_waitingAcks.empty() && (ackNow || ++_ackPackets >= _maxAckPackets))
+		flushAcks();
+}
+
+void FlowManager::flushAcks() {
+	_ackPackets = 0;
+	if (_waitingAcks.empty() || status == RTMFP::FAILED)
+		return;
+
+	// Receiver window, input buffer size minus the data buffered in the flow and the media waiting to be read
+	UInt64 window(Net::GetRecvBufferSize()), readQueue(readQueueSize());
+	shared<Buffer> pChunks;
+
+	for (auto& it : _waitingAcks) {
+		vector<UInt64> losts;
+		UInt16 size(0);
+		UInt64 stage(it.second), bufferSize(0);
+		auto itFlow = _flows.find(it.first);
+		if (itFlow != _flows.end()) {
+			stage = itFlow->second->buildAck(losts, size);
+			UInt64 buffered(itFlow->second->bufferedSize() + readQueue);
+			bufferSize = buffered < window ? min<UInt64>((window - buffered) / 1024, UInt64(RTMFP::WINDOW_MAX) / 1024) : 0; // in 1024 bytes blocks
+		} // else commit everything (flow unknown)
+		size += Binary::Get7BitSize<UInt64>(it.first) + Binary::Get7BitSize<UInt64>(bufferSize) + Binary::Get7BitSize<UInt64>(stage);
+		// Flow unknown (rejected or released) => followed by a flow exception, a null window alone would let the writer wait for it
+		UInt16 exceptionSize(itFlow == _flows.end() ? (3 + Binary::Get7BitSize<UInt64>(it.first) + 1) : 0);
+
+		// Bundle the acknowledgments of all flows (and the writers chunks) in the same packet while possible
+		if (pChunks && (RTMFP::SIZE_HEADER + pChunks->size() + 3 + size + exceptionSize) > RTMFP::SIZE_PACKET)
+			send(make_shared<RTMFPChunkSender>(0x89 + _responder, pChunks));
+		if (!pChunks)
+			pChunks.set();
+		BinaryWriter writer(*pChunks);
+		writer.write8(0x51).write16(size);
+		writer.write7Bit<UInt64>(it.first).write7Bit<UInt64>(bufferSize).write7Bit<UInt64>(stage);
+		for (UInt64 lost : losts)
+			writer.write7Bit<UInt64>(lost);
+		if (exceptionSize)
+			writer.write8(0x5e).write16(exceptionSize - 3).write7Bit<UInt64>(it.first).write8(0);
+		TRACE("Sending ack ", stage, " on flow ", it.first)
+	}
+	_waitingAcks.clear();
+	if (pChunks)
+		send(make_shared<RTMFPChunkSender>(0x89 + _responder, pChunks));
 }
 
 void FlowManager::send(shared<RTMFPSender>&& pSender) {
@@ -393,6 +554,7 @@ void FlowManager::send(shared<RTMFPSender>&& pSender) {
 	// continue even on _killing to repeat writers messages to flush it (reliable)
 	pSender->address = _address;
 	pSender->pSession = _pSendSession;
+	++_pSendSession->pending;
 	_invoker.threadPool.queue(_threadSend, move(pSender));
 }
 
@@ -440,6 +602,13 @@ RTMFPFlow* FlowManager::createFlow(UInt64 id, const string& signature, UInt64 id
 	return _flows.emplace_hint(it, piecewise_construct, forward_as_tuple(id), forward_as_tuple(pFlow))->second;
 }
 
+UInt64 FlowManager::fragmentation() const {
+	UInt64 size(0);
+	for (auto& it : _flows)
+		size += it.second->bufferedSize();
+	return size;
+}
+
 bool FlowManager::manage() {
 
 	if (status != RTMFP::FAILED) {
@@ -474,9 +643,29 @@ bool FlowManager::manage() {
 		// Every 5s : send back session close request
 		if (status == RTMFP::NEAR_CLOSED && _lastClose.isElapsed(5000))
 			sendCloseChunk(false);
+
+		// Path MTU discovery, send the next probe if the last one is lost
+		if (_probeSize && status == RTMFP::CONNECTED && _probeTime.isElapsed(rto()))
+			sendProbe();
+
+		// Forward error correction, ask the peer if it decodes the parities (Flash ignores the request)
+		if (_fecRequests && status == RTMFP::CONNECTED && _fecTime.isElapsed(rto())) {
+			--_fecRequests;
+			_fecTime.update();
+			BinaryWriter(write(0x6c, 1)).write8(0);
+			sendAlone(); // not with the chunks of the session, the peer may not know the request
+		}
+
+		// Delta Group Reports, ask the peer if it reads them (Flash ignores the request)
+		if (_deltaRequests && status == RTMFP::CONNECTED && _deltaTime.isElapsed(rto())) {
+			--_deltaRequests;
+			_deltaTime.update();
+			BinaryWriter(write(0x6b, 1)).write8(0);
+			sendAlone(); // not with the chunks of the session, the peer may not know the request
+		}
 	}
 
-	// Send the waiting messages
+	// Send the waiting messages (and acknowledgments)
 	flushWriters();
 	return true;
 }
@@ -517,7 +706,7 @@ bool FlowManager::computeKeys(UInt32 farId) {
 	RTMFP::ComputeAsymetricKeys(_sharedSecret, BIN initiatorNonce->data(), initiatorNonce->size(), BIN responderNonce->data(), responderNonce->size(), requestKey, responseKey);
 	_pDecoder.set(_responder ? requestKey : responseKey);
 	_pEncoder.set(_responder ? responseKey : requestKey);
-	_pSendSession.set(farId, _pEncoder, socket(_address.family()), _pSendSession ? _pSendSession->initiatorTime.load() : 0); // important, initialize the sender session
+	_pSendSession.set(farId, _pEncoder, socket(_address.family()), _pSendSession ? _pSendSession->initiatorTime.load() : 0, _pStats); // important, initialize the sender session
 
 	// Save nonces just in case we are in a NetGroup connection
 	_farNonce = _pHandshake->farNonce;
@@ -534,13 +723,16 @@ void FlowManager::receive(const SocketAddress& address, const Packet& packet) {
 	UInt8 marker = reader.read8();
 	UInt16 time = reader.read16();
 	_recvTime.update();
+	_pStats->bytesReceived.fetch_add(packet.size(), memory_order_relaxed);
+	_pStats->packetsReceived.fetch_add(1, memory_order_relaxed);
+	HISTOGRAM(*_pStats, HISTOGRAM_RECEIVE)
 
 	if (address != _address) {
 		DEBUG("Session ", name(), " has change its address from ", _address, " to ", address)
 
 		// If address family change socket will change
 		if (address.family() != _address.family())
-			_pSendSession.set(_farId, _pEncoder, socket(_address.family()), _pSendSession ? _pSendSession->initiatorTime.load() : 0);
+			_pSendSession.set(_farId, _pEncoder, socket(_address.family()), _pSendSession ? _pSendSession->initiatorTime.load() : 0, _pStats);
 		_address.set(address);
 	}
 
@@ -698,7 +890,7 @@ bool FlowManager::onPeerHandshake70(const SocketAddress& address, const shared<B
 
 	// update address & generate the session
 	_address.set(address);
-	_pSendSession.set(0, _pEncoder, socket(_address.family()), _pSendSession ? _pSendSession->initiatorTime.load() : 0);
+	_pSendSession.set(0, _pEncoder, socket(_address.family()), _pSendSession ? _pSendSession->initiatorTime.load() : 0, _pStats);
 	return true;
 };
 
@@ -33,69 +33,88 @@ GroupBuffer::~GroupBuffer() {
 	stop();
 }
 
-bool GroupBuffer::add(Exception& ex, UInt32 groupMediaId, const shared<GroupFragment>& pFragment) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	if (!running())
-		start();
-
-	_waitingRequests.emplace_back(WaitRequest::ADD_FRAGMENT, groupMediaId, pFragment);
-	wakeUp.set();
+bool GroupBuffer::Requests::push(const WaitRequest& request, bool& wasEmpty) {
+	UInt32 tail(_tail.load(memory_order_relaxed));
+	if ((tail - _headCache) >= GROUPBUFFER_REQUESTS && (tail - (_headCache = _head.load(memory_order_acquire))) >= GROUPBUFFER_REQUESTS)
+		return false;
+	WaitRequest& slot(_requests[tail & (GROUPBUFFER_REQUESTS - 1)]);
+	slot.pFragment = request.pFragment;
+	slot.fragmentId = request.fragmentId;
+	slot.groupMediaId = request.groupMediaId;
+	slot.mediaId = request.mediaId;
+	slot.command = request.command;
+	// sequentially consistent with pop() and available() : if the consumer has not seen this request it has already read all the previous ones
+	_tail.store(tail + 1);
+	wasEmpty = (_headCache = _head.load()) == tail;
 	return true;
 }
 
-bool GroupBuffer::removeBuffer(Exception& ex, UInt32 groupMediaId) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	if (!running())
-		start();
+void GroupBuffer::Requests::pop(UInt32 count) {
+	for (UInt32 i = 0; i < count; ++i)
+		at(i).pFragment.reset(); // release the fragment now
+	_head.store(_read += count);
+}
 
-	_waitingRequests.emplace_back(WaitRequest::REMOVE_BUFFER, groupMediaId);
-	wakeUp.set();
+bool GroupBuffer::queue(const WaitRequest& request) {
+	bool wasEmpty(false);
+	// Ring full : wait for the thread to process a batch
+	while (!_requests.push(request, wasEmpty)) {
+		wakeUp.set();
+		this_thread::yield();
+	}
+	// Push before the running test, so a thread stopping after the test will see the request (see run())
+	atomic_thread_fence(memory_order_seq_cst);
+	if (!running()) {
+		start();
+		wasEmpty = true;
+	}
+	if (wasEmpty)
+		wakeUp.set(); // else the thread has not finished to read the requests
 	return true;
 }
 
-bool GroupBuffer::removeFragments(Exception& ex, UInt32 groupMediaId, UInt64 fragmentId) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	if (!running())
-		start();
+bool GroupBuffer::add(Exception& ex, UInt32 groupMediaId, const shared<GroupFragment>& pFragment) {
+	return queue(WaitRequest(WaitRequest::ADD_FRAGMENT, groupMediaId, pFragment));
+}
 
-	_waitingRequests.emplace_back(WaitRequest::REMOVE_FRAGMENTS, groupMediaId, nullptr, fragmentId);
-	wakeUp.set();
-	return true;
+bool GroupBuffer::removeBuffer(Exception& ex, UInt32 groupMediaId) {
+	return queue(WaitRequest(WaitRequest::REMOVE_BUFFER, groupMediaId));
 }
 
-bool GroupBuffer::startProcessing(Exception& ex, UInt32 groupMediaId) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	if (!running())
-		start();
+bool GroupBuffer::removeFragments(Exception& ex, UInt32 groupMediaId, UInt64 fragmentId) {
+	return queue(WaitRequest(WaitRequest::REMOVE_FRAGMENTS, groupMediaId, nullptr, fragmentId));
+}
 
-	_waitingRequests.emplace_back(WaitRequest::START_PROCESSING, groupMediaId);
-	wakeUp.set();
-	return true;
+bool GroupBuffer::startProcessing(Exception& ex, UInt32 groupMediaId, UInt16 mediaId, UInt64 firstFragment) {
+	return queue(WaitRequest(WaitRequest::START_PROCESSING, groupMediaId, nullptr, firstFragment, mediaId));
 }
 
 bool GroupBuffer::run(Exception&, const volatile bool& requestStop) {
 
+	bool stopping(false);
 	for (;;) {
 		bool timeout = !wakeUp.wait(120000); // 2 mn of timeout
 		for (;;) {
 
-			// Get waiting fragments or handle stop
-			deque<WaitRequest> requests;
-			{
-				lock_guard<mutex> lock(_mutex);
-				if (_waitingRequests.empty()) {
-					if (!timeout && !requestStop)
-						break; // wait more
-					stop(); // to set _stop immediatly!
+			// Get the waiting requests or handle stop
+			UInt32 count(_requests.available());
+			if (!count) {
+				if (stopping)
 					return true;
-				}
-				requests = move(_waitingRequests);
+				if (!timeout && !requestStop)
+					break; // wait more
+				stop(); // to set _stop immediatly!
+				// Process the requests pushed before the producer has seen the stop (the next ones will restart the thread)
+				atomic_thread_fence(memory_order_seq_cst);
+				stopping = true;
+				continue;
 			}
 
-			// Process requests
+			// Process the batch of requests
 			Result result;
-			for (WaitRequest& request : requests)
-				processRequest(result, request);
+			for (UInt32 i = 0; i < count; ++i)
+				processRequest(result, _requests.at(i));
+			_requests.pop(count);
 
 			// Forward packets if the result queue is not empty
 			if (!result.empty())
@@ -104,7 +123,7 @@ bool GroupBuffer::run(Exception&, const volatile bool& requestStop) {
 	}
 }
 
-void GroupBuffer::processRequest(deque<RTMFP::MediaPacket>& result, WaitRequest& request) {
+void GroupBuffer::processRequest(Result& result, WaitRequest& request) {
 
 	auto itBuffer = _mapGroupMedia2fragments.lower_bound(request.groupMediaId);
 
@@ -114,7 +133,12 @@ void GroupBuffer::processRequest(deque<RTMFP::MediaPacket>& result, WaitRequest&
 		// Create the buffer if it doesn't exist
 		if (itBuffer == _mapGroupMedia2fragments.end() || itBuffer->first != request.groupMediaId)
 			itBuffer = _mapGroupMedia2fragments.emplace_hint(itBuffer, piecewise_construct, forward_as_tuple(request.groupMediaId), forward_as_tuple());
-		else {
+		itBuffer->second.mediaId = request.mediaId;
+		if (request.fragmentId) { // ignore the fragments before the first one
+			itBuffer->second.erase(itBuffer->second.begin(), itBuffer->second.lower_bound(request.fragmentId));
+			itBuffer->second.currentId = request.fragmentId - 1;
+		}
+		if (!itBuffer->second.empty()) {
 			auto itFragment = itBuffer->second.begin();
 			while (processFragment(result, itBuffer->first, itBuffer->second, itFragment))
 				++itFragment;
@@ -139,7 +163,7 @@ void GroupBuffer::processRequest(deque<RTMFP::MediaPacket>& result, WaitRequest&
 	}
 }
 
-void GroupBuffer::processAddFragment(map<UInt32, MediaBuffer>::iterator& itBuffer, deque<RTMFP::MediaPacket>& result, WaitRequest& request) {
+void GroupBuffer::processAddFragment(map<UInt32, MediaBuffer>::iterator& itBuffer, Result& result, WaitRequest& request) {
 
 	// Create the buffer if it doesn't exist
 	if (itBuffer == _mapGroupMedia2fragments.end() || itBuffer->first != request.groupMediaId)
@@ -156,7 +180,7 @@ void GroupBuffer::processAddFragment(map<UInt32, MediaBuffer>::iterator& itBuffe
 		++itFragment;
 }
 
-void GroupBuffer::processRemoveFragments(const map<UInt32, MediaBuffer>::iterator& itBuffer, deque<RTMFP::MediaPacket>& result, WaitRequest& request) {
+void GroupBuffer::processRemoveFragments(const map<UInt32, MediaBuffer>::iterator& itBuffer, Result& result, WaitRequest& request) {
 	if (itBuffer == _mapGroupMedia2fragments.end() || itBuffer->first != request.groupMediaId) {
 		FATAL_ERROR("Unable to find the GroupMedia buffer ", request.groupMediaId) // implementation error
 		return;
@@ -185,7 +209,7 @@ void GroupBuffer::processRemoveFragments(const map<UInt32, MediaBuffer>::iterato
 	}
 }
 
-bool GroupBuffer::processFragment(std::deque<RTMFP::MediaPacket>& result, UInt32 groupMediaId, MediaBuffer& buffer, MAP_FRAGMENTS_ITERATOR& itFragment) {
+bool GroupBuffer::processFragment(Result& result, UInt32 groupMediaId, MediaBuffer& buffer, MAP_FRAGMENTS_ITERATOR& itFragment) {
 	if (itFragment == buffer.end())
 		return false;
 
@@ -198,7 +222,8 @@ bool GroupBuffer::processFragment(std::deque<RTMFP::MediaPacket>& result, UInt32
 			buffer.currentId = itFragment->first;
 
 			DEBUG("GroupMedia ", groupMediaId, " - Pushing Media Fragment ", itFragment->first)
-			result.emplace_back(*itFragment->second, itFragment->second->time, itFragment->second->type);
+			HISTOGRAM_ORIGIN(itFragment->second->origin) // reception time of the fragment, kept by the media packet
+			result.emplace_back(buffer.mediaId, *itFragment->second, itFragment->second->time, itFragment->second->type);
 			return true;
 		}
 		return false;
@@ -251,7 +276,8 @@ bool GroupBuffer::processFragment(std::deque<RTMFP::MediaPacket>& result, UInt32
 		} while (itCurrent++ != itEnd);
 
 		DEBUG("GroupMedia ", groupMediaId, " - Pushing splitted packet ", itStart->first, " - ", nbFragments, " fragments for a total size of ", writer.size())
-		result.emplace_back(Packet(pBuffer), itStart->second->time, itStart->second->type);
+		HISTOGRAM_ORIGIN(itStart->second->origin) // reception time of the first fragment, kept by the media packet
+		result.emplace_back(buffer.mediaId, Packet(pBuffer), itStart->second->time, itStart->second->type);
 		return true;
 	}
 	return false;
@@ -24,39 +24,168 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "GroupStream.h"
 #include "librtmfp.h"
 #include "Base/Util.h"
+#include <algorithm>
 
 using namespace Base;
 using namespace std;
 
 UInt32	GroupMedia::GroupMediaCounter = 0;
 
+#define FRAGMENTS_CAPACITY	1024 // initial capacity of the fragment store (power of 2, at least 64)
+#define FRAGMENTS_MAX		0x40000 // maximum capacity of the fragment store (power of 2), the fragments farther from the stored ones are ignored
+
+GroupMedia::FragmentStore::FragmentStore() : _slots(FRAGMENTS_CAPACITY), _bits(FRAGMENTS_CAPACITY / 64), _mask(FRAGMENTS_CAPACITY - 1), _first(0), _last(0), _count(0), _lastReference(0), _evicted(false), changed(true) {
+}
+
+const shared<GroupFragment>& GroupMedia::FragmentStore::get(UInt64 id) const {
+	static const shared<GroupFragment> Null;
+	return has(id) ? _slots[id & _mask].pFragment : Null;
+}
+
+bool GroupMedia::FragmentStore::accepts(UInt64 id) const {
+	if (!_count)
+		return true;
+	return id < _first ? (_last - id) < FRAGMENTS_MAX : (id <= _last || (id - _first) < FRAGMENTS_MAX);
+}
+
+const shared<GroupFragment>& GroupMedia::FragmentStore::add(UInt64 id, const Packet& packet, UInt32 time, UInt8 mediaType, UInt8 marker, UInt8 splitedNumber) {
+	DEBUG_ASSERT(accepts(id)) // implementation error, the fragment must be checked before
+	if (!_count)
+		_first = _last = id;
+	else if (id < _first) {
+		reserve(id, _last);
+		_first = id;
+	}
+	else if (id > _last) {
+		reserve(_first, id);
+		_last = id;
+	}
+	Slot& slot = _slots[id & _mask];
+	slot.pFragment.set(packet, time, (AMF::Type)mediaType, id, marker, splitedNumber);
+	// Time reference (newest media beginning) to evict the fragments by time
+	if ((marker == GroupStream::GROUP_MEDIA_DATA || marker == GroupStream::GROUP_MEDIA_START) && id > _lastReference) {
+		slot.time = Time::Now();
+		_lastReference = id;
+	}
+	else
+		slot.time = 0;
+	_bits[(id & _mask) >> 6] |= UInt64(1) << (id & 63);
+	++_count;
+	changed = true;
+	return slot.pFragment;
+}
+
+void GroupMedia::FragmentStore::reserve(UInt64 first, UInt64 last) {
+	UInt64 capacity(_slots.size());
+	while (capacity < (last - first + 1) && capacity < FRAGMENTS_MAX)
+		capacity <<= 1;
+	if (capacity == _slots.size())
+		return;
+
+	// Move the fragments to their new index
+	vector<Slot> slots(capacity);
+	vector<UInt64> bits(capacity / 64);
+	for (UInt64 id = _first; id <= _last; ++id) {
+		if (!has(id))
+			continue;
+		UInt64 index(id & (capacity - 1));
+		slots[index] = move(_slots[id & _mask]);
+		bits[index >> 6] |= UInt64(1) << (id & 63);
+	}
+	_slots.swap(slots);
+	_bits.swap(bits);
+	_mask = capacity - 1;
+}
+
+UInt64 GroupMedia::FragmentStore::evict(Int64 time) {
+	// Find the first time reference received after time
+	UInt64 end(_first);
+	for (; end <= _last; ++end) {
+		if (has(end) && _slots[end & _mask].time >= time)
+			break;
+	}
+	if (end > _last || end == _first)
+		return 0; // nothing recent (no reception, keep the fragments) or nothing old
+
+	for (UInt64 id = _first; id < end; ++id) {
+		if (!has(id))
+			continue;
+		Slot& slot(_slots[id & _mask]);
+		slot.pFragment.reset();
+		slot.time = 0;
+		_bits[(id & _mask) >> 6] &= ~(UInt64(1) << (id & 63));
+		--_count;
+	}
+	_first = end;
+	_evicted = changed = true;
+	return end;
+}
+
+UInt64 GroupMedia::FragmentStore::read64(UInt64 id) const {
+	UInt64 index(id & _mask), shift(index & 63);
+	UInt64 word(_bits[index >> 6] >> shift);
+	if (shift)
+		word |= _bits[((index >> 6) + 1) & (_mask >> 6)] << (64 - shift);
+	return word;
+}
+
+UInt64 GroupMedia::FragmentStore::nextMissing(UInt64 id) const {
+	if (!_count || id < _first)
+		return id;
+	while (id <= _last) {
+		UInt64 missing(~read64(id));
+		if ((_last - id) < 63)
+			missing |= ~UInt64(0) << (_last - id + 1); // the bits after _last can be the ones of the first fragments
+		if (missing)
+			return id + RTMFP::LowestBit(missing);
+		id += 64;
+	}
+	return id;
+}
+
+void GroupMedia::FragmentStore::writeMap(BinaryWriter& writer) const {
+	// Bit i of the map is the fragment _last-1-i, so the words are read backward and reversed
+	// (ids before _first read the bits of ids after _last, not present, except for the padding bits which are cleared)
+	UInt64 bits(_last - _first), id(_last);
+	while (bits) {
+		id -= 64;
+		UInt64 word(RTMFP::ReverseBits(read64(id)));
+		UInt8 bytes(8);
+		if (bits < 64) {
+			word &= (UInt64(1) << bits) - 1;
+			bytes = UInt8((bits + 7) / 8);
+			bits = 0;
+		}
+		else
+			bits -= 64;
+		for (UInt8 i = 0; i < bytes; ++i)
+			writer.write8(UInt8(word >> (i * 8)));
+	}
+}
+
 GroupMedia::GroupMedia(const string& name, const string& key, const Base::shared<RTMFPGroupConfig>& parameters, bool audioReliable, bool videoReliable) : _fragmentCounter(0), _currentPushMask(0),
-	_currentPullFragment(0), _itPullPeer(_mapPeers.end()), _itPushPeer(_mapPeers.end()), _itFragmentsPeer(_mapPeers.end()), _lastFragmentMapId(0), _firstPullReceived(false), _fragmentsMapBuffer(MAX_FRAGMENT_MAP_SIZE*4),
+	_currentPullFragment(0), _itPushPeer(_mapPeers.end()), _itFragmentsPeer(_mapPeers.end()), _lastFragmentMapId(0), _firstPullReceived(false), _fragmentsMapBuffer(MAX_FRAGMENT_MAP_SIZE*4),
 	_stream(name), _streamKey(key), groupParameters(parameters), id(++GroupMediaCounter), _endFragment(0), _pullPaused(false), _audioReliable(audioReliable), _videoReliable(videoReliable), 
-	_pullLimitReached(false), _startedPushRequests(false) {
+	_startedPushRequests(false), _fragmentsMapLast(0), _fragmentsIn(0), _duplicatesIn(0), _duplicateBytesIn(0), _joining(!parameters->isPublisher && parameters->fastJoin), _joinFragment(0), _joinAnchor(0) {
 
 	_onPeerClose = [this](const string& peerId, UInt8 mask) {
-		// unset push masks
-		if (mask) {
-			for (UInt8 i = 0; i < 8; i++) {
-				if (mask & (1 << i)) {
-					auto itPush = _mapPushMasks.find(1 << i);
-					if (itPush != _mapPushMasks.end() && itPush->second.first == peerId)
-						_mapPushMasks.erase(itPush);
-				}
-			}
+		// unset push masks and statistics
+		for (PushMask& pushMask : _pushMasks) {
+			if (pushMask.pusher == peerId)
+				pushMask.pusher.clear();
+			pushMask.peers.erase(peerId);
 		}
 		removePeer(peerId);
 	};
 	_onPlayPull = [this](PeerMedia* pPeer, UInt64 index, bool flush) {
-		auto itFragment = _fragments.find(index);
-		if (itFragment == _fragments.end()) {
+		const shared<GroupFragment>& pFragment = _fragments.get(index);
+		if (!pFragment) {
 			DEBUG("GroupMedia ", id, " - Peer is asking for an unknown Fragment (", index, "), possibly deleted")
 			return;
 		}
 
 		// Send fragment to peer (pull mode)
-		pPeer->sendMedia(*itFragment->second, true, itFragment->second->type == AMF::TYPE_AUDIO? _audioReliable : _videoReliable, flush);
+		pPeer->sendMedia(*pFragment, true, pFragment->type == AMF::TYPE_AUDIO? _audioReliable : _videoReliable, flush);
 	};
 	_onFragmentsMap = [this](UInt64 counter) {
 		if (groupParameters->isPublisher)
@@ -88,7 +217,6 @@ GroupMedia::GroupMedia(const string& name, const string& key, const Base::shared
 		UInt8 splitCounter = reader.size() / NETGROUP_MAX_PACKET_SIZE - ((reader.size() % NETGROUP_MAX_PACKET_SIZE) == 0);
 		UInt8 marker = GroupStream::GROUP_MEDIA_DATA ;
 		TRACE("GroupMedia ", id, " - Creating ", (type==AMF::TYPE_VIDEO? "Video":((type==AMF::TYPE_AUDIO)? "Audio" : "Unknown"))," fragments ", _fragmentCounter + 1, " to ", _fragmentCounter + 1 + splitCounter, " - time : ", time)
-		auto itFragment = _fragments.end();
 		do {
 			if (reader.size() > NETGROUP_MAX_PACKET_SIZE)
 				marker = splitCounter == 0 ? GroupStream::GROUP_MEDIA_END : ((reader.current() == reader.data()) ? GroupStream::GROUP_MEDIA_START : GroupStream::GROUP_MEDIA_NEXT);
@@ -99,7 +227,7 @@ GroupMedia::GroupMedia(const string& name, const string& key, const Base::shared
 			pBuffer->resize(fragmentSize);
 			BinaryWriter writer(pBuffer->data(), pBuffer->size());
 			writer.write(reader.current(), fragmentSize);
-			addFragment(itFragment, reliable, NULL, marker, ++_fragmentCounter, splitCounter, type, time, Packet(pBuffer), false); // wait onFlush for flushing
+			addFragment(reliable, NULL, marker, ++_fragmentCounter, splitCounter, type, time, Packet(pBuffer), false); // wait onFlush for flushing
 			reader.next(fragmentSize);
 		} while (splitCounter-- > 0);
 
@@ -111,13 +239,36 @@ GroupMedia::GroupMedia(const string& name, const string& key, const Base::shared
 	_onFragment = [this](PeerMedia* pPeer, const string& peerId, UInt8 marker, UInt64 fragmentId, UInt8 splitedNumber, UInt8 mediaType, UInt32 time, const Packet& packet, double lostRate) {
 		_lastFragment.update(); // save the last fragment reception time for timeout calculation
 
+		// The fragment id comes from the peer, it must not grow the fragment store without limit
+		if (!_fragments.accepts(fragmentId)) {
+			WARN("GroupMedia ", id, " - Fragment ", fragmentId, " from ", peerId, " out of the fragments window (", _fragments.first(), " - ", _fragments.last(), "), ignored")
+			return;
+		}
+
+		// Duplicate check first, the fragment is only referenced until here (too old fragments are ignored too)
+		bool duplicate(_fragments.has(fragmentId) || (_fragments.evicted() && fragmentId < _fragments.first()));
+		++_fragmentsIn;
+		++pPeer->fragmentsIn;
+		if (duplicate) {
+			++_duplicatesIn;
+			++pPeer->duplicatesIn;
+			_duplicateBytesIn += packet.size();
+			pPeer->duplicateBytesIn += packet.size();
+		}
+
 		// Pull fragment?
 		bool startProcess(false);
 		auto itWaiting = _mapWaitingFragments.find(fragmentId);
 		if (itWaiting != _mapWaitingFragments.end()) {
 			TRACE("GroupMedia ", id, " - Waiting fragment ", fragmentId, " received from ", peerId)
+			PullRequest& request = itWaiting->second;
+			if (request.pPeer == pPeer)
+				pPeer->pullAnswered((UInt32)request.time.elapsed());
+			else if (request.pPeer)
+				request.pPeer->pullCanceled();
+			_lastPullAnswer.update();
 			_mapWaitingFragments.erase(itWaiting);
-			if (!_firstPullReceived)
+			if (!_firstPullReceived && !_joining) // (the fast join starts from the video codec infos)
 				startProcess = _firstPullReceived = true;
 		}
 		// Push fragment
@@ -126,56 +277,44 @@ GroupMedia::GroupMedia(const string& name, const string& key, const Base::shared
 			if (pPeer->pushInMode & mask) {
 				TRACE("GroupMedia ", id, " - Push In - fragment received from ", peerId, " : ", fragmentId, " ; mask : ", String::Format<UInt8>("%.2x", mask))
 
-				auto itPushMask = _mapPushMasks.lower_bound(mask);
-				// first push with this mask?
-				if (itPushMask == _mapPushMasks.end() || itPushMask->first != mask)
-					_mapPushMasks.emplace_hint(itPushMask, piecewise_construct, forward_as_tuple(mask), forward_as_tuple(peerId.c_str(), fragmentId));
-				else {
-					if (itPushMask->second.first != peerId) {
-						// Peer is faster?
-						if (itPushMask->second.second < fragmentId) {
-							DEBUG("GroupMedia ", id, " - Push In - Updating the pusher of mask ", mask, ", last peer was ", itPushMask->second.first)
-							auto itOldPeer = _mapPeers.find(itPushMask->second.first);
-							if (itOldPeer != _mapPeers.end())
-								itOldPeer->second->sendPushMode(itOldPeer->second->pushInMode - mask);
-							itPushMask->second.first = peerId.c_str();
-						}
-						else {
-							TRACE("GroupMedia ", id, " - Push In - Tested pusher is slower than current one, resetting mask ", mask, "...")
-							pPeer->sendPushMode(pPeer->pushInMode - mask);
-						}
-					}
-					if (itPushMask->second.second < fragmentId)
-						itPushMask->second.second = fragmentId; // update the last id received for this mask
-				}
+				updatePushers(*pPeer, peerId, fragmentId, duplicate);
 			}
 			else
 				DEBUG("GroupMedia ", id, " - Unexpected fragment received from ", peerId, " : ", fragmentId, " ; mask : ", String::Format<UInt8>("%.2x", mask))
 		}
 
-		bool ignore(false);
-		auto itFragment = _fragments.lower_bound(fragmentId);
-		if (itFragment != _fragments.end() && itFragment->first == fragmentId) {
-			DEBUG("GroupMedia ", id, " - Fragment ", fragmentId, " already received, ignored")
-			ignore = true;
-		}
-		// We must ignore fragments too old
-		else if (_mapTime2Fragment.size() > 2) {
-			auto itBegin = _mapTime2Fragment.begin();
-			auto itEnd = _mapTime2Fragment.rbegin();
-			if (((itEnd->first - itBegin->first) > groupParameters->windowDuration) && itBegin->second > fragmentId) {
-				DEBUG("GroupMedia ", id, " - Fragment ", fragmentId, " too old (min : ", itBegin->second, "), ignored") // TODO: see if we must close the session in this case
-				ignore = true;
-			}
+		if (duplicate) {
+			if (_fragments.has(fragmentId))
+				TRACE("GroupMedia ", id, " - Fragment ", fragmentId, " already received from ", peerId, ", ignored")
+			else
+				DEBUG("GroupMedia ", id, " - Fragment ", fragmentId, " too old (min : ", _fragments.first(), "), ignored") // TODO: see if we must close the session in this case
+			if (startProcess)
+				onStartProcessing(id, _joinAnchor);
+			return;
 		}
 
 		// Add the fragment to the map and send it to pushers, always flush
-		if (!ignore)
-			addFragment(itFragment, (mediaType==AMF::TYPE_AUDIO)? _audioReliable : ((mediaType== AMF::TYPE_VIDEO)? _videoReliable : true), pPeer, marker, fragmentId, splitedNumber, mediaType, time, packet, true);
+		addFragment((mediaType==AMF::TYPE_AUDIO)? _audioReliable : ((mediaType== AMF::TYPE_VIDEO)? _videoReliable : true), pPeer, marker, fragmentId, splitedNumber, mediaType, time, packet, true);
+
+		// Fast join : the reading starts from the first video codec infos received, the requests of the older fragments are canceled
+		if (_joining && !_joinAnchor && mediaType == AMF::TYPE_VIDEO && (marker == GroupStream::GROUP_MEDIA_DATA || marker == GroupStream::GROUP_MEDIA_START) 
+			&& RTMFP::IsVideoCodecInfos(packet.data(), packet.size())) {
+			DEBUG("GroupMedia ", id, " - Fast join - Video codec infos found in fragment ", fragmentId)
+			_joinAnchor = fragmentId;
+			_currentPullFragment = fragmentId - 1;
+			auto itWait = _mapWaitingFragments.begin();
+			while (itWait != _mapWaitingFragments.end() && itWait->first < fragmentId) {
+				if (itWait->second.pPeer)
+					itWait->second.pPeer->pullCanceled();
+				_mapWaitingFragments.erase(itWait++);
+			}
+			if (!_firstPullReceived)
+				startProcess = _firstPullReceived = true;
+		}
 
 		// Important, after receiving the first pull fragment we start processing fragments
 		if (startProcess)
-			onStartProcessing(id);
+			onStartProcessing(id, _joinAnchor);
 	};
 }
 
@@ -194,13 +333,14 @@ void GroupMedia::close(UInt64 lastFragment) {
 	
 	DEBUG("Closing the GroupMedia ", id, " (last fragment : ", lastFragment, ")")
 	_endFragment = lastFragment;
+	_fragments.changed = true;
 }
 
 void GroupMedia::closePublisher() {
 	if (_endFragment) // already closed
 		return;
 
-	UInt32 currentTime = (_fragments.empty()) ? 0 : _fragments.rbegin()->second->time; // get time from last fragment
+	UInt32 currentTime = (_fragments.empty()) ? 0 : _fragments.get(_fragments.last())->time; // get time from last fragment
 	string tmp;
 	shared<Buffer> pBuffer(SET);
 	AMFWriter writer(*pBuffer);
@@ -224,23 +364,20 @@ void GroupMedia::closePublisher() {
 	close(_fragmentCounter);
 }
 
-void GroupMedia::addFragment(MAP_FRAGMENTS_ITERATOR& itFragment, bool reliable, PeerMedia* pPeer, UInt8 marker, UInt64 fragmentId, UInt8 splitedNumber, UInt8 mediaType, UInt32 time, const Packet& packet, bool flush) {
-	itFragment = _fragments.emplace_hint(itFragment, piecewise_construct, forward_as_tuple(fragmentId), forward_as_tuple(SET, packet, time, (AMF::Type)mediaType, fragmentId, marker, splitedNumber));
-
-	if ((marker == GroupStream::GROUP_MEDIA_DATA || marker == GroupStream::GROUP_MEDIA_START) && (_mapTime2Fragment.empty() || fragmentId > _mapTime2Fragment.rbegin()->second))
-		_mapTime2Fragment[Time::Now()] = fragmentId;
+void GroupMedia::addFragment(bool reliable, PeerMedia* pPeer, UInt8 marker, UInt64 fragmentId, UInt8 splitedNumber, UInt8 mediaType, UInt32 time, const Packet& packet, bool flush) {
+	const shared<GroupFragment>& pFragment = _fragments.add(fragmentId, packet, time, mediaType, marker, splitedNumber);
 
 	// Send fragment to peers (push mode) in order of priority
 	UInt8 nbPush = groupParameters->pushLimit + 1;
 	for (auto& it : _listPeers) {
-		if (it.get() != pPeer && it->sendMedia(*itFragment->second, false, reliable, flush) && (--nbPush == 0)) {
+		if (it.get() != pPeer && it->sendMedia(*pFragment, false, reliable, flush) && (--nbPush == 0)) {
 			TRACE("GroupMedia ", id, " - Push limit (", groupParameters->pushLimit + 1, ") reached for fragment ", fragmentId, " (mask=", String::Format<UInt8>("%.2x", 1 << (fragmentId % 8)), ")")
 			break;
 		}
 	}
 
 	// Push the fragment to the output buffer
-	onNewFragment(id, itFragment->second);
+	onNewFragment(id, pFragment);
 }
 
 bool GroupMedia::manage(Int64 now) {
@@ -330,44 +467,31 @@ bool GroupMedia::getNextPeer(MAP_PEERS_INFO_ITERATOR_TYPE& itPeer, bool ascendin
 }
 
 void GroupMedia::eraseOldFragments() {
-	if (_fragments.empty() || _mapTime2Fragment.empty())
+	if (_fragments.empty())
 		return;
 
 	Int64 timeNow = Time::Now();
 	Int64 time2Keep = timeNow - (groupParameters->windowDuration + groupParameters->relayMargin);
-	auto itTime = _mapTime2Fragment.lower_bound(time2Keep);
-
-	// To not delete more than the window duration
-	if (itTime != _mapTime2Fragment.end() && itTime != _mapTime2Fragment.begin() && time2Keep > itTime->first)
-		--itTime;
-
-	// Ignore if no fragment found or if it is the first reference
-	if (itTime == _mapTime2Fragment.end() || itTime == _mapTime2Fragment.begin())
-		return;
-
-	// Get the first fragment before the itTime reference
-	auto itFragment = _fragments.find(itTime->second);
-	if (itFragment != _fragments.begin() && itFragment != _fragments.end())
-		--itFragment;
-
-	if (itFragment == _fragments.end()) {
-		FATAL_ERROR("Unable to find the reference fragment with time ", itTime->second) // implementation error
+	UInt64 oldFragment = _fragments.first();
+	UInt64 firstFragment = _fragments.evict(time2Keep);
+	if (!firstFragment)
 		return;
-	}
 
 	// Delete the old fragments and the old fragments references
-	DEBUG("GroupMedia ", id, " - Deletion of fragments ", _fragments.begin()->first, " to ", itFragment->first, " - current time : ", timeNow)
-	_fragments.erase(_fragments.begin(), itFragment);
-	_mapTime2Fragment.erase(_mapTime2Fragment.begin(), itTime);
+	DEBUG("GroupMedia ", id, " - Deletion of fragments ", oldFragment, " to ", firstFragment - 1, " - current time : ", timeNow)
 
 	// Delete the old waiting fragments
-	auto itWait = _mapWaitingFragments.lower_bound(itFragment->first);
-	if (!_mapWaitingFragments.empty() && _mapWaitingFragments.begin()->first < itFragment->first) {
+	auto itWait = _mapWaitingFragments.lower_bound(firstFragment);
+	if (!_mapWaitingFragments.empty() && _mapWaitingFragments.begin()->first < firstFragment) {
 		WARN("GroupMedia ", id, " - Deletion of waiting fragments ", _mapWaitingFragments.begin()->first, " to ", (itWait == _mapWaitingFragments.end())? _mapWaitingFragments.rbegin()->first : itWait->first)
+		for (auto itPull = _mapWaitingFragments.begin(); itPull != itWait; ++itPull) {
+			if (itPull->second.pPeer)
+				itPull->second.pPeer->pullCanceled();
+		}
 		_mapWaitingFragments.erase(_mapWaitingFragments.begin(), itWait);
 	}
-	if (_currentPullFragment < itFragment->first)
-		_currentPullFragment = itFragment->first; // move the current pull fragment to the 1st fragment
+	if (_currentPullFragment < firstFragment)
+		_currentPullFragment = firstFragment; // move the current pull fragment to the 1st fragment
 
 	// Delete the old fragments map references
 	auto firstFragmentMap = _mapPullTime2Fragment.lower_bound(time2Keep);
@@ -375,7 +499,7 @@ void GroupMedia::eraseOldFragments() {
 		_mapPullTime2Fragment.erase(_mapPullTime2Fragment.begin(), firstFragmentMap);
 
 	// Notify the group buffer
-	onRemovedFragments(id, itFragment->first);
+	onRemovedFragments(id, firstFragment);
 }
 
 UInt64 GroupMedia::updateFragmentMap() {
@@ -385,9 +509,13 @@ UInt64 GroupMedia::updateFragmentMap() {
 	// First we erase old fragments
 	eraseOldFragments();
 
-	// Generate the Fragments map message
-	UInt64 firstFragment = _fragments.empty() ? _endFragment : _fragments.begin()->first;
-	UInt64 lastFragment = _fragments.empty() ? _endFragment : _fragments.rbegin()->first;
+	// Generate the Fragments map message only if the fragments have changed
+	if (!_fragments.changed && _fragmentsMapLast)
+		return _fragmentsMapLast;
+	_fragments.changed = false;
+
+	UInt64 firstFragment = _fragments.empty() ? _endFragment : _fragments.first();
+	UInt64 lastFragment = _fragments.empty() ? _endFragment : _fragments.last();
 
 	UInt64 nbFragments = lastFragment - firstFragment; // number of fragments - the first one
 	_fragmentsMapBuffer.resize((UInt32)((nbFragments / 8) + ((nbFragments % 8) > 0)) + Binary::Get7BitSize<UInt64>(lastFragment) + 1, false);
@@ -396,7 +524,7 @@ UInt64 GroupMedia::updateFragmentMap() {
 
 	// If there is only one fragment we just write its counter
 	if (!nbFragments)
-		return lastFragment;
+		return _fragmentsMapLast = lastFragment;
 
 	if (groupParameters->isPublisher) { // Publisher : We have all fragments, faster treatment
 		
@@ -409,20 +537,10 @@ UInt64 GroupMedia::updateFragmentMap() {
 			lastByte = (lastByte << 1) + 1;
 		writer.write8(lastByte);
 	}
-	else {
-		// Loop on each bit
-		for (UInt64 index = lastFragment - 1; index >= firstFragment && index >= 8; index -= 8) {
-
-			UInt8 currentByte = 0;
-			for (UInt8 fragment = 0; fragment < 8 && (index-fragment) >= firstFragment; fragment++) {
-				if (_fragments.find(index - fragment) != _fragments.end())
-					currentByte += (1 << fragment);
-			}
-			writer.write8(currentByte);
-		}
-	}
+	else
+		_fragments.writeMap(writer);
 
-	return lastFragment;
+	return _fragmentsMapLast = lastFragment;
 }
 
 void GroupMedia::sendPushRequests() {
@@ -433,12 +551,102 @@ void GroupMedia::sendPushRequests() {
 	_currentPushMask = (!_currentPushMask) ? 1 << (Util::Random<UInt8>() % 8) : ((_currentPushMask == 0x80) ? 1 : _currentPushMask << 1);
 	DEBUG("GroupMedia ", id, " - Push In - Current mask is ", String::Format<UInt8>("%.2x", _currentPushMask))
 
-	// Get the next peer & send the push request
-	if ((_itPushPeer == _mapPeers.end() && RTMFP::GetRandomIt<MAP_PEERS_INFO_TYPE, MAP_PEERS_INFO_ITERATOR_TYPE>(_mapPeers, _itPushPeer, [this](const MAP_PEERS_INFO_ITERATOR_TYPE& it) { return !(it->second->pushInMode & _currentPushMask); }))
-			|| getNextPeer(_itPushPeer, false, 0, _currentPushMask))
-		_itPushPeer->second->sendPushMode(_itPushPeer->second->pushInMode | _currentPushMask);
-	else
+	PushMask& pushMask = _pushMasks[RTMFP::LowestBit(_currentPushMask)];
+	UInt32 pushers(0);
+	for (auto& it : _mapPeers) {
+		if (it.second->pushInMode & _currentPushMask)
+			++pushers;
+	}
+	if (pushers > 1) {
+		DEBUG("GroupMedia ", id, " - Push In - A peer is already tested for mask ", String::Format<UInt8>("%.2x", _currentPushMask))
+		return;
+	}
+
+	// Get the next peer not pushing this mask and not backed off & send the push request
+	Int64 now(Time::Now());
+	auto isAllowed = [this, &pushMask, now](const MAP_PEERS_INFO_ITERATOR_TYPE& it) {
+		if (it->second->pushInMode & _currentPushMask)
+			return false;
+		auto itStats = pushMask.peers.find(it->first);
+		return itStats == pushMask.peers.end() || itStats->second.retry <= now;
+	};
+	bool found(false);
+	if (_itPushPeer == _mapPeers.end())
+		found = RTMFP::GetRandomIt<MAP_PEERS_INFO_TYPE, MAP_PEERS_INFO_ITERATOR_TYPE>(_mapPeers, _itPushPeer, isAllowed);
+	else {
+		for (UInt32 i = 0; i < _mapPeers.size() && !found && getNextPeer(_itPushPeer, false, 0, _currentPushMask); ++i)
+			found = isAllowed(_itPushPeer);
+	}
+	if (!found) {
 		DEBUG("GroupMedia ", id, " - Push In - No new peer available for mask ", String::Format<UInt8>("%.2x", _currentPushMask))
+		return;
+	}
+
+	// The pusher and the tested peer start to count from the same fragment
+	for (auto& itStats : pushMask.peers)
+		itStats.second.first = itStats.second.duplicates = 0;
+	_itPushPeer->second->sendPushMode(_itPushPeer->second->pushInMode | _currentPushMask);
+}
+
+void GroupMedia::updatePushers(PeerMedia& peer, const string& peerId, UInt64 fragmentId, bool duplicate) {
+	UInt8 mask = 1 << (fragmentId % 8);
+	PushMask& pushMask = _pushMasks[fragmentId % 8];
+	PushStats& stats = pushMask.peers[peerId];
+	if (duplicate) {
+		++stats.duplicates;
+		++pushMask.duplicates;
+	}
+	else
+		++stats.first;
+	if (pushMask.pusher.empty())
+		pushMask.pusher = peerId; // first pusher of this mask
+	if ((stats.first + stats.duplicates) < NETGROUP_PUSH_SAMPLES)
+		return;
+
+	if (pushMask.pusher == peerId) {
+		// The pusher is backed off if its fragments are mostly received before (by pull or by the other masks)
+		if (stats.duplicates > stats.first) {
+			DEBUG("GroupMedia ", id, " - Push In - ", stats.duplicates, " duplicates on ", stats.first + stats.duplicates, " fragments from the pusher of mask ", String::Format<UInt8>("%.2x", mask), ", backing off ", peerId)
+			backOffPusher(peer, mask, stats);
+			pushMask.pusher.clear();
+		}
+		stats.first = stats.duplicates = 0;
+		return;
+	}
+
+	// Tested peer : it replaces the pusher if it has delivered more fragments first since the start of the test
+	auto itPusher = _mapPeers.find(pushMask.pusher);
+	PushStats& pusherStats = pushMask.peers[pushMask.pusher];
+	if (itPusher == _mapPeers.end() || IsBetterPusher(stats.first, stats.duplicates, pusherStats.first, pusherStats.duplicates)) {
+		DEBUG("GroupMedia ", id, " - Push In - Updating the pusher of mask ", String::Format<UInt8>("%.2x", mask), " to ", peerId, " (", stats.first, "/", stats.first + stats.duplicates, " received first), last peer was ", pushMask.pusher, " (", pusherStats.first, "/", pusherStats.first + pusherStats.duplicates, ")")
+		if (itPusher != _mapPeers.end())
+			backOffPusher(*itPusher->second, mask, pusherStats);
+		pushMask.pusher = peerId;
+		stats.backoff = 0;
+	}
+	else {
+		TRACE("GroupMedia ", id, " - Push In - Tested pusher is slower than current one, resetting mask ", mask, "...")
+		backOffPusher(peer, mask, stats);
+	}
+	stats.first = stats.duplicates = 0;
+	pusherStats.first = pusherStats.duplicates = 0;
+}
+
+bool GroupMedia::IsBetterPusher(UInt32 first, UInt32 duplicates, UInt32 pusherFirst, UInt32 pusherDuplicates) {
+	if (!pusherFirst && !pusherDuplicates)
+		return true; // the pusher has sent nothing since the start of the test (stalled)
+	if (first != pusherFirst)
+		return first > pusherFirst;
+	return first && duplicates < pusherDuplicates; // same fragments delivered first, the one sending less duplicates is better
+}
+
+void GroupMedia::backOffPusher(PeerMedia& peer, UInt8 mask, PushStats& stats) {
+	if (!stats.backoff)
+		stats.backoff = 8 * NETGROUP_PUSH_DELAY; // one cycle of the masks
+	else if ((stats.backoff *= 2) > NETGROUP_PUSH_BACKOFF_MAX)
+		stats.backoff = NETGROUP_PUSH_BACKOFF_MAX;
+	stats.retry = Time::Now() + stats.backoff;
+	peer.sendPushMode(peer.pushInMode & ~mask);
 }
 
 void GroupMedia::sendPullRequests() {
@@ -454,39 +662,40 @@ void GroupMedia::sendPullRequests() {
 			DEBUG("GroupMedia ", id, " - sendPullRequests - No Fragments map received since Fectch period (", groupParameters->fetchPeriod, "ms), pull paused")
 			_pullPaused = true;
 			if (!_firstPullReceived)
-				onStartProcessing(id); // start processing fragments anyway (to handle peers with pull disabled)
+				onStartProcessing(id, 0); // start processing fragments anyway (to handle peers with pull disabled)
 		}
-		// else we are waiting for fetch period before starting pull requests
+		// else we are waiting for fetch period before starting pull requests (or fast joining)
+		else if (_joining)
+			sendJoinRequests();
 		return;
 	}
+	if (_joining && sendJoinRequests())
+		return;
 	UInt64 lastFragment = (--maxFragment)->second; // get the first fragment < the fetch period
 	
 	// The first pull request get the latest known fragments
 	if (!_currentPullFragment) {
 		_currentPullFragment = (lastFragment > 1)? lastFragment - 1 : 1;
-		auto itRandom1 = _mapPeers.begin();
-		_itPullPeer = _mapPeers.begin();
+		auto itRandom1 = _mapPeers.begin(), itRandom2 = _mapPeers.begin();
 		if (RTMFP::GetRandomIt<MAP_PEERS_INFO_TYPE, MAP_PEERS_INFO_ITERATOR_TYPE>(_mapPeers, itRandom1, [this](const MAP_PEERS_INFO_ITERATOR_TYPE& it) { return it->second->hasFragment(_currentPullFragment); })) {
 			TRACE("GroupMedia ", id, " - sendPullRequests - first fragment found : ", _currentPullFragment)
-			if (_fragments.find(_currentPullFragment) == _fragments.end()) { // ignoring if already received
-				itRandom1->second->sendPull(_currentPullFragment);
-				_mapWaitingFragments.emplace(piecewise_construct, forward_as_tuple(_currentPullFragment), forward_as_tuple());
+			if (!_fragments.has(_currentPullFragment)) { // ignoring if already received
+				sendPull(_currentPullFragment, *itRandom1->second);
 			}
 			else {
 				_firstPullReceived = true;
-				onStartProcessing(id);
+				onStartProcessing(id, 0);
 			}
 		} else
 			TRACE("GroupMedia ", id, " - sendPullRequests - Unable to find the first fragment (", _currentPullFragment, ")")
-		if (RTMFP::GetRandomIt<MAP_PEERS_INFO_TYPE, MAP_PEERS_INFO_ITERATOR_TYPE>(_mapPeers, _itPullPeer, [this](const MAP_PEERS_INFO_ITERATOR_TYPE& it) { return it->second->hasFragment(_currentPullFragment + 1); })) {
+		if (RTMFP::GetRandomIt<MAP_PEERS_INFO_TYPE, MAP_PEERS_INFO_ITERATOR_TYPE>(_mapPeers, itRandom2, [this](const MAP_PEERS_INFO_ITERATOR_TYPE& it) { return it->second->hasFragment(_currentPullFragment + 1); })) {
 			TRACE("GroupMedia ", id, " - sendPullRequests - second fragment found : ", _currentPullFragment + 1)
-			if (_fragments.find(++_currentPullFragment) == _fragments.end()) { // ignoring if already received
-				_itPullPeer->second->sendPull(_currentPullFragment);
-				_mapWaitingFragments.emplace(piecewise_construct, forward_as_tuple(_currentPullFragment), forward_as_tuple());
+			if (!_fragments.has(++_currentPullFragment)) { // ignoring if already received
+				sendPull(_currentPullFragment, *itRandom2->second);
 			}
 			else {
 				_firstPullReceived = true;
-				onStartProcessing(id);
+				onStartProcessing(id, 0);
 			}
 			return;
 		}
@@ -495,51 +704,124 @@ void GroupMedia::sendPullRequests() {
 		return;
 	}
 
-	// Loop on older fragments to send back the requests
-	timeMax -= groupParameters->fetchPeriod;
-	maxFragment = _mapPullTime2Fragment.lower_bound(timeMax);
-	if (maxFragment != _mapPullTime2Fragment.begin() && maxFragment != _mapPullTime2Fragment.end()) {
-		UInt64 lastOldFragment = (--maxFragment)->second; // get the first fragment < the fetch period * 2
-		for (auto itPull = _mapWaitingFragments.begin(); itPull != _mapWaitingFragments.end() && itPull->first <= lastOldFragment; itPull++) {
+	// Send back the timed out requests (or requests of removed peers) to another peer
+	resendPullRequests();
 
-			// Fetch period elapsed? => blacklist the peer and send back the request to another peer
-			if (itPull->second.isElapsed(groupParameters->fetchPeriod)) {
-				DEBUG("GroupMedia ", id, " - sendPullRequests - ", groupParameters->fetchPeriod, "ms without receiving fragment ", itPull->first, " retrying...")
-				
-				if (sendPullToNextPeer(itPull->first))
-					itPull->second = timeNow;
+	// Find the holes (the fragments present are skipped by words) until the first fragment not available
+	// and count the peers having each one, in the limit of the requests that the peers can receive
+	UInt32 available(0);
+	for (auto& it : _mapPeers) {
+		if (it.second->pullsWaiting < NETGROUP_PULL_PEER_LIMIT)
+			available += NETGROUP_PULL_PEER_LIMIT - it.second->pullsWaiting;
+	}
+	vector<pair<UInt32, UInt64>> holes; // number of peers having the fragment, fragment id
+	UInt64 current(_currentPullFragment);
+	while (current < lastFragment && holes.size() < available) {
+		UInt64 missing = _fragments.nextMissing(current + 1);
+		if (missing > lastFragment) {
+			current = lastFragment;
+			break;
+		}
+		if (_mapWaitingFragments.find(missing) == _mapWaitingFragments.end()) {
+			UInt32 owners(0);
+			for (auto& it : _mapPeers) {
+				if (it.second->hasFragment(missing))
+					++owners;
+			}
+			if (!owners) {
+				DEBUG("GroupMedia ", id, " - sendPullRequests - No peer found for fragment ", missing)
+				break; // we wait for the fragment to be available
 			}
+			holes.emplace_back(owners, missing);
 		}
+		current = missing;
 	}
 
-	// Find the holes and send pull requests
-	for (; _currentPullFragment < lastFragment; _currentPullFragment++) {
+	// Send the requests of the rarest fragments first (in order for the same number of peers)
+	stable_sort(holes.begin(), holes.end(), [](const pair<UInt32, UInt64>& hole1, const pair<UInt32, UInt64>& hole2) { return hole1.first < hole2.first; });
+	UInt64 blocked(0); // first fragment not requested (its peers are at their pull limit)
+	for (auto& hole : holes) {
+		if (!sendPullToBestPeer(hole.second) && (!blocked || hole.second < blocked))
+			blocked = hole.second;
+	}
+	_currentPullFragment = blocked ? blocked - 1 : current;
 
-		if (_fragments.find(_currentPullFragment + 1) == _fragments.end()) {
-			if (!sendPullToNextPeer(_currentPullFragment + 1))
-				break; // we wait for the fragment to be available
-			_mapWaitingFragments.emplace(piecewise_construct, forward_as_tuple(_currentPullFragment + 1), forward_as_tuple());
-		}
+	// Is there a pull congestion? (no request answered since NETGROUP_PULL_TIMEOUT)
+	if (!groupParameters->disablePullTimeout && !_mapWaitingFragments.empty() && _lastPullAnswer.isElapsed(NETGROUP_PULL_TIMEOUT)) {
+		INFO("GroupMedia ", id, " - No pull request answered since ", NETGROUP_PULL_TIMEOUT, "ms (", _mapWaitingFragments.size(), " waiting)")
+		onPullTimeout(id); // close the session
 	}
 
-	// Is there a pull congestion?
-	if (!groupParameters->disablePullTimeout) {
+	DEBUG("GroupMedia ", id, " - sendPullRequests - Pull requests done : ", _mapWaitingFragments.size(), " waiting fragments (current : ", _currentPullFragment, "; last Fragment : ", lastFragment, ")")
+}
 
-		if (_mapWaitingFragments.size() > NETGROUP_PULL_LIMIT) {
+bool GroupMedia::sendJoinRequests() {
 
-			if (!_pullLimitReached) {
-				_pullLimitReached = true;
-				_pullTimeout = timeNow;
-				INFO("GroupMedia ", id, " - There is more than ", NETGROUP_PULL_LIMIT," pull requests, pull timeout started")
+	// Fetch period elapsed since the first fragments map : the normal pull requests start after the fragments received
+	if ((Time::Now() - _mapPullTime2Fragment.begin()->first) > groupParameters->fetchPeriod) {
+		_joining = false;
+		if (_joinAnchor)
+			return false;
+		DEBUG("GroupMedia ", id, " - Fast join - No video codec infos found", _joinFragment ? ", reading from the first fragment" : "")
+		if (_joinFragment) {
+			_currentPullFragment = _joinFragment - 1;
+			if (!_firstPullReceived) {
+				_firstPullReceived = true;
+				onStartProcessing(id, 0);
 			}
-			else if (RTMFP::IsElapsed(_pullTimeout, timeNow, NETGROUP_PULL_TIMEOUT))
-				onPullTimeout(id); // close the session
 		}
-		else if (_pullLimitReached)
-			_pullLimitReached = false;
+		return false;
 	}
 
-	DEBUG("GroupMedia ", id, " - sendPullRequests - Pull requests done : ", _mapWaitingFragments.size(), " waiting fragments (current : ", _currentPullFragment, "; last Fragment : ", lastFragment, ")")
+	UInt64 lastFragment(_lastFragmentMapId);
+	if (!_joinFragment)
+		_joinFragment = lastFragment + 1;
+
+	// Pull back a new batch of older fragments when the previous one is answered, in the limit of the fragments available
+	if (!_joinAnchor && _joinFragment > 1) {
+		auto itWait = _mapWaitingFragments.lower_bound(_joinFragment);
+		if (itWait == _mapWaitingFragments.end() || itWait->first >= _joinFragment + NETGROUP_JOIN_BATCH) {
+			UInt64 first = (_joinFragment > NETGROUP_JOIN_BATCH) ? _joinFragment - NETGROUP_JOIN_BATCH : 1;
+			while (first < _joinFragment) {
+				bool available(false);
+				for (auto& it : _mapPeers) {
+					if ((available = it.second->hasFragment(first)))
+						break;
+				}
+				if (available)
+					break;
+				++first; // too old for the peers
+			}
+			if (first < _joinFragment)
+				DEBUG("GroupMedia ", id, " - Fast join - Pulling fragments ", first, " to ", _joinFragment - 1)
+			_joinFragment = first;
+		}
+	}
+
+	// Send back the timed out requests and pull the missing fragments from the codec infos (or the first fragment pulled) to the last one
+	resendPullRequests();
+	UInt64 current(_joinAnchor ? _joinAnchor : _joinFragment);
+	for (UInt64 missing = _fragments.nextMissing(current); missing <= lastFragment; missing = _fragments.nextMissing(missing + 1)) {
+		if (_mapWaitingFragments.find(missing) == _mapWaitingFragments.end())
+			sendPullToBestPeer(missing);
+	}
+	return true;
+}
+
+void GroupMedia::resendPullRequests() {
+
+	for (auto& itPull : _mapWaitingFragments) {
+		PullRequest& request = itPull.second;
+		if (request.pPeer && !request.time.isElapsed(request.timeout))
+			continue;
+		DEBUG("GroupMedia ", id, " - sendPullRequests - ", request.timeout, "ms without receiving fragment ", itPull.first, " (", request.tries, " tries), retrying...")
+		PeerMedia* pPeer(request.pPeer);
+		if (pPeer) {
+			pPeer->pullTimedOut();
+			request.pPeer = NULL;
+		}
+		sendPullToBestPeer(itPull.first, pPeer);
+	}
 }
 
 void GroupMedia::sendFragmentsMap() {
@@ -559,17 +841,48 @@ void GroupMedia::sendFragmentsMap() {
 	}
 }
 
-bool GroupMedia::sendPullToNextPeer(UInt64 idFragment) {
-
-	if (!getNextPeer(_itPullPeer, true, idFragment, 0)) {
-		DEBUG("GroupMedia ", id, " - sendPullRequests - No peer found for fragment ", idFragment)
+bool GroupMedia::sendPullToBestPeer(UInt64 idFragment, PeerMedia* pExcluded) {
+
+	PeerMedia* pBest(NULL);
+	double bestCost(0);
+	for (auto& it : _mapPeers) {
+		PeerMedia& peer = *it.second;
+		if (&peer == pExcluded || peer.pullsWaiting >= NETGROUP_PULL_PEER_LIMIT || !peer.hasFragment(idFragment))
+			continue;
+		double cost(peer.pullCost());
+		if (!pBest || cost < bestCost) {
+			pBest = &peer;
+			bestCost = cost;
+		}
+	}
+	if (!pBest && pExcluded && pExcluded->pullsWaiting < NETGROUP_PULL_PEER_LIMIT && pExcluded->hasFragment(idFragment))
+		pBest = pExcluded; // no other peer, we try again with the same one
+	if (!pBest) {
+		DEBUG("GroupMedia ", id, " - sendPullRequests - No peer available for fragment ", idFragment)
 		return false;
 	}
-	
-	_itPullPeer->second->sendPull(idFragment);
+	sendPull(idFragment, *pBest);
 	return true;
 }
 
+void GroupMedia::sendPull(UInt64 idFragment, PeerMedia& peer) {
+	if (_mapWaitingFragments.empty())
+		_lastPullAnswer.update(); // start the pull congestion count
+
+	PullRequest& request = _mapWaitingFragments[idFragment];
+	peer.sendPull(idFragment);
+	request.pPeer = &peer;
+	request.time.update();
+
+	// Timeout from the expected delay of the peer, doubled at each try and limited to the fetch period
+	UInt32 timeout = 4 * peer.pullDelay();
+	if (timeout < NETGROUP_PULL_MIN_TIMEOUT)
+		timeout = NETGROUP_PULL_MIN_TIMEOUT;
+	timeout <<= (request.tries < 4) ? request.tries : 4;
+	request.timeout = (timeout < groupParameters->fetchPeriod) ? timeout : groupParameters->fetchPeriod;
+	++request.tries;
+}
+
 void GroupMedia::removePeer(const string& peerId) {
 	
 	auto itPeer = _mapPeers.find(peerId);
@@ -595,9 +908,13 @@ void GroupMedia::removePeer(MAP_PEERS_INFO_ITERATOR_TYPE itPeer) {
 		}
 	}
 
+	// Its pull requests will be sent back to another peer
+	for (auto& itPull : _mapWaitingFragments) {
+		if (itPull.second.pPeer == itPeer->second.get())
+			itPull.second.pPeer = NULL;
+	}
+
 	// If it is a current peer => increment
-	if (itPeer == _itPullPeer && getNextPeer(_itPullPeer, true, 0, 0) && itPeer == _itPullPeer)
-		_itPullPeer = _mapPeers.end(); // to avoid bad pointer
 	if (itPeer == _itPushPeer && getNextPeer(_itPushPeer, false, 0, 0) && itPeer == _itPushPeer)
 		_itPushPeer = _mapPeers.end(); // to avoid bad pointer
 	if (itPeer == _itFragmentsPeer && getNextPeer(_itFragmentsPeer, false, 0, 0) && itPeer == _itFragmentsPeer)
@@ -620,18 +937,45 @@ void GroupMedia::callFunction(const string& function, queue<string>& arguments)
 		arguments.pop();
 	}
 
-	UInt32 currentTime = (_fragments.empty())? 0 : _fragments.rbegin()->second->time;
+	UInt32 currentTime = (_fragments.empty())? 0 : _fragments.get(_fragments.last())->time;
 
 	// Create and send the fragment
 	TRACE("Creating fragment for function ", function, "...")
 	onMedia(true, AMF::TYPE_DATA_AMF3, currentTime, Packet(pBuffer));
 }
 
+void GroupMedia::updateStats(RTMFP::StreamStats& stats) {
+	UInt32 pushers(0);
+	for (PushMask& pushMask : _pushMasks) {
+		if (!pushMask.pusher.empty())
+			++pushers;
+	}
+	stats.groupPeers.store(_mapPeers.size(), memory_order_relaxed);
+	stats.groupFragments.store(_fragments.size(), memory_order_relaxed);
+	stats.groupPullsWaiting.store(_mapWaitingFragments.size(), memory_order_relaxed);
+	stats.groupPushers.store(pushers, memory_order_relaxed);
+	stats.groupFragmentsIn.store(_fragmentsIn, memory_order_relaxed);
+	stats.groupDuplicatesIn.store(_duplicatesIn, memory_order_relaxed);
+	stats.groupDuplicateBytesIn.store(_duplicateBytesIn, memory_order_relaxed);
+}
+
 void GroupMedia::printStats() {
-	INFO("Fragments : ", _fragments.size(), " ; Times : ", _mapTime2Fragment.size(), " ; peers : ", _mapPeers.size(), " ; masks : ", _mapPushMasks.size(), " ; waiting : ", _mapWaitingFragments.size())
+	UInt8 masks(0);
+	for (PushMask& pushMask : _pushMasks) {
+		if (!pushMask.pusher.empty())
+			++masks;
+	}
+	INFO("Fragments : ", _fragments.size(), " ; Capacity : ", _fragments.capacity(), " ; peers : ", _mapPeers.size(), " ; masks : ", masks, " ; waiting : ", _mapWaitingFragments.size(),
+		" ; duplicates : ", _duplicatesIn, "/", _fragmentsIn, " (", _duplicateBytesIn, " bytes)")
 
 #if defined(_DEBUG)
-	for (auto& itMask : _mapPushMasks)
-		DEBUG("Push In mask ", itMask.first, " peer : ", itMask.second.first, " ; id : ", itMask.second.second)
+	for (UInt8 i = 0; i < 8; ++i) {
+		if (!_pushMasks[i].pusher.empty())
+			DEBUG("Push In mask ", 1 << i, " peer : ", _pushMasks[i].pusher, " ; tested : ", _pushMasks[i].peers.size(), " ; duplicates : ", _pushMasks[i].duplicates)
+	}
+	for (auto& itPeer : _mapPeers) {
+		if (itPeer.second->duplicatesIn)
+			DEBUG("Peer ", itPeer.first, " duplicates : ", itPeer.second->duplicatesIn, "/", itPeer.second->fragmentsIn, " (", itPeer.second->duplicateBytesIn, " bytes)")
+	}
 #endif
 }
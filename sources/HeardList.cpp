@@ -0,0 +1,303 @@
+/*
+Copyright 2016 Thomas Jammet
+mathieu.poux[a]gmail.com
+jammetthomas[a]gmail.com
+
+This file is part of Librtmfp.
+
+Librtmfp is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Librtmfp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HeardList.h"
+#include "Base/Logs.h"
+
+using namespace Base;
+using namespace std;
+
+RTMFP::AddressType HeardList::Address::type() const {
+
+	// Wildcard address?
+	UInt8 i = 1, end = size();
+	while (i < end && !data[i])
+		++i;
+	return (i == end) ? RTMFP::ADDRESS_UNSPECIFIED : RTMFP::AddressType(data[0] & 0x7F);
+}
+
+bool HeardList::Address::read(BinaryReader& reader) {
+	if (!reader.available())
+		return false;
+
+	UInt8 size = (*reader.current() & 0x80) ? 19 : 7;
+	if (reader.available() < size) {
+		WARN("Address truncated in Group Report (", reader.available(), " bytes available, expected ", size, ")")
+		reader.next(reader.available());
+		return false;
+	}
+	reader.read(size, data);
+	return true;
+}
+
+void HeardList::Address::set(const SocketAddress& address, RTMFP::AddressType type) {
+
+	BinaryWriter writer(data, sizeof(data));
+	RTMFP::WriteAddress(writer, address, type);
+}
+
+SocketAddress& HeardList::Address::get(SocketAddress& address) const {
+
+	BinaryReader reader(data, size());
+	RTMFP::ReadAddress(reader, address);
+	return address;
+}
+
+bool HeardList::Peer::addAddress(const Address& address) {
+	if (addressesCount >= RTMFP_MAX_ADDRESSES)
+		return false; // max size reached
+
+	for (UInt8 i = 0; i < addressesCount; ++i) {
+		if (addresses[i] == address)
+			return false;
+	}
+	addresses[addressesCount++] = address;
+	++version;
+	return true;
+}
+
+bool HeardList::Peer::addAddress(const SocketAddress& address, RTMFP::AddressType type) {
+
+	Address newAddress;
+	newAddress.set(address, type);
+	return addAddress(newAddress);
+}
+
+void HeardList::Peer::setHostAddress(const SocketAddress& address) {
+
+	Address newAddress;
+	if (address)
+		newAddress.set(address, RTMFP::ADDRESS_REDIRECTION);
+	if (newAddress.empty() ? hostAddress.empty() : (!hostAddress.empty() && hostAddress == newAddress))
+		return;
+	hostAddress = newAddress;
+	++version;
+}
+
+void HeardList::Peer::readAddresses(BinaryReader& reader, const function<void(const SocketAddress&, RTMFP::AddressType)>& onNewAddress) {
+
+	// Same rules as RTMFP::ReadAddresses, without creating the addresses already known
+	Address address;
+	SocketAddress socketAddress;
+	while (address.read(reader)) {
+
+		RTMFP::AddressType addressType = address.type();
+		switch (addressType & 0x0F) {
+		case RTMFP::ADDRESS_LOCAL:
+		case RTMFP::ADDRESS_PUBLIC:
+			if (addAddress(address) && onNewAddress)
+				onNewAddress(address.get(socketAddress), addressType);
+			break;
+		case RTMFP::ADDRESS_REDIRECTION:
+			if (hostAddress.empty() || hostAddress != address) { // new address?
+				hostAddress = address;
+				hostAddress.data[0] = (address.data[0] & 0x80) | RTMFP::ADDRESS_REDIRECTION;
+				++version;
+				if (onNewAddress)
+					onNewAddress(address.get(socketAddress), addressType);
+			}
+			break;
+		case RTMFP::ADDRESS_UNSPECIFIED:
+			if (onNewAddress)
+				onNewAddress(address.get(socketAddress), addressType);
+			break;
+		}
+		TRACE("IP Address : ", address.get(socketAddress), " - type : ", addressType)
+	}
+}
+
+void HeardList::Peer::writeAddresses(BinaryWriter& writer) const {
+
+	UInt32 size = 1; // 1 for 0A header
+	if (!hostAddress.empty())
+		size += hostAddress.size();
+	for (UInt8 i = 0; i < addressesCount; ++i)
+		size += addresses[i].size();
+
+	writer.write7Bit<UInt64>(size);
+	writer.write8(0x0A);
+	if (!hostAddress.empty())
+		hostAddress.write(writer);
+	for (UInt8 i = 0; i < addressesCount; ++i)
+		addresses[i].write(writer);
+}
+
+void HeardList::Peer::getAddresses(PEER_LIST_ADDRESS_TYPE& addresses, SocketAddress& host) const {
+
+	SocketAddress address;
+	if (!hostAddress.empty())
+		hostAddress.get(host);
+	for (UInt8 i = 0; i < addressesCount; ++i)
+		addresses.emplace(this->addresses[i].get(address), this->addresses[i].type());
+}
+
+HeardList::HeardList() : _index(HEARDLIST_MIN_CAPACITY, 0), _count(0) {
+}
+
+UInt32 HeardList::position(const UInt8* id) const {
+
+	// The peer ID is a sha256, its first bytes are already well distributed
+	UInt32 hash;
+	memcpy(&hash, id, sizeof(hash));
+	return hash & (_index.size() - 1);
+}
+
+HeardList::Peer* HeardList::find(const UInt8* id) {
+
+	UInt32 mask = _index.size() - 1;
+	for (UInt32 i = position(id); _index[i]; i = (i + 1) & mask) {
+		Peer& peer = _peers[_index[i] - 1];
+		if (memcmp(peer.id(), id, PEER_ID_SIZE) == 0)
+			return &peer;
+	}
+	return NULL;
+}
+
+HeardList::Peer* HeardList::find(const string& peerId) {
+	if (peerId.size() != PEER_ID_SIZE * 2)
+		return NULL;
+
+	string id;
+	return find(BIN String::ToHex(peerId, id).data());
+}
+
+HeardList::Peer& HeardList::add(const char* rawId, Int64 lastGroupReport) {
+
+	// Keep the hash index half empty
+	if ((_count + 1) * 2 > _index.size())
+		rehash(_index.size() * 2);
+
+	UInt32 slot;
+	if (_freeSlots.empty()) {
+		slot = _peers.size();
+		_peers.emplace_back();
+	}
+	else {
+		slot = _freeSlots.back();
+		_freeSlots.pop_back();
+	}
+	Peer& peer = _peers[slot];
+	memcpy(peer.rawId, rawId, PEER_ID_SIZE + 2);
+	peer.hostAddress.clear();
+	peer.addressesCount = peer.version = 0;
+	peer.died = false;
+	peer.lastGroupReport = lastGroupReport;
+	peer._slot = slot;
+
+	UInt32 mask = _index.size() - 1, i = position(peer.id());
+	while (_index[i])
+		i = (i + 1) & mask;
+	_index[i] = slot + 1;
+
+	peer._expiration = _expirations.size();
+	_expirations.emplace_back(slot);
+	siftUp(peer._expiration);
+
+	++_count;
+	return peer;
+}
+
+void HeardList::remove(Peer& peer) {
+
+	// Remove from the hash index, the next peers are moved back if the hole is on their probe sequence
+	UInt32 mask = _index.size() - 1, hole = position(peer.id());
+	while (_index[hole] != peer._slot + 1)
+		hole = (hole + 1) & mask;
+	for (UInt32 i = (hole + 1) & mask; _index[i]; i = (i + 1) & mask) {
+		UInt32 start = position(_peers[_index[i] - 1].id());
+		if (((i - start) & mask) >= ((i - hole) & mask)) {
+			_index[hole] = _index[i];
+			hole = i;
+		}
+	}
+	_index[hole] = 0;
+
+	// Remove from the expiration heap
+	UInt32 last = _expirations.back();
+	_expirations.pop_back();
+	if (last != peer._slot) {
+		_expirations[peer._expiration] = last;
+		_peers[last]._expiration = peer._expiration;
+		siftUp(peer._expiration);
+		siftDown(_peers[last]._expiration);
+	}
+
+	_freeSlots.emplace_back(peer._slot);
+	--_count;
+}
+
+void HeardList::update(Peer& peer, Int64 lastGroupReport) {
+
+	bool older = lastGroupReport < peer.lastGroupReport;
+	peer.lastGroupReport = lastGroupReport;
+	if (older)
+		siftUp(peer._expiration);
+	else
+		siftDown(peer._expiration);
+}
+
+void HeardList::rehash(UInt32 capacity) {
+
+	vector<UInt32> index(move(_index));
+	_index.assign(capacity, 0);
+	UInt32 mask = capacity - 1;
+	for (UInt32 slot : index) {
+		if (!slot)
+			continue;
+		UInt32 i = position(_peers[slot - 1].id());
+		while (_index[i])
+			i = (i + 1) & mask;
+		_index[i] = slot;
+	}
+}
+
+void HeardList::siftUp(UInt32 position) {
+
+	UInt32 slot = _expirations[position];
+	Int64 time = _peers[slot].lastGroupReport;
+	while (position) {
+		UInt32 parent = (position - 1) / 2;
+		if (_peers[_expirations[parent]].lastGroupReport <= time)
+			break;
+		_expirations[position] = _expirations[parent];
+		_peers[_expirations[position]]._expiration = position;
+		position = parent;
+	}
+	_expirations[position] = slot;
+	_peers[slot]._expiration = position;
+}
+
+void HeardList::siftDown(UInt32 position) {
+
+	UInt32 slot = _expirations[position], size = _expirations.size();
+	Int64 time = _peers[slot].lastGroupReport;
+	for (UInt32 child = 2 * position + 1; child < size; child = 2 * position + 1) {
+		if (child + 1 < size && _peers[_expirations[child + 1]].lastGroupReport < _peers[_expirations[child]].lastGroupReport)
+			++child;
+		if (time <= _peers[_expirations[child]].lastGroupReport)
+			break;
+		_expirations[position] = _expirations[child];
+		_peers[_expirations[position]]._expiration = position;
+		position = child;
+	}
+	_expirations[position] = slot;
+	_peers[slot]._expiration = position;
+}
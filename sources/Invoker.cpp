@@ -112,7 +112,7 @@ struct Invoker::ConnectionBuffer : virtual Object {
 
 	// Media stream buffer
 	struct MediaBuffer : virtual Object {
-		MediaBuffer() : firstRead(true), codecInfosRead(false), AACsequenceHeaderRead(false), timeOffset(0) {}
+		MediaBuffer() : firstRead(true), codecInfosRead(false), AACsequenceHeaderRead(false), timeOffset(0), size(0) {}
 
 		// Packet structure
 		struct RTMFPMediaPacket : Packet, virtual Object {
@@ -121,15 +121,31 @@ struct Invoker::ConnectionBuffer : virtual Object {
 			UInt32		time;
 			AMF::Type	type;
 			UInt32		pos;
+#if defined(LIBRTMFP_HISTOGRAMS)
+			const Int64	origin = RTMFP::Origin; // reception time of the packet (in usec)
+#endif
 		};
 		deque<RTMFPMediaPacket>					mediaPackets;
 		bool									firstRead;
 		bool									codecInfosRead; // Player : False until the video codec infos have been read
 		bool									AACsequenceHeaderRead; // False until the AAC sequence header infos have been read
 		UInt32									timeOffset; // time offset used when a fallback connection has started
+		UInt64									size; // size of the media packets waiting to be read
+		shared<RTMFP::StreamStats>				pStats; // statistics of the stream (can be null if the connection is removed)
+
+		// Update the read queue statistics
+		void									updateStats() {
+			if (!pStats)
+				return;
+			pStats->readQueue.store(size, memory_order_relaxed);
+			pStats->readPackets.store((UInt32)mediaPackets.size(), memory_order_relaxed);
+		}
 	};
 	map<UInt16, MediaBuffer>					mapMedias; // Map of media players
 	UInt16										mediaCount; // Counter of media streams (publisher/player) id
+#if defined(LIBRTMFP_HISTOGRAMS)
+	shared<RTMFP::Stats>						pStats; // statistics of the connection (latency histograms)
+#endif
 };
 
 // Writing Connection buffer structure, contains current packet buffer from 1 session
@@ -153,22 +169,34 @@ Invoker::Invoker(void(*onLog)(unsigned int, const char*, long, const char*), voi
 		lock_guard<mutex> lock(_mutexConnections);
 
 		auto it = _mapConnections.find(packet.index);
-		if (it != _mapConnections.end() && it->second->status < RTMFP::NEAR_CLOSED)
+		if (it != _mapConnections.end() && it->second->status < RTMFP::NEAR_CLOSED) {
+			HISTOGRAM_ADD(*it->second->stats(), HISTOGRAM_WRITE, packet.origin, RTMFP::MicroNow())
+			HISTOGRAM_WRITE_ORIGIN(packet.origin)
 			it->second->writeAudio(packet, packet.time);
+			HISTOGRAM_WRITE_ORIGIN(0)
+		}
 	};
 	onPushVideo = [this](WritePacket& packet) {
 		lock_guard<mutex> lock(_mutexConnections);
 
 		auto it = _mapConnections.find(packet.index);
-		if (it != _mapConnections.end() && it->second->status < RTMFP::NEAR_CLOSED)
+		if (it != _mapConnections.end() && it->second->status < RTMFP::NEAR_CLOSED) {
+			HISTOGRAM_ADD(*it->second->stats(), HISTOGRAM_WRITE, packet.origin, RTMFP::MicroNow())
+			HISTOGRAM_WRITE_ORIGIN(packet.origin)
 			it->second->writeVideo(packet, packet.time);
+			HISTOGRAM_WRITE_ORIGIN(0)
+		}
 	};
 	onPushData = [this](WritePacket& packet) {
 		lock_guard<mutex> lock(_mutexConnections);
 
 		auto it = _mapConnections.find(packet.index);
-		if (it != _mapConnections.end() && it->second->status < RTMFP::NEAR_CLOSED)
+		if (it != _mapConnections.end() && it->second->status < RTMFP::NEAR_CLOSED) {
+			HISTOGRAM_ADD(*it->second->stats(), HISTOGRAM_WRITE, packet.origin, RTMFP::MicroNow())
+			HISTOGRAM_WRITE_ORIGIN(packet.origin)
 			it->second->writeData(packet, packet.time);
+			HISTOGRAM_WRITE_ORIGIN(0)
+		}
 	};
 	onFlushPublisher = [this](const WriteFlush& obj) {
 		lock_guard<mutex> lock(_mutexConnections);
@@ -273,7 +301,11 @@ Invoker::Invoker(void(*onLog)(unsigned int, const char*, long, const char*), voi
 
 		auto itConn = _mapConnections.find(decoded.idConnection);
 		if (itConn != _mapConnections.end()) {
+			HISTOGRAM_ADD(*itConn->second->stats(), HISTOGRAM_DECODE, decoded.origin, decoded.decodeTime)
+			HISTOGRAM_ORIGIN(decoded.origin) // read by the next stages
+			HISTOGRAM(*itConn->second->stats(), HISTOGRAM_DEQUEUE)
 			itConn->second->receive(decoded);
+			HISTOGRAM_ORIGIN(0)
 		} else
 			DEBUG("RTMFPDecoder callback without connection, possibly deleted")
 	};
@@ -490,6 +522,12 @@ void Invoker::removeConnection(map<int, shared<RTMFPSession>>::iterator it, bool
 		_connection2Buffer.erase(id);
 	}
 
+	// Erase the statistics
+	{
+		lock_guard<mutex> lock(_mutexStats);
+		_mapStats.erase(id);
+	}
+
 	// Erase possible writing buffer
 	{
 		lock_guard<mutex> lock(_mutexWrite);
@@ -518,6 +556,8 @@ UInt32 Invoker::connect(const char* url, RTMFPConfig* parameters) {
 			_waitSignal.set(); // release from waiting function
 		};
 		_mapConnections.emplace(idConn, pConn);
+		lock_guard<mutex> lockStats(_mutexStats);
+		_mapStats.emplace(idConn, pConn->stats());
 	}
 
 	_handler.queue(onConnect, idConn, url, host, address, addresses, rawUrl);
@@ -538,7 +578,15 @@ UInt16 Invoker::createMediaBuffer(UInt32 RTMFPcontext, function<bool(UInt16)> co
 		return 0;
 
 	// Add the media buffer
-	connBuffer.mapMedias.emplace(piecewise_construct, forward_as_tuple(++connBuffer.mediaCount), forward_as_tuple());
+	ConnectionBuffer::MediaBuffer& mediaBuffer = connBuffer.mapMedias.emplace(piecewise_construct, forward_as_tuple(++connBuffer.mediaCount), forward_as_tuple()).first->second;
+	lock_guard<mutex> lockStats(_mutexStats);
+	auto itStats = _mapStats.find(RTMFPcontext);
+	if (itStats != _mapStats.end()) {
+		mediaBuffer.pStats = itStats->second->stream(connBuffer.mediaCount);
+#if defined(LIBRTMFP_HISTOGRAMS)
+		connBuffer.pStats = itStats->second;
+#endif
+	}
 	return connBuffer.mediaCount;
 }
 
@@ -594,8 +642,11 @@ void Invoker::startFallback(FallbackConnection& fallback) {
 	};
 
 	// Connect & add the fallback connection to map of connections
-	if (pConn->connect(fallback.url.c_str(), fallback.host, fallback.address, fallback.addresses, fallback.rawUrl))
+	if (pConn->connect(fallback.url.c_str(), fallback.host, fallback.address, fallback.addresses, fallback.rawUrl)) {
 		_mapConnections.emplace(fallback.idFallback, pConn); // Note: mutex is already locked here
+		lock_guard<mutex> lockStats(_mutexStats);
+		_mapStats.emplace(fallback.idFallback, pConn->stats());
+	}
 }
 
 int Invoker::connect2Group(UInt32 RTMFPcontext, const char* streamName, RTMFPConfig* parameters, RTMFPGroupConfig* groupParameters, bool audioReliable, bool videoReliable, const char* fallbackUrl) {
@@ -827,6 +878,7 @@ int Invoker::write(unsigned int RTMFPcontext, const UInt8* data, UInt32 size) {
 			WARN("Invoker::write() - Unexpected previous size found for session ", RTMFPcontext, " : ", previousSize, ", expected : ", writeBuffer.buffer->size() + 11)
 
 		// Packet complete, send it to the session
+		HISTOGRAM_ORIGIN(HISTOGRAM_NOW()) // origin time of the packet for the latency histograms
 		if (writeBuffer.type == AMF::TYPE_AUDIO)
 			_handler.queue(onPushAudio, RTMFPcontext, Packet(writeBuffer.buffer), writeBuffer.time, AMF::TYPE_AUDIO);
 		else if (writeBuffer.type == AMF::TYPE_VIDEO)
@@ -835,6 +887,7 @@ int Invoker::write(unsigned int RTMFPcontext, const UInt8* data, UInt32 size) {
 			_handler.queue(onPushData, RTMFPcontext, Packet(writeBuffer.buffer), writeBuffer.time, AMF::TYPE_DATA);
 		else
 			WARN("Invoker::write() - Unhandled packet type : ", writeBuffer.type)
+		HISTOGRAM_ORIGIN(0)
 		
 		writeBuffer.writer.reset(); writeBuffer.buffer.reset();
 	}
@@ -906,8 +959,14 @@ int Invoker::read(UInt32 RTMFPcontext, UInt16 mediaId, UInt8* buf, UInt32 size)
 					break;
 				}
 				writer.write32(11 + packet.size()); // footer, size on 4 bytes
+#if defined(LIBRTMFP_HISTOGRAMS)
+				if (itBuffer->second.pStats)
+					HISTOGRAM_ADD(*itBuffer->second.pStats, HISTOGRAM_READ, packet.origin, RTMFP::MicroNow())
+#endif
+				itMedia->second.size -= packet.size();
 				itMedia->second.mediaPackets.pop_front();
 			}
+			itMedia->second.updateStats();
 			// Finally update the nbRead & available
 			nbRead += writer.size();
 			_mutexRead.unlock();
@@ -1012,10 +1071,113 @@ void Invoker::bufferizeMedia(UInt32 RTMFPcontext, UInt16 mediaId, UInt32 time, c
 		}
 
 		itMedia->second.mediaPackets.emplace_back(packet, time + itMedia->second.timeOffset, type);
+		itMedia->second.size += packet.size();
+		itMedia->second.updateStats();
+#if defined(LIBRTMFP_HISTOGRAMS)
+		if (itBuffer->second.pStats)
+			HISTOGRAM(*itBuffer->second.pStats, HISTOGRAM_BUFFER)
+#endif
 		_waitSignal.set(); // signal that data is available
 	}
 }
 
+UInt64 Invoker::readQueueSize(UInt32 RTMFPcontext) {
+	lock_guard<mutex> lock(_mutexRead);
+	auto itBuffer = _connection2Buffer.find(RTMFPcontext);
+	if (itBuffer == _connection2Buffer.end())
+		return 0;
+
+	UInt64 size(0);
+	for (auto& itMedia : itBuffer->second.mapMedias)
+		size += itMedia.second.size;
+	return size;
+}
+
+bool Invoker::getStats(UInt32 RTMFPcontext, RTMFPStats& stats) {
+	shared<RTMFP::Stats> pStats;
+	{
+		lock_guard<mutex> lock(_mutexStats);
+		auto itStats = _mapStats.find(RTMFPcontext);
+		if (itStats == _mapStats.end())
+			return false;
+		pStats = itStats->second;
+	}
+
+	stats.bytesSent = pStats->bytesSent.load(memory_order_relaxed);
+	stats.packetsSent = pStats->packetsSent.load(memory_order_relaxed);
+	stats.bytesReceived = pStats->bytesReceived.load(memory_order_relaxed);
+	stats.packetsReceived = pStats->packetsReceived.load(memory_order_relaxed);
+	stats.retransmissions = pStats->retransmissions.load(memory_order_relaxed);
+	stats.abandons = pStats->abandons.load(memory_order_relaxed);
+	stats.drops = pStats->drops.load(memory_order_relaxed);
+	stats.sendLostRate = pStats->sendLostRate.load(memory_order_relaxed);
+	stats.sendByteRate = pStats->sendByteRate.load(memory_order_relaxed);
+	stats.srtt = pStats->srtt.load(memory_order_relaxed);
+	stats.rto = pStats->rto.load(memory_order_relaxed);
+	stats.queueing = pStats->queueing.load(memory_order_relaxed);
+	stats.fragmentation = pStats->fragmentation.load(memory_order_relaxed);
+	stats.p2pSessions = pStats->p2pSessions.load(memory_order_relaxed);
+	stats.groupPeers = pStats->groupPeers.load(memory_order_relaxed);
+
+	// Sum of the streams values
+	stats.readQueue = 0;
+	stats.groupPullsWaiting = stats.groupPushers = 0;
+	pStats->streams([&stats](UInt16 mediaId, const RTMFP::StreamStats& streamStats) {
+		stats.readQueue += streamStats.readQueue.load(memory_order_relaxed);
+		stats.groupPullsWaiting += streamStats.groupPullsWaiting.load(memory_order_relaxed);
+		stats.groupPushers += streamStats.groupPushers.load(memory_order_relaxed);
+	});
+	return true;
+}
+
+bool Invoker::getStreamStats(UInt32 RTMFPcontext, UInt16 streamId, RTMFPStreamStats& stats) {
+	shared<RTMFP::Stats> pStats;
+	{
+		lock_guard<mutex> lock(_mutexStats);
+		auto itStats = _mapStats.find(RTMFPcontext);
+		if (itStats == _mapStats.end())
+			return false;
+		pStats = itStats->second;
+	}
+
+	bool found(false);
+	pStats->streams([&stats, &found, streamId](UInt16 mediaId, const RTMFP::StreamStats& streamStats) {
+		if (mediaId != streamId)
+			return;
+		found = true;
+		stats.readQueue = streamStats.readQueue.load(memory_order_relaxed);
+		stats.readPackets = streamStats.readPackets.load(memory_order_relaxed);
+		stats.groupPeers = streamStats.groupPeers.load(memory_order_relaxed);
+		stats.groupFragments = streamStats.groupFragments.load(memory_order_relaxed);
+		stats.groupPullsWaiting = streamStats.groupPullsWaiting.load(memory_order_relaxed);
+		stats.groupPushers = streamStats.groupPushers.load(memory_order_relaxed);
+		stats.groupFragmentsIn = streamStats.groupFragmentsIn.load(memory_order_relaxed);
+		stats.groupDuplicatesIn = streamStats.groupDuplicatesIn.load(memory_order_relaxed);
+		stats.groupDuplicateBytesIn = streamStats.groupDuplicateBytesIn.load(memory_order_relaxed);
+	});
+	return found;
+}
+
+bool Invoker::getHistogram(UInt32 RTMFPcontext, int stage, RTMFPHistogram& histogram, bool reset) {
+#if defined(LIBRTMFP_HISTOGRAMS)
+	if (stage < 0 || stage >= RTMFP::HISTOGRAM_COUNT)
+		return false;
+
+	shared<RTMFP::Stats> pStats;
+	{
+		lock_guard<mutex> lock(_mutexStats);
+		auto itStats = _mapStats.find(RTMFPcontext);
+		if (itStats == _mapStats.end())
+			return false;
+		pStats = itStats->second;
+	}
+	pStats->histograms[stage].read(histogram, reset);
+	return true;
+#else
+	return false;
+#endif
+}
+
 void Invoker::decode(int idConnection, UInt32 idSession, const SocketAddress& address, const shared<RTMFP::Engine>& pEngine, shared<Buffer>& pBuffer, UInt16& threadRcv) {
 
 	shared<RTMFPDecoder> pDecoder(SET, idConnection, idSession, address, pEngine, pBuffer, handler);
@@ -35,6 +35,22 @@ FlashListener::FlashListener(Publisher& publication, const string& identifier, c
 	_pDataWriter(pDataWriter), _pAudioWriter(pAudioWriter), _pVideoWriter(pVideoWriter), receiveAudio(true), receiveVideo(true), _firstTime(true), _seekTime(0),
 	_dataInitialized(false), _startTime(0), _lastTime(0), _codecInfosSent(false) {
 
+	// audio first to keep its continuity during the video key frames
+	if (_pAudioWriter)
+		_pAudioWriter->setPriority(RTMFP::PRIORITY_AUDIO);
+	if (_pVideoWriter)
+		_pVideoWriter->setPriority(RTMFP::PRIORITY_VIDEO);
+
+	// Forward error correction of the media, parameters read for each publication
+	UInt32 fecBlock(RTMFP::Parameters().getNumber<UInt32>("fecBlock"));
+	if (fecBlock) {
+		UInt8 block(fecBlock > 0xFF ? 0xFF : UInt8(fecBlock));
+		UInt32 parities(RTMFP::Parameters().getNumber<UInt32>("fecParities"));
+		if (_pAudioWriter)
+			_pAudioWriter->setFEC(block, parities > block ? block : UInt8(parities));
+		if (_pVideoWriter)
+			_pVideoWriter->setFEC(block, parities > block ? block : UInt8(parities));
+	}
 }
 
 FlashListener::~FlashListener() {
@@ -24,13 +24,11 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "GroupStream.h"
 #include "librtmfp.h"
 #include "Base/Util.h"
+#include <algorithm>
 
 using namespace Base;
 using namespace std;
 
-#if defined(_WIN32)
-	#define sscanf sscanf_s
-#endif
 #if !defined(_INC_MATH) // On Android gnu_shared library does not include math.h
 	#define log2(VARIABLE) (log(VARIABLE) / log(2))
 #endif
@@ -44,12 +42,10 @@ UInt32 NetGroup::AddressesSize(const SocketAddress& host, const PEER_LIST_ADDRES
 	return size;
 }
 
-const string& NetGroup::GetGroupAddressFromPeerId(const char* rawId, std::string& groupAddress) {
+const GroupAddress& NetGroup::GetGroupAddressFromPeerId(const char* rawId, GroupAddress& groupAddress) {
 	
-	static UInt8 tmp[PEER_ID_SIZE];
-	EVP_Digest(rawId, PEER_ID_SIZE+2, tmp, NULL, EVP_sha256(), NULL);
-	String::Assign(groupAddress, String::Hex(tmp, PEER_ID_SIZE));
-	TRACE("Group address : ", groupAddress)
+	EVP_Digest(rawId, PEER_ID_SIZE+2, groupAddress.value, NULL, EVP_sha256(), NULL);
+	TRACE("Group address : ", String::Hex(groupAddress.value, PEER_ID_SIZE))
 	return groupAddress;
 }
 
@@ -63,33 +59,22 @@ UInt32 NetGroup::TargetNeighborsCount(double peersCount) {
 
 double NetGroup::estimatedPeersCount() {
 
-	if (_mapGroupAddress.size() < 4)
-		return _mapGroupAddress.size();
+	UInt32 size = _groupAddresses.size();
+	if (size < 4)
+		return size;
 
 	// First get the neighbors N-2 and N+2
-	auto itFirst = _mapGroupAddress.lower_bound(_myGroupAddress);
-	auto itLast = itFirst;
-	if (itFirst == _mapGroupAddress.end()) {
-		itFirst = --(--(_mapGroupAddress.end()));
-		itLast = ++(_mapGroupAddress.begin());
-	}
-	else {
-
-		if (itFirst->first > _myGroupAddress)  // Current == N+1
-			RTMFP::GetPreviousIt(_mapGroupAddress, itFirst);
-		else
-			RTMFP::GetNextIt(_mapGroupAddress, itLast); // Current == N-1 (TODO: can it happen?)
-
-		RTMFP::GetPreviousIt(_mapGroupAddress, itFirst);
-		RTMFP::GetNextIt(_mapGroupAddress, itLast);
+	UInt32 index = findGroupAddress(_myGroupAddress);
+	UInt32 first = (index + size - 2) % size, last = (index + 1) % size; // Current == N+1 (or end)
+	if (index < size && _groupAddresses[index].address == _myGroupAddress) { // Current == N-1 (TODO: can it happen?)
+		first = (index + size - 1) % size;
+		last = (index + 2) % size;
 	}
 	
-	TRACE("First peer (N-2) = ", itFirst->first)
-	TRACE("Last peer (N+2) = ", itLast->first)
+	TRACE("First peer (N-2) = ", String::Hex(_groupAddresses[first].pPeer->id(), PEER_ID_SIZE))
+	TRACE("Last peer (N+2) = ", String::Hex(_groupAddresses[last].pPeer->id(), PEER_ID_SIZE))
 
-	unsigned long long valFirst = 0, valLast = 0;
-	sscanf(itFirst->first.substr(0, 16).c_str(), "%llx", &valFirst);
-	sscanf(itLast->first.substr(0, 16).c_str(), "%llx", &valLast);
+	UInt64 valFirst = _groupAddresses[first].address.prefix(), valLast = _groupAddresses[last].address.prefix();
 
 	// Then calculate the total	
 	if (valLast > valFirst)
@@ -99,15 +84,10 @@ double NetGroup::estimatedPeersCount() {
 }
 
 NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt, const string& groupName, const string& streamName, RTMFPSession& conn, RTMFPGroupConfig* parameters,
-	bool audioReliable, bool videoReliable) : _p2pAble(false), idHex(groupId), idTxt(groupTxt), _groupName(groupName), stream(streamName), _conn(conn), _pListener(NULL), _pGroupParameters(new RTMFPGroupConfig()), _pullTimeout(false),
-	_groupMediaPublisher(_mapGroupMedias.end()), _countP2P(0), _countP2PSuccess(0), _audioReliable(audioReliable), _videoReliable(videoReliable), FlashHandler(0, mediaId) {
+	bool audioReliable, bool videoReliable) : _p2pAble(false), idHex(groupId), idTxt(groupTxt), _groupName(groupName), _conn(conn), _pListener(NULL), _pGroupParameters(new RTMFPGroupConfig()), _pullTimeout(false),
+	_groupMediaPublisher(_mapGroupMedias.end()), _countP2P(0), _countP2PSuccess(0), FlashHandler(0, mediaId) {
 	_onNewMedia = [this](const string& peerId, shared<PeerMedia>& pPeerMedia, const string& streamName, const string& streamKey, BinaryReader& packet) {
 
-		if (streamName != stream) {
-			INFO("New stream available in the group but not registered : ", streamName, " (expected : ", stream, ")")
-			return false;
-		}
-
 		shared<RTMFPGroupConfig> pParameters(SET);
 		memcpy(pParameters.get(), _pGroupParameters.get(), sizeof(RTMFPGroupConfig)); // TODO: make a initializer
 		ReadGroupConfig(pParameters, packet);  // TODO: check groupParameters
@@ -119,20 +99,19 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 				DEBUG("New GroupMedia ignored, we are the publisher")
 				return false;
 			}
-			itGroupMedia = _mapGroupMedias.emplace_hint(itGroupMedia, piecewise_construct, forward_as_tuple(streamKey), forward_as_tuple(stream, streamKey, pParameters, _audioReliable, _videoReliable));
-			itGroupMedia->second.onNewFragment = _onNewFragment;
-			itGroupMedia->second.onRemovedFragments = _onRemovedFragments;
-			itGroupMedia->second.onStartProcessing = _onStartProcessing;
-			itGroupMedia->second.onPullTimeout = _onPullTimeout;
-			DEBUG("Creation of GroupMedia ", itGroupMedia->second.id, " for the stream ", stream, " :\n", String::Hex(BIN streamKey.data(), streamKey.size()))
-
-			// Send the group media infos to each other peers
-			for (auto& itPeer : _mapPeers) {
-				if (itPeer.first == peerId)
-					continue;
-				auto pPeerMedia = itPeer.second->getPeerMedia(itGroupMedia->first);
-				itGroupMedia->second.sendGroupMedia(pPeerMedia);
+			auto itStream = _streams.find(streamName);
+			if (itStream == _streams.end()) {
+				// Save the Group Media to start it if the stream is subscribed later
+				auto itAvailable = _availableMedias.lower_bound(streamKey);
+				if (itAvailable == _availableMedias.end() || itAvailable->first != streamKey) {
+					INFO("New stream available in the group but not subscribed : ", streamName)
+					_availableMedias.emplace_hint(itAvailable, piecewise_construct, forward_as_tuple(streamKey), forward_as_tuple(streamName, pParameters));
+				}
+				else
+					itAvailable->second.time = Time::Now(); // announced again
+				return false;
 			}
+			itGroupMedia = createGroupMedia(itGroupMedia, streamKey, itStream, pParameters, peerId);
 		}
 		
 		// And finally try to add the peer and send the GroupMedia subscription
@@ -149,14 +128,14 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 	};
 	_onGroupReport = [this](P2PSession* pPeer, BinaryReader& packet, bool sendMediaSubscription) {
 		
-		auto itNode = _mapHeardList.find(pPeer->peerId);
-		if (itNode == _mapHeardList.end()) {
+		HeardList::Peer* pNode = _heardList.find(BIN pPeer->rawId.data() + 2);
+		if (!pNode || pNode->died) {
 			WARN("Group report received from unknown peer ", pPeer->peerId) // should not happen
 			return;
 		}
 
 		// Read the Group Report & try to update the Best List if new peers are found
-		if (readGroupReport(itNode, packet) && !_bestList.size() && !_startedBestList) {
+		if (readGroupReport(*pNode, packet) && !_bestList.size() && !_startedBestList) {
 			updateBestList(); // Note: if we don't receive any group report we don't update the best list
 			_startedBestList = true;
 		}
@@ -164,6 +143,7 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 		// First Viewer = > create listener
 		if (_groupMediaPublisher != _mapGroupMedias.end() && !_pListener) {
 			Exception ex;
+			const string& stream = _groupMediaPublisher->second.stream();
 			if (!(_pListener = _conn.startListening<GroupListener>(ex, stream, _groupName))) {
 				WARN(ex) // TODO : See if we can send a specific answer
 				return;
@@ -171,6 +151,7 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 			INFO("First viewer play request, starting to play Stream ", stream, " from ", _groupName)
 			_pListener->onMedia = _groupMediaPublisher->second.onMedia;
 			_pListener->onFlush = _groupMediaPublisher->second.onFlush;
+			_pListener->publication.sendGOP(*_pListener); // start the stream with the current GOP
 			_conn.handleFirstPeer(); // A peer is connected : unlock the possible blocking function
 		}
 
@@ -196,8 +177,8 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 	_onGroupBegin = [this](P2PSession* pPeer) {
 
 		 // When we receive the 0E NetGroup message type we must send the group report if not already sent
-		auto itNode = _mapHeardList.find(pPeer->peerId);
-		if (itNode == _mapHeardList.end() || pPeer->groupFirstReportSent)
+		HeardList::Peer* pNode = _heardList.find(BIN pPeer->rawId.data() + 2);
+		if (!pNode || pNode->died || pPeer->groupFirstReportSent)
 			return;
 
 		sendGroupReport(pPeer, true);
@@ -219,6 +200,8 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 	// Copy the group parameters
 	memcpy(_pGroupParameters.get(), parameters, sizeof(RTMFPGroupConfig));
 
+	auto itStream = _streams.emplace(piecewise_construct, forward_as_tuple(streamName), forward_as_tuple(mediaId, audioReliable, videoReliable)).first;
+
 	// If Publisher create a new GroupMedia
 	if (_pGroupParameters->isPublisher) {
 
@@ -229,15 +212,20 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 
 		shared<RTMFPGroupConfig> pParameters(SET);
 		memcpy(pParameters.get(), _pGroupParameters.get(), sizeof(RTMFPGroupConfig)); // TODO: make a initializer
-		_groupMediaPublisher = _mapGroupMedias.emplace(piecewise_construct, forward_as_tuple(streamKey), forward_as_tuple(stream, streamKey, pParameters, _audioReliable, _videoReliable)).first;
+		_groupMediaPublisher = _mapGroupMedias.emplace(piecewise_construct, forward_as_tuple(streamKey), forward_as_tuple(itStream->first, streamKey, pParameters, itStream->second.audioReliable, itStream->second.videoReliable)).first;
 	}
 	// Else it's a player, create the fragment controler
 	else {
 		_pGroupBuffer.set();
 		_pGroupBuffer->onNextPacket = [this](GroupBuffer::Result& result) { // Executed in the GroupBuffer Thread
-			// Use Flash handler to process the packets
-			for (RTMFP::MediaPacket& mediaPacket : result)
+			// Use Flash handler to process the packets (the media id is only read by this thread)
+			for (GroupBuffer::MediaPacket& mediaPacket : result) {
+				HISTOGRAM_ORIGIN(mediaPacket.origin)
+				HISTOGRAM(*_conn.stats(), HISTOGRAM_GROUP)
+				setIdMedia(mediaPacket.mediaId);
 				FlashHandler::process(mediaPacket.type, mediaPacket.time, mediaPacket, 0, 0, 0, false);
+			}
+			HISTOGRAM_ORIGIN(0)
 		};
 
 		_onNewFragment = [this](UInt32 groupMediaId, const shared<GroupFragment>& pFragment) {
@@ -248,9 +236,18 @@ NetGroup::NetGroup(UInt16 mediaId, const string& groupId, const string& groupTxt
 			Exception ex;
 			AUTO_ERROR(_pGroupBuffer->removeFragments(ex, groupMediaId, fragmentId), "GroupBuffer ", groupMediaId, " remove fragments")
 		};
-		_onStartProcessing = [this](UInt32 groupMediaId) {
-			Exception ex;
-			AUTO_ERROR(_pGroupBuffer->startProcessing(ex, groupMediaId), "GroupBuffer ", groupMediaId, " start processing")
+		_onStartProcessing = [this](UInt32 groupMediaId, UInt64 firstFragment) {
+			for (auto& itGroupMedia : _mapGroupMedias) {
+				if (itGroupMedia.second.id != groupMediaId)
+					continue;
+				auto itStream = _streams.find(itGroupMedia.second.stream());
+				if (itStream == _streams.end())
+					break;
+				Exception ex;
+				AUTO_ERROR(_pGroupBuffer->startProcessing(ex, groupMediaId, itStream->second.mediaId, firstFragment), "GroupBuffer ", groupMediaId, " start processing")
+				return;
+			}
+			ERROR("Unable to find the stream of GroupMedia ", groupMediaId) // implementation error
 		};
 		_onPullTimeout = [this](UInt32 groupMediaId) {
 			_pullTimeout = true; // wait the next manage to disconnect
@@ -302,6 +299,7 @@ void NetGroup::close() {
 		itGroupMedia.second.onPullTimeout = nullptr;
 	}
 	_mapGroupMedias.clear();
+	_availableMedias.clear();
 
 	MAP_PEERS_ITERATOR_TYPE itPeer = _mapPeers.begin();
 	while (itPeer != _mapPeers.end())
@@ -313,51 +311,125 @@ void NetGroup::close() {
 	}
 }
 
-void NetGroup::addPeer2HeardList(const string& peerId, const char* rawId, const PEER_LIST_ADDRESS_TYPE& listAddresses, const SocketAddress& hostAddress, UInt64 timeElapsed) {
+bool NetGroup::addStream(UInt16 mediaId, const string& streamName, bool audioReliable, bool videoReliable) {
+	if (_pGroupParameters->isPublisher) {
+		WARN("Unable to subscribe to the stream ", streamName, ", the group ", _groupName, " is publishing")
+		return false;
+	}
 
-	auto itDied = _mapDiedPeers.find(peerId);
-	if (itDied != _mapDiedPeers.end()) {
-		DEBUG("The peer ", peerId," is already died")
-		return;
+	auto itStream = _streams.lower_bound(streamName);
+	if (itStream != _streams.end() && itStream->first == streamName) {
+		WARN("The stream ", streamName, " is already subscribed in the group ", _groupName)
+		return false;
+	}
+	INFO("Subscribing to the stream ", streamName, " in the group ", _groupName, " (mediaId=", mediaId, ")")
+	itStream = _streams.emplace_hint(itStream, piecewise_construct, forward_as_tuple(streamName), forward_as_tuple(mediaId, audioReliable, videoReliable));
+
+	// Start the Group Medias already announced by the peers
+	auto itAvailable = _availableMedias.begin();
+	while (itAvailable != _availableMedias.end()) {
+		if (itAvailable->second.stream != streamName) {
+			++itAvailable;
+			continue;
+		}
+		auto itGroupMedia = _mapGroupMedias.lower_bound(itAvailable->first);
+		if (itGroupMedia == _mapGroupMedias.end() || itGroupMedia->first != itAvailable->first)
+			createGroupMedia(itGroupMedia, itAvailable->first, itStream, itAvailable->second.pParameters, String::Empty());
+		_availableMedias.erase(itAvailable++);
+	}
+	return true;
+}
+
+bool NetGroup::removeStream(UInt16 mediaId) {
+	if (_pGroupParameters->isPublisher)
+		return false;
+
+	auto itStream = _streams.begin();
+	while (itStream != _streams.end() && itStream->second.mediaId != mediaId)
+		++itStream;
+	if (itStream == _streams.end())
+		return false;
+	INFO("Unsubscribing from the stream ", itStream->first, " in the group ", _groupName)
+
+	// Delete the Group Medias of the stream (the peers are kept for the other streams), they can be started again by a new subscription
+	auto itGroupMedia = _mapGroupMedias.begin();
+	while (itGroupMedia != _mapGroupMedias.end()) {
+		if (itGroupMedia->second.stream() != itStream->first) {
+			++itGroupMedia;
+			continue;
+		}
+		_availableMedias.emplace(piecewise_construct, forward_as_tuple(itGroupMedia->first), forward_as_tuple(itStream->first, itGroupMedia->second.groupParameters));
+		if (_pGroupBuffer) {
+			Exception ex;
+			AUTO_ERROR(_pGroupBuffer->removeBuffer(ex, itGroupMedia->second.id), "GroupBuffer remove buffer", itGroupMedia->second.id)
+		}
+		_mapGroupMedias.erase(itGroupMedia++);
+	}
+	_streams.erase(itStream);
+	return true;
+}
+
+map<string, GroupMedia>::iterator NetGroup::createGroupMedia(map<string, GroupMedia>::iterator itGroupMedia, const string& streamKey, const map<string, Stream>::iterator& itStream,
+	const shared<RTMFPGroupConfig>& pParameters, const string& peerId) {
+
+	itGroupMedia = _mapGroupMedias.emplace_hint(itGroupMedia, piecewise_construct, forward_as_tuple(streamKey), forward_as_tuple(itStream->first, streamKey, pParameters, itStream->second.audioReliable, itStream->second.videoReliable));
+	itGroupMedia->second.onNewFragment = _onNewFragment;
+	itGroupMedia->second.onRemovedFragments = _onRemovedFragments;
+	itGroupMedia->second.onStartProcessing = _onStartProcessing;
+	itGroupMedia->second.onPullTimeout = _onPullTimeout;
+	DEBUG("Creation of GroupMedia ", itGroupMedia->second.id, " for the stream ", itStream->first, " :\n", String::Hex(BIN streamKey.data(), streamKey.size()))
+
+	// Send the group media infos to each other peers
+	for (auto& itPeer : _mapPeers) {
+		if (itPeer.first == peerId)
+			continue;
+		auto pPeerMedia = itPeer.second->getPeerMedia(itGroupMedia->first);
+		itGroupMedia->second.sendGroupMedia(pPeerMedia);
 	}
+	return itGroupMedia;
+}
 
-	auto it = _mapHeardList.lower_bound(peerId);
-	if (it != _mapHeardList.end() && it->first == peerId) {
-		DEBUG("The peer ", peerId, " is already known")
+void NetGroup::addPeer2HeardList(const string& peerId, const char* rawId, const PEER_LIST_ADDRESS_TYPE& listAddresses, const SocketAddress& hostAddress, UInt64 timeElapsed) {
+
+	HeardList::Peer* pPeer = _heardList.find(BIN rawId + 2);
+	if (pPeer) {
+		DEBUG("The peer ", peerId, pPeer->died? " is already died" : " is already known")
 		return;
 	}
 
-	string groupAddress;
-	_mapGroupAddress.emplace(piecewise_construct, forward_as_tuple(GetGroupAddressFromPeerId(rawId, groupAddress).c_str()), forward_as_tuple(peerId.c_str()));
-	it = _mapHeardList.emplace_hint(it, piecewise_construct, forward_as_tuple(peerId.c_str()), forward_as_tuple(SET, rawId, groupAddress, listAddresses, hostAddress, timeElapsed));
-	DEBUG("Peer ", it->first, " added to heard list")
+	pPeer = &addHeardPeer(rawId, timeElapsed);
+	pPeer->setHostAddress(hostAddress);
+	for (auto& itAddress : listAddresses)
+		pPeer->addAddress(itAddress.first, itAddress.second);
 }
 
-void NetGroup::handlePeerDisconnection(const string& peerId) {
+HeardList::Peer& NetGroup::addHeardPeer(const char* rawId, UInt64 timeElapsed) {
 
-	auto itHeardList = _mapHeardList.find(peerId);
-	if (itHeardList == _mapHeardList.end())
-		return; // peer not found
+	HeardList::Peer& peer = _heardList.add(rawId, ((UInt64)Time::Now()) - (timeElapsed * 1000));
+	GetGroupAddressFromPeerId(rawId, peer.groupAddress);
+	_groupAddresses.emplace(_groupAddresses.begin() + findGroupAddress(peer.groupAddress), peer);
+	DEBUG("Peer ", String::Hex(peer.id(), PEER_ID_SIZE), " added to heard list")
+	return peer;
+}
+
+void NetGroup::handlePeerDisconnection(const string& peerId) {
 
-	auto itDied = _mapDiedPeers.lower_bound(peerId);
-	if (itDied != _mapDiedPeers.end() && itDied->first == peerId)
-		return; // peer already died
+	HeardList::Peer* pPeer = _heardList.find(peerId);
+	if (!pPeer || pPeer->died)
+		return; // peer not found or already died
 
 	INFO("Peer ", peerId, " died, it is now disabled...")
-	_mapDiedPeers.emplace_hint(itDied, peerId, itHeardList->second); // we keep the peer for max. 5min
+	pPeer->died = true; // we keep the peer for max. 5min
 
 	// Delete peer from heard list
-	auto itGroupAddress = _mapGroupAddress.find(itHeardList->second->groupAddress);
-	DEBUG_ASSERT(itGroupAddress != _mapGroupAddress.end()) // implementation error
-	_mapGroupAddress.erase(itGroupAddress);
-	_mapHeardList.erase(itHeardList);
+	removeGroupAddress(pPeer->groupAddress);
 	--_countP2P; // this attempt was not a fail
 }
 
 bool NetGroup::addPeer(const string& peerId, const shared<P2PSession>& pPeer) {
 
-	auto itHeardList = _mapHeardList.find(peerId);
-	if (itHeardList == _mapHeardList.end()) {
+	HeardList::Peer* pNode = _heardList.find(BIN pPeer->rawId.data() + 2);
+	if (!pNode || pNode->died) {
 		ERROR("Unknown peer to add : ", peerId) // implementation error
 		return false;
 	}
@@ -375,10 +447,10 @@ bool NetGroup::addPeer(const string& peerId, const shared<P2PSession>& pPeer) {
 		++_countP2PSuccess;
 
 	// Update the heard list addresses
-	itHeardList->second->hostAddress = pPeer->hostAddress;
+	pNode->setHostAddress(pPeer->hostAddress);
 	for (auto& itAddress : pPeer->addresses())
 		if ((itAddress.second & 0x0f) == RTMFP::ADDRESS_PUBLIC) // In Netgroup report we just save the public addresses
-			itHeardList->second->addresses.emplace(itAddress.first, itAddress.second);
+			pNode->addAddress(itAddress.first, itAddress.second);
 
 	_mapPeers.emplace_hint(it, peerId, pPeer);
 
@@ -466,9 +538,18 @@ bool NetGroup::manage(Exception& ex, Int64 now) {
 			++itGroupMedia;
 	}
 
-	// Clean peers heard list
+	// Clean peers heard list and the Group Medias not subscribed and not announced since NETGROUP_MEDIA_TIMEOUT
 	if (RTMFP::IsElapsed(_lastCleanHeardList, now, NETGROUP_CLEAN_DELAY)) {
 		cleanHeardList();
+		auto itAvailable = _availableMedias.begin();
+		while (itAvailable != _availableMedias.end()) {
+			if (RTMFP::IsElapsed(itAvailable->second.time, now, NETGROUP_MEDIA_TIMEOUT)) {
+				DEBUG("Group Media of the stream ", itAvailable->second.stream, " not announced since ", NETGROUP_MEDIA_TIMEOUT, "ms, deleting it")
+				_availableMedias.erase(itAvailable++);
+			}
+			else
+				++itAvailable;
+		}
 		_lastCleanHeardList = now;
 	};
 
@@ -481,8 +562,8 @@ bool NetGroup::manage(Exception& ex, Int64 now) {
 	// Print statistics
 	if (RTMFP::IsElapsed(_lastStats, now, NETGROUP_STATS_DELAY)) {
 		double peersCount = estimatedPeersCount();
-		INFO("Peers connected to group ", _groupName, " : ", _mapPeers.size(), "/", _mapGroupAddress.size(), " ; target count : ", _bestList.size(), "/", TargetNeighborsCount(peersCount), "/", (UInt64)peersCount,
-			" ; P2P success : ", _countP2PSuccess, "/", _countP2P, " ; GroupMedia count : ", _mapGroupMedias.size())
+		INFO("Peers connected to group ", _groupName, " : ", _mapPeers.size(), "/", _groupAddresses.size(), " ; target count : ", _bestList.size(), "/", TargetNeighborsCount(peersCount), "/", (UInt64)peersCount,
+			" ; P2P success : ", _countP2PSuccess, "/", _countP2P, " ; GroupMedia count : ", _mapGroupMedias.size(), " ; streams : ", _streams.size())
 			for (auto& itGroup : _mapGroupMedias)
 				itGroup.second.printStats();
 
@@ -491,43 +572,78 @@ bool NetGroup::manage(Exception& ex, Int64 now) {
 	return true;
 }
 
+void NetGroup::updateStats(RTMFP::Stats& stats) {
+	stats.groupPeers.store(_mapPeers.size(), memory_order_relaxed);
+
+	for (auto& itGroupMedia : _mapGroupMedias) {
+		auto itStream = _streams.find(itGroupMedia.second.stream());
+		if (itStream == _streams.end())
+			continue;
+		if (!itStream->second.pStats)
+			itStream->second.pStats = stats.stream(itStream->second.mediaId);
+		itGroupMedia.second.updateStats(*itStream->second.pStats);
+	}
+}
+
 void NetGroup::updateBestList() {
 
 	// Calculate the Best List
+	set<HeardList::Peer*> bestList;
+	buildBestList(_myGroupAddress, _conn.peerId(), bestList);
+
 	std::set<std::string> oldList(move(_bestList));
-	buildBestList(_myGroupAddress, _conn.peerId(), _bestList);
+	string peerId;
+	for (HeardList::Peer* pPeer : bestList)
+		_bestList.emplace(String::Assign(peerId, String::Hex(pPeer->id(), PEER_ID_SIZE)));
 
 	// Send new connection requests and close the old ones
 	manageBestConnections(oldList);
 }
 
-void NetGroup::buildBestList(const string& groupAddress, const string& peerId, set<string>& bestList) {
+UInt32 NetGroup::findGroupAddress(const GroupAddress& groupAddress) {
+
+	return lower_bound(_groupAddresses.begin(), _groupAddresses.end(), groupAddress, [](const GroupEntry& entry, const GroupAddress& address) { 
+		return entry.address < address; 
+	}) - _groupAddresses.begin();
+}
+
+void NetGroup::removeGroupAddress(const GroupAddress& groupAddress) {
+
+	UInt32 index = findGroupAddress(groupAddress);
+	if (index == _groupAddresses.size() || _groupAddresses[index].address != groupAddress) {
+		ERROR("Unable to find the group address of a peer to delete") // implementation error
+		return;
+	}
+	_groupAddresses.erase(_groupAddresses.begin() + index);
+}
+
+void NetGroup::buildBestList(const GroupAddress& groupAddress, const string& peerId, set<HeardList::Peer*>& bestList) {
 	bestList.clear();
 
 	// Find the 6 closest peers
-	if (_mapGroupAddress.size() <= 6) {
-		for (auto& it : _mapGroupAddress)
-			bestList.emplace(it.second);
+	UInt32 size = _groupAddresses.size();
+	if (size <= 6) {
+		for (auto& entry : _groupAddresses)
+			bestList.emplace(entry.pPeer);
 	}
 	else { // More than 6 peers, in this part redundant peers are accepted to limit the size of the Best List
 		UInt16 count(0);
 
 		// First we search the first of the 6 closest peers
-		auto itFirst = _mapGroupAddress.lower_bound(groupAddress);
-		if (itFirst == _mapGroupAddress.end())
-			itFirst = --(_mapGroupAddress.end());
-		for (int i = 0; i < 2; i++)
-			RTMFP::GetPreviousIt(_mapGroupAddress, itFirst);
+		UInt32 index = findGroupAddress(groupAddress);
+		if (index == size)
+			index = size - 1;
+		index = (index + size - 2) % size;
 
 		// Then we add the 6 peers
 		for (int j = 0; j < 6; j++) {
-			if (itFirst->first == groupAddress)
+			if (_groupAddresses[index].address == groupAddress)
 				--j; // to avoid adding our own address
 			else {
-				if (bestList.emplace(itFirst->second).second)
+				if (bestList.emplace(_groupAddresses[index].pPeer).second)
 					++count;
 			}
-			RTMFP::GetNextIt(_mapGroupAddress, itFirst);
+			index = (index + 1) % size;
 		}
 
 		// Find the 6 lowest latency
@@ -545,36 +661,35 @@ void NetGroup::buildBestList(const string& groupAddress, const string& peerId, s
 				if ((*itLatency)->peerId == peerId)
 					--i; // to avoid adding our own address
 				else {
-					if (bestList.emplace((*itLatency)->peerId).second)
+					HeardList::Peer* pNode = _heardList.find(BIN (*itLatency)->rawId.data() + 2);
+					if (pNode && !pNode->died && bestList.emplace(pNode).second)
 						++count;
 				}
 			}
 		}
 
 		// Add one random peer
-		auto itRandom = _mapGroupAddress.begin();
-		if (RTMFP::GetRandomIt<map<string, string>, map<string, string>::iterator>(_mapGroupAddress, itRandom, [bestList, groupAddress](const map<string, string>::iterator& it) { 
-					return it->first != groupAddress && bestList.find(it->second) == bestList.end();
-				})) {
-			bestList.emplace(itRandom->second);
-			++count;
-		}
+		UInt32 random = Util::Random<UInt32>() % size;
+		index = random;
+		do {
+			const GroupEntry& entry = _groupAddresses[index];
+			if (entry.address != groupAddress && bestList.find(entry.pPeer) == bestList.end()) {
+				bestList.emplace(entry.pPeer);
+				++count;
+				break;
+			}
+		} while ((index = (index + 1) % size) != random);
 
 		// Find 2 log(N) peers with location + 1/2, 1/4, 1/8 ...
-		int targetCount = min((int)TargetNeighborsCount(estimatedPeersCount()), (int)(_mapGroupAddress.size() - (peerId != _conn.peerId())));
-		auto itTarget = _mapGroupAddress.lower_bound(groupAddress);
-		if (itTarget == _mapGroupAddress.end())
-			itTarget = _mapGroupAddress.begin();
+		int targetCount = min((int)TargetNeighborsCount(estimatedPeersCount()), (int)(size - (peerId != _conn.peerId())));
+		index = findGroupAddress(groupAddress) % size;
 		for (int missing = targetCount - count; missing > 0; --missing) {
-			auto& itNode = itTarget;
 
 			// Advance from x + 1/2^i
-			UInt32 step = _mapGroupAddress.size() / (UInt32)pow(2, missing);
-			for (UInt32 i = 0; i < step; ++i)
-				RTMFP::GetNextIt(_mapGroupAddress, itNode);
+			index = (index + size / (UInt32)pow(2, missing)) % size;
 
-			while (itNode->first == groupAddress || !bestList.emplace(itNode->second).second) // If not added go to next
-				RTMFP::GetNextIt(_mapGroupAddress, itNode);
+			while (_groupAddresses[index].address == groupAddress || !bestList.emplace(_groupAddresses[index].pPeer).second) // If not added go to next
+				index = (index + 1) % size;
 		}
 	}
 }
@@ -582,15 +697,15 @@ void NetGroup::buildBestList(const string& groupAddress, const string& peerId, s
 void NetGroup::sendGroupReport(P2PSession* pPeer, bool initiator) {
 	TRACE("Preparing the Group Report message (type 0A) for peer ", pPeer->peerId)
 
-	auto itNode = _mapHeardList.find(pPeer->peerId);
-	if (itNode == _mapHeardList.end()) {
+	HeardList::Peer* pNode = _heardList.find(BIN pPeer->rawId.data() + 2);
+	if (!pNode || pNode->died) {
 		ERROR("Unable to find the peer ", pPeer->peerId, " in the Heard list") // implementation error
 		return;
 	}
 
 	// Build the Best list for far peer
-	set<string> bestList;
-	buildBestList(itNode->second->groupAddress, itNode->first, bestList);
+	set<HeardList::Peer*> bestList;
+	buildBestList(pNode->groupAddress, pPeer->peerId, bestList);
 
 	Int64 timeNow(Time::Now());
 	const SocketAddress& hostAddress(_conn.address()), peerAddress(pPeer->address());
@@ -613,23 +728,28 @@ void NetGroup::sendGroupReport(P2PSession* pPeer, bool initiator) {
 	writer.write8(0);
 
 	// Peers ID, addresses and time
-	for (auto& it2 : bestList) {
-		itNode = _mapHeardList.find(it2);
-		if (itNode != _mapHeardList.end()) {
-
-			UInt64 timeElapsed = (UInt64)((itNode->second->lastGroupReport > 0) ? ((timeNow - itNode->second->lastGroupReport) / 1000) : 0);
-			TRACE("Group 0A argument - Peer ", itNode->first, " - elapsed : ", timeElapsed)
-			writer.write8(0x22).write(itNode->second->rawId.data(), PEER_ID_SIZE+2);
-			writer.write7Bit<UInt64>(timeElapsed);
-			writer.write7Bit<UInt64>(AddressesSize(itNode->second->hostAddress, itNode->second->addresses));
-			writer.write8(0x0A);
-			if (itNode->second->hostAddress)
-				RTMFP::WriteAddress(writer, itNode->second->hostAddress, RTMFP::ADDRESS_REDIRECTION);
-			for (auto& itAddress : itNode->second->addresses)
-				RTMFP::WriteAddress(writer, itAddress.first, itAddress.second);
-			writer.write8(0);
+	// With delta Group Reports (librtmfp peer) the peers already reported are skipped if they have not been heard since and their addresses have not changed
+	// An entry sent again always carries its addresses : the far peer may have removed the peer from its heard list since
+	map<string, pair<Int64, UInt32>> reportedPeers;
+	for (HeardList::Peer* pBest : bestList) {
+		if (pPeer->deltaReports) {
+			string id(STR pBest->id(), PEER_ID_SIZE);
+			auto itReported = pPeer->reportedPeers.find(id);
+			bool skip = itReported != pPeer->reportedPeers.end() && itReported->second.first == pBest->lastGroupReport && itReported->second.second == pBest->version;
+			reportedPeers.emplace(piecewise_construct, forward_as_tuple(move(id)), forward_as_tuple(pBest->lastGroupReport, pBest->version));
+			if (skip)
+				continue; // nothing new
 		}
+
+		UInt64 timeElapsed = (UInt64)((pBest->lastGroupReport > 0) ? ((timeNow - pBest->lastGroupReport) / 1000) : 0);
+		TRACE("Group 0A argument - Peer ", String::Hex(pBest->id(), PEER_ID_SIZE), " - elapsed : ", timeElapsed)
+		writer.write8(0x22).write(pBest->rawId, PEER_ID_SIZE+2);
+		writer.write7Bit<UInt64>(timeElapsed);
+		pBest->writeAddresses(writer);
+		writer.write8(0);
 	}
+	if (pPeer->deltaReports)
+		pPeer->reportedPeers = move(reportedPeers);
 
 	DEBUG("Sending the group report to ", pPeer->peerId)
 	pPeer->groupReportInitiator = initiator;
@@ -657,10 +777,15 @@ void NetGroup::manageBestConnections(const set<string>& oldList) {
 		
 		// if peer is not connected we try to connect to it
 		if (_mapPeers.find(*it2Connect) == _mapPeers.end()) {
-			auto itNode = _mapHeardList.find(*it2Connect);
-			if (itNode == _mapHeardList.end())
+			HeardList::Peer* pNode = _heardList.find(*it2Connect);
+			if (!pNode || pNode->died) {
 				WARN("Unable to find the peer ", *it2Connect, " to start connecting") // implementation error, should not happen
-			else if (_conn.connect2Peer(it2Connect->c_str(), stream.c_str(), itNode->second->addresses, itNode->second->hostAddress, true)) { // rendezvous service delayed of 5s
+				continue;
+			}
+			PEER_LIST_ADDRESS_TYPE addresses;
+			SocketAddress hostAddress;
+			pNode->getAddresses(addresses, hostAddress);
+			if (_conn.connect2Peer(it2Connect->c_str(), String::Empty(), addresses, hostAddress, true)) { // rendezvous service delayed of 5s (the connection is shared by all the streams)
 				if (++_countP2P == ULLONG_MAX) { // reset p2p count
 					_countP2PSuccess = _countP2P = 0;
 					_p2pRateTime.update();
@@ -673,42 +798,21 @@ void NetGroup::manageBestConnections(const set<string>& oldList) {
 
 void NetGroup::cleanHeardList() {
 
+	// Peers are ordered by time of last Group Report, stop at the first one not expired
 	Int64 now = Time::Now();
-	auto itHeardList = _mapHeardList.begin();
-	while (itHeardList != _mapHeardList.end()) {
-
-		// No Group Report since 5min?
-		if (now > itHeardList->second->lastGroupReport && ((now - itHeardList->second->lastGroupReport) > NETGROUP_PEER_TIMEOUT)) {
-			INFO("Peer ", itHeardList->first, " timeout (", NETGROUP_PEER_TIMEOUT, "ms elapsed) - deleting from the Heard List...")
+	HeardList::Peer* pPeer;
+	string peerId;
+	while ((pPeer = _heardList.oldest()) && now > pPeer->lastGroupReport && ((now - pPeer->lastGroupReport) > NETGROUP_PEER_TIMEOUT)) { // No Group Report since 5min?
+		String::Assign(peerId, String::Hex(pPeer->id(), PEER_ID_SIZE));
+		INFO("Peer ", peerId, " timeout (", NETGROUP_PEER_TIMEOUT, "ms elapsed) - deleting from the ", pPeer->died? "Died List..." : "Heard List...")
 
-			// Close the peer if we are connected to it
-			_conn.removePeer(itHeardList->first);
+		// Close the peer if we are connected to it
+		_conn.removePeer(peerId);
 
-			// Delete from the Heard List
-			auto itGroupAddress = _mapGroupAddress.find(itHeardList->second->groupAddress);
-			DEBUG_ASSERT(itGroupAddress != _mapGroupAddress.end()) // implementation error
-			_mapGroupAddress.erase(itGroupAddress);
-			_mapHeardList.erase(itHeardList++);
-			continue;
-		}
-		++itHeardList;
-	}
-
-	// Remove died peers too
-	auto itDiedPeer = _mapDiedPeers.begin();
-	while (itDiedPeer != _mapDiedPeers.end()) {
-
-		// No Group Report since 5min?
-		if (now > itDiedPeer->second->lastGroupReport && ((now - itDiedPeer->second->lastGroupReport) > NETGROUP_PEER_TIMEOUT)) {
-			INFO("Peer ", itDiedPeer->first, " timeout (", NETGROUP_PEER_TIMEOUT, "ms elapsed) - deleting from the Died List...")
-
-			// Close the peer if we are connected to it
-			_conn.removePeer(itDiedPeer->first);
-			_mapDiedPeers.erase(itDiedPeer++);
-			continue;
-
-		}
-		++itDiedPeer;
+		// Delete from the Heard List
+		if (!pPeer->died)
+			removeGroupAddress(pPeer->groupAddress);
+		_heardList.remove(*pPeer);
 	}
 }
 
@@ -786,14 +890,13 @@ void NetGroup::ReadGroupConfig(const shared<RTMFPGroupConfig>& parameters, Binar
 	}
 }
 
-bool NetGroup::readGroupReport(const map<string, shared<GroupNode>>::iterator& itNode, BinaryReader& packet) {
-	string tmp, newPeerId, rawId;
-	SocketAddress myAddress, serverAddress;
-	PEER_LIST_ADDRESS_TYPE listAddresses;
+bool NetGroup::readGroupReport(HeardList::Peer& peer, BinaryReader& packet) {
+	string newPeerId, rawId;
+	SocketAddress myAddress;
 	Int64 now = Time::Now();
 
 	// Record the time of last Group Report received to build our Group Report
-	itNode->second->lastGroupReport = now;
+	_heardList.update(peer, now);
 
 	while (packet.read8() == 1) // TODO: check what this means
 		packet.next();
@@ -822,25 +925,28 @@ bool NetGroup::readGroupReport(const map<string, shared<GroupNode>>::iterator& i
 	}
 	// Update the far peer addresses
 	BinaryReader peerAddressReader(packet.current(), size - 1);
-	RTMFP::ReadAddresses(peerAddressReader, itNode->second->addresses, itNode->second->hostAddress, [](const SocketAddress&, RTMFP::AddressType) {});
+	peer.readAddresses(peerAddressReader, nullptr);
 	packet.next(size - 1);
 
-	// Loop on each peer of the NetGroup
+	// Loop on each peer of the NetGroup (the peer ID is converted in hexadecimal only when needed)
+	HeardList::Peer* pNode(NULL);
+	function<void(const SocketAddress&, RTMFP::AddressType)> onNewAddress([this, &pNode, &newPeerId](const SocketAddress& address, RTMFP::AddressType type) {
+		_conn.updatePeerAddress(String::Assign(newPeerId, String::Hex(pNode->id(), PEER_ID_SIZE)), address, type);
+	});
 	bool newPeers = false;
 	while (packet.available() > 4) {
 		if ((tmpMarker = packet.read8()) != 00) {
-			ERROR("Unexpected marker : ", String::Format<UInt8>("%.2x", tmpMarker), " from ", itNode->first, " - Expected 00 (available=", packet.available(), ", lastSize=", size,")")
+			ERROR("Unexpected marker : ", String::Format<UInt8>("%.2x", tmpMarker), " from ", String::Hex(peer.id(), PEER_ID_SIZE), " - Expected 00 (available=", packet.available(), ", lastSize=", size,")")
 			break;
 		}
 		size = packet.read8();
 		if (size == 0x22) {
 			packet.read(size, rawId);
-			String::Assign(newPeerId, String::Hex(BIN rawId.data() + 2, PEER_ID_SIZE));
 			if (String::ICompare(rawId, "\x21\x0F", 2) != 0) {
-				ERROR("Unexpected parameter : ", newPeerId, " - Expected Peer Id")
+				ERROR("Unexpected parameter : ", String::Hex(BIN rawId.data(), rawId.size()), " - Expected Peer Id")
 				break;
 			}
-			TRACE("Group Report - Peer ID : ", newPeerId)
+			TRACE("Group Report - Peer ID : ", String::Hex(BIN rawId.data() + 2, PEER_ID_SIZE))
 		}
 		else if (size > 7)
 			packet.next(size); // ignore the addresses if peerId not set
@@ -856,27 +962,26 @@ bool NetGroup::readGroupReport(const map<string, shared<GroupNode>>::iterator& i
 		TRACE("Group Report - Time elapsed : ", time, " ; addresses size : ", size)
 
 		// New peer, read its addresses if no timeout reached
-		if (newPeerId != _conn.peerId() && *packet.current() == 0x0A && (time < (NETGROUP_PEER_TIMEOUT/1000))) {
+		if (rawId.size() == PEER_ID_SIZE + 2 && rawId != _conn.rawId() && *packet.current() == 0x0A && (time < (NETGROUP_PEER_TIMEOUT/1000))) {
 
 			BinaryReader addressReader(packet.current() + 1, size - 1); // +1 to ignore 0A
-			auto itHeardList = _mapHeardList.find(newPeerId);
-			// New peer? => add it to heard list
-			if (itHeardList == _mapHeardList.end()) {
-				SocketAddress hostAddress;
-				listAddresses.clear();
-				RTMFP::ReadAddresses(addressReader, listAddresses, hostAddress, [](const SocketAddress&, RTMFP::AddressType) {});
+			// New peer? => add it to heard list (if it has addresses)
+			if (!(pNode = _heardList.find(BIN rawId.data() + 2))) {
+				if (size < 2) {
+					packet.next(size);
+					continue;
+				}
+				pNode = &addHeardPeer(rawId.data(), time);
+				pNode->readAddresses(addressReader, nullptr);
 				newPeers = true;
-				addPeer2HeardList(newPeerId.c_str(), rawId.data(), listAddresses, hostAddress, time);  // To avoid memory sharing we use c_str() (copy-on-write implementation on linux)
 			}
 			// Else update time & addresses
-			else {
+			else if (!pNode->died) {
 				Int64 nodeTime = now - (time * 1000);
-				if (nodeTime > itHeardList->second->lastGroupReport)
-					itHeardList->second->lastGroupReport = nodeTime;
+				if (nodeTime > pNode->lastGroupReport)
+					_heardList.update(*pNode, nodeTime);
 
-				RTMFP::ReadAddresses(addressReader, itHeardList->second->addresses, itHeardList->second->hostAddress, [this, newPeerId](const SocketAddress& address, RTMFP::AddressType type) {
-					_conn.updatePeerAddress(newPeerId, address, type);
-				});
+				pNode->readAddresses(addressReader, onNewAddress);
 			}
 				
 		}
@@ -38,7 +38,9 @@ UInt32 P2PSession::P2PSessionCounter = 0x03000000; // Notice that Flash uses inc
 
 P2PSession::P2PSession(RTMFPSession* parent, string id, Invoker& invoker, OnStatusEvent pOnStatusEvent, 
 		const Base::SocketAddress& host, bool responder, bool group, UInt16 mediaId) : peerId(id), hostAddress(host), _parent(parent), _groupBeginSent(false), _peerMediaId(mediaId),
-		groupReportInitiator(false), _groupConnectSent(false), _isGroup(group), groupFirstReportSent(false), FlowManager(responder, invoker, pOnStatusEvent) {
+		groupReportInitiator(false), _groupConnectSent(false), _isGroup(group), groupFirstReportSent(false), FlowManager(responder, invoker, pOnStatusEvent, parent->stats()) {
+	if (group && RTMFP::Parameters().getNumber<UInt32>("deltaReports"))
+		_deltaRequests = RTMFP::DELTA_REQUESTS;
 	_pMainStream->onMedia = [this](UInt16 mediaId, UInt32 time, const Packet& packet, double lostRate, AMF::Type type) {
 		return _parent->onMediaPlay(_peerMediaId, time, packet, lostRate, type);
 	};
@@ -70,29 +72,23 @@ P2PSession::P2PSession(RTMFPSession* parent, string id, Invoker& invoker, OnStat
 		string streamKey;
 		packet.read(0x22, streamKey);
 
-		// Create the PeerMedia and writer if it does not exists
-		auto itStream = _mapStream2PeerMedia.lower_bound(streamKey);
-		if (itStream == _mapStream2PeerMedia.end() || itStream->first != streamKey) {
-
-			// Save the streamKey
-			const shared<RTMFPWriter>& pWriter = createWriter(Packet(EXPAND("\x00\x47\x52\x11")), _mainFlowId);
-			auto itPeerMedia = _mapWriter2PeerMedia.emplace(piecewise_construct, forward_as_tuple(pWriter->id), forward_as_tuple(SET, this, pWriter)).first;
-			itStream = _mapStream2PeerMedia.emplace_hint(itStream, streamKey, itPeerMedia->second);
-			itPeerMedia->second->pStreamKey = &itStream->first;
-		} 
-		// else the stream already exists, it is a subscription
-		else if (itStream->second->idFlow) {
+		// If the stream already exists it is a subscription
+		auto itStream = _mapStream2PeerMedia.find(streamKey);
+		if (itStream != _mapStream2PeerMedia.end() && !itStream->second->closed() && itStream->second->idFlow) {
 			DEBUG("Peer ", peerId, " already subscribed to this stream, media subscription refused")
 			return false;
 		}
-		_mapFlow2PeerMedia.emplace(flowId, itStream->second);
+
+		// Create the PeerMedia and writer if it does not exists
+		shared<PeerMedia>& pPeerMedia = getPeerMedia(streamKey);
+		_mapFlow2PeerMedia.emplace(flowId, pPeerMedia);
 
 		// Save the flow ID
-		itStream->second->idFlow = flowId;
+		pPeerMedia->idFlow = flowId;
 
 		// If we accept the request and are responder => send the Media Subscription message
-		if (!onNewMedia(peerId, itStream->second, streamName, streamKey, packet))
-			itStream->second->close(false); // else we close the writer & flow
+		if (!onNewMedia(peerId, pPeerMedia, streamName, streamKey, packet))
+			pPeerMedia->close(false); // else we close the writer & flow
 		return true;
 	};
 	_pMainStream->onGroupReport = [this](BinaryReader& packet, UInt16 streamId, UInt64 flowId, UInt64 writerId) {
@@ -190,6 +186,7 @@ void P2PSession::close(bool abrupt, RTMFP::CLOSE_REASON reason) {
 		// Full close : we also close the NetGroup Report writer
 		_groupConnectSent = _groupBeginSent = groupFirstReportSent = false;
 		_pReportWriter.reset();
+		reportedPeers.clear();
 	}
 
 	for (auto& itPeerMedia : _mapWriter2PeerMedia)
@@ -286,6 +283,9 @@ bool P2PSession::handlePlay(const string& streamName, UInt16 streamId, UInt64 fl
 	pDataWriter->flush();
 	pDataWriter->setCallbackHandle(0); // reset callback handler
 
+	// Start the stream with the current GOP
+	_pListener->publication.sendGOP(*_pListener);
+
 	// A peer is connected : unlock the possible blocking RTMFP_PublishP2P function
 	_parent->setP2pPublisherReady();
 	return true;
@@ -371,17 +371,29 @@ bool P2PSession::sendGroupBegin() {
 
 shared<PeerMedia>& P2PSession::getPeerMedia(const string& streamKey) {
 
-	// Create a new writer if the stream key is unknown
 	auto itStream = _mapStream2PeerMedia.lower_bound(streamKey);
-	if (itStream == _mapStream2PeerMedia.end() || itStream->first != streamKey) {
-		shared<RTMFPWriter> pWriter = createWriter(Packet(EXPAND("\x00\x47\x52\x11")), _mainFlowId);
-		auto itPeerMedia = _mapWriter2PeerMedia.emplace(piecewise_construct, forward_as_tuple(pWriter->id), forward_as_tuple(SET, this, pWriter)).first;
-		itStream = _mapStream2PeerMedia.emplace_hint(itStream, streamKey, itPeerMedia->second);
-		itPeerMedia->second->pStreamKey = &itStream->first;
-		return itPeerMedia->second;
+	if (itStream != _mapStream2PeerMedia.end() && itStream->first == streamKey) {
+		if (!itStream->second->closed())
+			return itStream->second;
+
+		// The PeerMedia has been closed (stream not subscribed), it is replaced
+		if (itStream->second->idFlow)
+			_mapFlow2PeerMedia.erase(itStream->second->idFlow);
+		for (auto itWriter = _mapWriter2PeerMedia.begin(); itWriter != _mapWriter2PeerMedia.end(); ++itWriter) {
+			if (itWriter->second == itStream->second) {
+				_mapWriter2PeerMedia.erase(itWriter);
+				break;
+			}
+		}
+		_mapStream2PeerMedia.erase(itStream++);
 	}
-	else 
-		return itStream->second;
+
+	// Create a new writer if the stream key is unknown
+	shared<RTMFPWriter> pWriter = createWriter(Packet(EXPAND("\x00\x47\x52\x11")), _mainFlowId);
+	auto itPeerMedia = _mapWriter2PeerMedia.emplace(piecewise_construct, forward_as_tuple(pWriter->id), forward_as_tuple(SET, this, pWriter)).first;
+	itStream = _mapStream2PeerMedia.emplace_hint(itStream, streamKey, itPeerMedia->second);
+	itPeerMedia->second->pStreamKey = &itStream->first;
+	return itPeerMedia->second;
 }
 
 void P2PSession::sendGroupReport(const UInt8* data, UInt32 size) {
@@ -413,6 +425,7 @@ void P2PSession::sendGroupPeerConnect() {
 bool P2PSession::createMediaWriter(shared<RTMFPWriter>& pWriter, UInt64 flowIdRef) {
 
 	pWriter = createWriter(Packet(EXPAND("\x00\x47\x52\x12")), flowIdRef);
+	pWriter->setPriority(RTMFP::PRIORITY_GROUP);
 	return true;
 }
 
@@ -497,6 +510,10 @@ DiffieHellman&	P2PSession::diffieHellman() {
 	return _parent->diffieHellman();
 }
 
+UInt64 P2PSession::readQueueSize() {
+	return _parent ? _parent->readQueueSize() : 0;
+}
+
 void P2PSession::addAddress(const SocketAddress& address, RTMFP::AddressType type) {
 	if ((type & 0x0f) == RTMFP::ADDRESS_REDIRECTION)
 		hostAddress = address;
@@ -27,7 +27,7 @@ using namespace Base;
 using namespace std;
 
 PeerMedia::PeerMedia(P2PSession* pSession, const shared<RTMFPWriter>& pMediaReportWriter) : _pMediaReportWriter(pMediaReportWriter), _pParent(pSession), _idFragmentsMapIn(0), _idFragmentsMapOut(0), 
-	idFlow(0), idFlowMedia(0), pStreamKey(NULL), _pushOutMode(0), pushInMode(0), groupMediaSent(false), _fragmentsMap(MAX_FRAGMENT_MAP_SIZE*4), id(pMediaReportWriter->id), _closed(false) {
+	idFlow(0), idFlowMedia(0), pStreamKey(NULL), _pushOutMode(0), pushInMode(0), groupMediaSent(false), pullsWaiting(0), fragmentsIn(0), duplicatesIn(0), duplicateBytesIn(0), _pullDelay(0), _pullSuccess(1), id(pMediaReportWriter->id), _closed(false) {
 	TRACE("Creation of PeerMedia ", id, " from ", _pParent->name())
 }
 
@@ -140,14 +140,13 @@ void PeerMedia::handleFragmentsMap(UInt64 id, const UInt8* data, UInt32 size) {
 	}
 
 	_idFragmentsMapIn = id;
-	if (!size)
-		return; // 0 size protection
-
 	if (size > MAX_FRAGMENT_MAP_SIZE)
 		DEBUG("Group Fragment map receive from ", _pParent->peerId, " > max size : ", size)
-	_fragmentsMap.resize(size);
-	BinaryWriter writer(_fragmentsMap.data(), size);
-	writer.write(data, size);
+
+	// Load the bytes in little endian words to test the fragments with a word access
+	_fragmentsMap.assign((size + 7) / 8, 0);
+	for (UInt32 i = 0; i < size; ++i)
+		_fragmentsMap[i >> 3] |= UInt64(data[i]) << ((i & 7) * 8);
 }
 
 void PeerMedia::handleFragment(UInt8 marker, UInt64 id, UInt8 splitedNumber, UInt8 mediaType, UInt32 time, const Packet& packet, double lostRate) {
@@ -165,10 +164,11 @@ bool PeerMedia::checkMask(UInt8 bitNumber) {
 	UInt64 lastFragment = _idFragmentsMapIn - (_idFragmentsMapIn % 8);
 	lastFragment += ((_idFragmentsMapIn % 8) > bitNumber) ? bitNumber : bitNumber - 8;
 
-	TRACE("Searching ", lastFragment, " into ", String::Format<UInt8>("%.2x", *_fragmentsMap.data()), " ; (current id : ", _idFragmentsMapIn, ") ; result = ",
-		((*_fragmentsMap.data()) & (1 << (8 - _idFragmentsMapIn + lastFragment))) > 0, " ; bit : ", bitNumber, " ; address : ", _pParent->peerId, " ; latency : ", _pParent->latency())
+	UInt8 firstByte = _fragmentsMap.empty() ? 0 : UInt8(_fragmentsMap[0]);
+	TRACE("Searching ", lastFragment, " into ", String::Format<UInt8>("%.2x", firstByte), " ; (current id : ", _idFragmentsMapIn, ") ; result = ",
+		(firstByte & (1 << (8 - _idFragmentsMapIn + lastFragment))) > 0, " ; bit : ", bitNumber, " ; address : ", _pParent->peerId, " ; latency : ", _pParent->latency())
 
-	return ((*_fragmentsMap.data()) & (1 << (8 - _idFragmentsMapIn + lastFragment))) > 0;
+	return (firstByte & (1 << (8 - _idFragmentsMapIn + lastFragment))) > 0;
 }
 
 bool PeerMedia::hasFragment(UInt64 index) {
@@ -181,17 +181,15 @@ bool PeerMedia::hasFragment(UInt64 index) {
 		return true; // Fragment is the last one
 	}
 
-	UInt32 offset = (UInt32)((_idFragmentsMapIn - index - 1) / 8);
-	UInt32 rest = ((_idFragmentsMapIn - index - 1) % 8);
-	if (offset > _fragmentsMap.size()) {
-		TRACE("Searching ", index, " impossible into ", _pParent->peerId, ", out of buffer (", offset, "/", _fragmentsMap.size(), ")")
+	UInt64 bit = _idFragmentsMapIn - index - 1;
+	if ((bit >> 6) >= _fragmentsMap.size()) {
+		TRACE("Searching ", index, " impossible into ", _pParent->peerId, ", out of buffer (", bit, "/", _fragmentsMap.size() * 64, ")")
 		return false; // Fragment deleted from buffer
 	}
 
-	TRACE("Searching ", index, " into ", String::Format<UInt8>("%.2x", *(_fragmentsMap.data() + offset)), " ; (current id : ", _idFragmentsMapIn, ", offset : ", offset, ") ; result = ",
-		(*(_fragmentsMap.data() + offset) & (1 << rest)) > 0)
+	TRACE("Searching ", index, " into ", _pParent->peerId, " ; (current id : ", _idFragmentsMapIn, ", bit : ", bit, ") ; result = ", (_fragmentsMap[bit >> 6] >> (bit & 63)) & 1)
 
-	return (*(_fragmentsMap.data() + offset) & (1 << rest)) > 0;
+	return ((_fragmentsMap[bit >> 6] >> (bit & 63)) & 1) > 0;
 }
 
 void PeerMedia::handlePlayPull(UInt64 index, bool flush) {
@@ -205,6 +203,26 @@ void PeerMedia::sendPull(UInt64 index) {
 
 	TRACE("Sending pull request for fragment ", index, " to peer ", _pParent->peerId);
 	_pMediaReportWriter->writeGroupPull(index);
+	++pullsWaiting;
+}
+
+UInt32 PeerMedia::pullDelay() const {
+	return _pullDelay ? _pullDelay : (2 * _pParent->latency() + 1); // RTT until the first answer
+}
+
+double PeerMedia::pullCost() const {
+	return pullDelay() * (1.0 + pullsWaiting) / ((_pullSuccess > 0.05) ? _pullSuccess : 0.05);
+}
+
+void PeerMedia::pullAnswered(UInt32 delay) {
+	pullCanceled();
+	_pullDelay = _pullDelay ? (7 * _pullDelay + delay) / 8 : (delay ? delay : 1);
+	_pullSuccess = (7 * _pullSuccess + 1) / 8;
+}
+
+void PeerMedia::pullTimedOut() {
+	pullCanceled();
+	_pullSuccess = 7 * _pullSuccess / 8;
 }
 
 void PeerMedia::flush() {
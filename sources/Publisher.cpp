@@ -54,7 +54,7 @@ Int64 Publisher::TimeJump::operator()(UInt32 time, UInt32 size, UInt64& bytes) {
 }
 
 Publisher::Publisher(const string& name, Invoker& invoker, bool audioReliable, bool videoReliable, bool p2p) : _running(false), _new(false), _name(name), publishAudio(true), publishVideo(true),
-	_audioReliable(audioReliable), _videoReliable(videoReliable), isP2P(p2p), _invoker(invoker), _lastTime(0) {
+	_audioReliable(audioReliable), _videoReliable(videoReliable), isP2P(p2p), _invoker(invoker), _lastTime(0), _gopSize(0), _gopMaxSize(RTMFP::Parameters().getNumber<UInt32>("gopCacheSize")) {
 
 	INFO("Initialization of the publisher ", _name, " (audioReliable : ", _audioReliable, " - videoReliable : ", _videoReliable, ")");
 }
@@ -102,6 +102,47 @@ void Publisher::stop() {
 		it.second->flush(); // flush possible last media + messages in stopPublishing
 	}
 	_running = false;
+	_gop.clear();
+	_gopSize = 0;
+}
+
+void Publisher::sendGOP(Listener& listener) const {
+	if (_gop.empty())
+		return;
+
+	DEBUG("Sending ", _gop.size(), " media packets (", _gopSize, " bytes) of the current GOP to ", listener.identifier, " from publication ", _name)
+	for (const Media& media : _gop) {
+		switch (media.type) {
+		case AMF::TYPE_AUDIO:
+			listener.pushAudio(media.time, media.packet, _audioReliable); break;
+		case AMF::TYPE_VIDEO:
+			listener.pushVideo(media.time, media.packet, _videoReliable); break;
+		default:
+			listener.pushData(media.time, media.packet, true); break;
+		}
+	}
+	listener.flush();
+}
+
+void Publisher::cacheMedia(AMF::Type type, UInt32 time, const Packet& packet) {
+	if (!_gopMaxSize)
+		return;
+
+	// A new GOP starts with each key frame
+	if (type == AMF::TYPE_VIDEO && RTMFP::IsKeyFrame(packet.data(), packet.size())) {
+		_gop.clear();
+		_gopSize = 0;
+	}
+	else if (_gop.empty())
+		return; // wait the first key frame
+
+	if ((_gopSize += packet.size()) > _gopMaxSize) {
+		DEBUG("GOP of publication ", _name, " larger than ", _gopMaxSize, " bytes, cache disabled until the next key frame")
+		_gop.clear();
+		_gopSize = 0;
+		return;
+	}
+	_gop.emplace_back(type, time, packet);
 }
 
 void Publisher::updateTime(AMF::Type type, UInt32 time, UInt32 size) {
@@ -145,6 +186,8 @@ void Publisher::pushAudio(UInt32 time, const Packet& packet) {
 		// AAC codec && settings codec informations
 		_audioCodec = move(packet);
 	}
+	else
+		cacheMedia(AMF::TYPE_AUDIO, time, packet);
 
 	_new = true;
 	auto it = _listeners.begin();
@@ -166,6 +209,8 @@ void Publisher::pushVideo(UInt32 time, const Packet& packet) {
 		// video codec && settings codec informations
 		_videoCodec = move(packet);
 	}
+	else
+		cacheMedia(AMF::TYPE_VIDEO, time, packet);
 
 	_new = true;
 	auto it = _listeners.begin();
@@ -180,6 +225,7 @@ void Publisher::pushData(UInt32 time, const Packet& packet) {
 	}
 
 	updateTime(AMF::TYPE_DATA, time, packet.size());
+	cacheMedia(AMF::TYPE_DATA, time, packet);
 
 	_new = true;
 	auto it = _listeners.begin();
@@ -23,6 +23,10 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 #include "Base/URL.h"
 #include "AMF.h"
 #include "Base/DNS.h"
+#include "librtmfp.h"
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
 
 using namespace std;
 using namespace Base;
@@ -96,7 +100,83 @@ Buffer& RTMFP::InitBuffer(shared<Buffer>& pBuffer, atomic<Int64>& initiatorTime,
 	return BinaryWriter(*pBuffer).write8(marker + 4).write16(RTMFP::TimeNow()).write16(RTMFP::Time(time)).buffer();
 }
 
+#if defined(LIBRTMFP_LOSS_INJECTION)
+atomic<UInt8> RTMFP::LossInjection(0);
+#endif
+
+shared<RTMFP::StreamStats> RTMFP::Stats::stream(UInt16 mediaId) {
+	lock_guard<mutex> lock(_mutex);
+	auto it = _streams.lower_bound(mediaId);
+	if (it == _streams.end() || it->first != mediaId)
+		it = _streams.emplace_hint(it, mediaId, shared<StreamStats>(SET));
+	return it->second;
+}
+
+void RTMFP::Stats::streams(const function<void(UInt16, const StreamStats&)>& function) {
+	lock_guard<mutex> lock(_mutex);
+	for (auto& it : _streams)
+		function(it.first, *it.second);
+}
+
+thread_local Int64 RTMFP::Origin(0);
+thread_local Int64 RTMFP::WriteOrigin(0);
+
+void RTMFP::Histogram::add(Int64 value) {
+	UInt32 usec = value > 0 ? (value < 0xFFFFFFFF ? UInt32(value) : 0xFFFFFFFF) : 0;
+
+	// Bucket : exact value under 8, then exponent and 3 bits of mantissa
+	UInt16 bucket(usec);
+	if (usec >= 8) {
+#if defined(_WIN32)
+		unsigned long exponent;
+		_BitScanReverse(&exponent, usec);
+#else
+		UInt8 exponent = 31 - __builtin_clz(usec);
+#endif
+		bucket = UInt16((exponent - 2) * 8 + ((usec >> (exponent - 3)) & 7));
+	}
+	_buckets[bucket].fetch_add(1, memory_order_relaxed);
+	_sum.fetch_add(usec, memory_order_relaxed);
+	UInt64 max = _max.load(memory_order_relaxed);
+	while (usec > max && !_max.compare_exchange_weak(max, usec, memory_order_relaxed));
+}
+
+UInt64 RTMFP::Histogram::Highest(UInt16 bucket) {
+	if (bucket < 8)
+		return bucket;
+	return (UInt64(9 + (bucket & 7)) << (bucket / 8 - 1)) - 1;
+}
+
+void RTMFP::Histogram::read(RTMFPHistogram& histogram, bool reset) {
+
+	// Copy the buckets (the count is computed from the copy to stay consistent)
+	UInt32 buckets[HISTOGRAM_BUCKETS];
+	UInt64 count(0);
+	for (UInt16 i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		count += buckets[i] = reset ? _buckets[i].exchange(0, memory_order_relaxed) : _buckets[i].load(memory_order_relaxed);
+	UInt64 sum = reset ? _sum.exchange(0, memory_order_relaxed) : _sum.load(memory_order_relaxed);
+	histogram.max = reset ? _max.exchange(0, memory_order_relaxed) : _max.load(memory_order_relaxed);
+	histogram.count = count;
+	histogram.mean = count ? sum / count : 0;
+
+	// Percentiles : highest value of the bucket reaching the rank, bounded by the maximum
+	static const double Ratios[] = { 0.5, 0.9, 0.99, 0.999 };
+	unsigned long long* percentiles[] = { &histogram.p50, &histogram.p90, &histogram.p99, &histogram.p999 };
+	UInt64 rank(0);
+	UInt16 bucket(0);
+	for (UInt8 i = 0; i < 4; ++i) {
+		UInt64 target = UInt64(ceil(count * Ratios[i]));
+		while (rank < target)
+			rank += buckets[bucket++];
+		*percentiles[i] = bucket ? min<UInt64>(Highest(bucket - 1), histogram.max) : 0;
+	}
+}
+
 bool RTMFP::Send(Socket& socket, const Packet& packet, const SocketAddress& address) {
+#if defined(LIBRTMFP_LOSS_INJECTION)
+	if (LossInjection && (Util::Random<UInt32>() % 100) < LossInjection)
+		return true; // simulated loss
+#endif
 	Exception ex;
 	int sent = socket.write(ex, packet, address);
 	if (sent < 0) {
@@ -108,9 +188,44 @@ bool RTMFP::Send(Socket& socket, const Packet& packet, const SocketAddress& addr
 	return true;
 }
 
+void RTMFP::XORFragment(Buffer& parity, UInt8 flags, const UInt8* data, UInt32 size) {
+	UInt32 paritySize(parity.size());
+	if (paritySize < (size + 3)) {
+		parity.resize(size + 3);
+		memset(parity.data() + paritySize, 0, size + 3 - paritySize);
+	}
+	UInt8* out(parity.data());
+	*out++ ^= flags;
+	*out++ ^= UInt8(size >> 8);
+	*out++ ^= UInt8(size);
+	for (UInt32 i = 0; i < size; ++i)
+		out[i] ^= data[i];
+}
+
+UInt64 RTMFP::ReverseBits(UInt64 value) {
+	value = ((value >> 1) & 0x5555555555555555ULL) | ((value & 0x5555555555555555ULL) << 1);
+	value = ((value >> 2) & 0x3333333333333333ULL) | ((value & 0x3333333333333333ULL) << 2);
+	value = ((value >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((value & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	// byte reversal
+	value = ((value >> 8) & 0x00FF00FF00FF00FFULL) | ((value & 0x00FF00FF00FF00FFULL) << 8);
+	value = ((value >> 16) & 0x0000FFFF0000FFFFULL) | ((value & 0x0000FFFF0000FFFFULL) << 16);
+	return (value >> 32) | (value << 32);
+}
+
+UInt8 RTMFP::LowestBit(UInt64 value) {
+#if defined(_WIN32)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (UInt8)index;
+#else
+	return (UInt8)__builtin_ctzll(value);
+#endif
+}
+
 bool RTMFP::Engine::decode(Exception& ex, Buffer& buffer, const SocketAddress& address) {
 	static UInt8 IV[KEY_SIZE];
 	EVP_CipherInit_ex(_context, EVP_aes_128_cbc(), NULL, _key, IV, 0);
+	EVP_CIPHER_CTX_set_padding(_context, 0); // the size is a multiple of the block size, otherwise OpenSSL 3 keeps the last block
 	int temp;
 	EVP_CipherUpdate(_context, buffer.data(), &temp, buffer.data(), buffer.size());
 	// Check CRC
@@ -131,8 +246,8 @@ shared<Buffer>& RTMFP::Engine::encode(shared<Buffer>& pBuffer, UInt32 farId, con
 		DUMP_RESPONSE("LIBRTMFP", pBuffer->data() + 6, pBuffer->size() - 6, address);
 
 	int size = pBuffer->size();
-	if (size > RTMFP::SIZE_PACKET)
-		CRITIC("Packet exceeds 1192 RTMFP maximum size, risks to be ignored by client");
+	if (size > RTMFP::SIZE_PACKET_MAX)
+		CRITIC("Packet exceeds ", RTMFP::SIZE_PACKET_MAX, " RTMFP maximum size, risks to be ignored by client");
 	// paddingBytesLength=(0xffffffff-plainRequestLength+5)&0x0F
 	int temp = (0xFFFFFFFF - size + 5) & 0x0F;
 	// Padd the plain request with paddingBytesLength of value 0xff at the end
@@ -149,6 +264,7 @@ shared<Buffer>& RTMFP::Engine::encode(shared<Buffer>& pBuffer, UInt32 farId, con
 	// Encrypt the resulted request
 	static UInt8 IV[KEY_SIZE];
 	EVP_CipherInit_ex(_context, EVP_aes_128_cbc(), NULL, _key, IV, 1);
+	EVP_CIPHER_CTX_set_padding(_context, 0);
 	EVP_CipherUpdate(_context, data + 4, &temp, data + 4, size - 4);
 
 	reader.reset(4);
@@ -26,13 +26,13 @@ using namespace std;
 using namespace Base;
 
 RTMFPFlow::RTMFPFlow(UInt64 id, FlowManager& band, const shared<FlashConnection>& pMainStream, UInt64 idWriterRef) : _pStream(pMainStream),
-	_lost(0),id(id),_writerRef(idWriterRef),_stage(0),_stageEnd(0),_band(band), fragmentation(0) {
+	_lost(0),id(id),_writerRef(idWriterRef),_stage(0),_stageEnd(0),_band(band), fragmentation(0), _fecFirst(0), _fecRebuilt(0) {
 
 	DEBUG("New main flow ", id, " on connection ", _band.name())
 }
 
 RTMFPFlow::RTMFPFlow(UInt64 id, const shared<FlashStream>& pStream, FlowManager& band, UInt64 idWriterRef) : _pStream(pStream),
-	_lost(0),id(id),_writerRef(idWriterRef),_stage(0), _stageEnd(0),_band(band), fragmentation(0) {
+	_lost(0),id(id),_writerRef(idWriterRef),_stage(0), _stageEnd(0),_band(band), fragmentation(0), _fecFirst(0), _fecRebuilt(0) {
 
 	DEBUG("New flow ", id, " on connection ", _band.name())
 }
@@ -41,6 +41,8 @@ RTMFPFlow::RTMFPFlow(UInt64 id, const shared<FlashStream>& pStream, FlowManager&
 RTMFPFlow::~RTMFPFlow() {
 
 	DEBUG("RTMFPFlow ", id, " consumed");
+	if (_fecRebuilt)
+		INFO(_fecRebuilt, " stages rebuilt with FEC on flow ", id, " in session ", _band.name())
 
 	// delete fragments
 	_fragments.clear();
@@ -67,6 +69,19 @@ UInt64 RTMFPFlow::buildAck(vector<UInt64>& losts, UInt16& size) {
 }
 
 void RTMFPFlow::input(UInt64 stage, UInt8 flags, const Packet& packet, bool lastFragment) {
+	// Keep the fragment for the FEC blocks (an abandon has no data, except the end of the flow)
+	if (_fecFirst && _fecTime.isElapsed(RTMFP::FEC_TIMEOUT)) {
+		DEBUG("No more FEC parity on flow ", id, ", fragments released")
+		_fecFragments.clear();
+		_fecFirst = 0; // until the next parity
+	}
+	if (_fecFirst && stage >= _fecFirst && (!(flags&RTMFP::MESSAGE_ABANDON) || (flags&RTMFP::MESSAGE_END))) {
+		_fecFragments.emplace(piecewise_construct, forward_as_tuple(stage), forward_as_tuple(flags, packet, lastFragment));
+		// Keep the block of the last parity and the next one at most (a parity is sent after its block)
+		if (stage >= (_fecFragments.begin()->first + 2 * RTMFP::FEC_BLOCK_MAX))
+			_fecFragments.erase(_fecFragments.begin(), _fecFragments.lower_bound(stage - 2 * RTMFP::FEC_BLOCK_MAX + 1));
+	}
+
 	if (_stageEnd) {
 		if (_fragments.empty()) {
 			// if completed accept anyway to allow ack and avoid repetition
@@ -140,6 +155,43 @@ void RTMFPFlow::input(UInt64 stage, UInt8 flags, const Packet& packet, bool last
 	
 }
 
+void RTMFPFlow::inputParity(UInt64 first, UInt8 count, UInt8 parities, UInt8 index, const Packet& parity) {
+	if (!parities || index >= parities)
+		return; // bad parity
+	_fecTime.update();
+	if (first > _fecFirst) {
+		// New block, remove the fragments of the previous ones
+		_fecFragments.erase(_fecFragments.begin(), _fecFragments.lower_bound(first));
+		_fecFirst = first;
+	}
+
+	// XOR the fragments received to get the missing one
+	shared<Buffer> pBuffer(SET, parity.data(), parity.size());
+	UInt64 missing(0);
+	for (UInt64 stage = first + index; stage < first + count; stage += parities) {
+		auto it = _fecFragments.find(stage);
+		if (it != _fecFragments.end()) {
+			RTMFP::XORFragment(*pBuffer, it->second.flags, it->second.data(), it->second.size());
+			continue;
+		}
+		if (missing || stage <= _stage)
+			return; // more than one stage missing, or stage already abandoned
+		missing = stage;
+	}
+	if (!missing || pBuffer->size() < 3)
+		return;
+	BinaryReader reader(pBuffer->data(), pBuffer->size());
+	UInt8 flags(reader.read8());
+	UInt16 size(reader.read16());
+	if (size > reader.available()) {
+		DEBUG("Bad FEC parity for stage ", missing, " on flow ", id)
+		return;
+	}
+	DEBUG("Stage ", missing, " rebuilt with FEC on flow ", id)
+	++_fecRebuilt;
+	input(missing, flags, Packet(pBuffer, reader.current(), size), true);
+}
+
 void RTMFPFlow::onFragment(UInt64 stage, UInt8 flags, const Packet& packet, bool lastFragment) {
 	
 	_stage = stage;
@@ -169,6 +221,7 @@ void RTMFPFlow::onFragment(UInt64 stage, UInt8 flags, const Packet& packet, bool
 
 void RTMFPFlow::output(UInt64 flowId, UInt32& lost, const Packet& packet, bool lastFragment) {
 
+	HISTOGRAM(*_band.stats(), HISTOGRAM_FLOW)
 	if (!_pStream || !_pStream->process(packet, id, _writerRef, lost, lastFragment)) {
 		_band.closeFlow(id); // send an exception
 		return;
@@ -25,37 +25,213 @@ along with Librtmfp.  If not, see <http://www.gnu.org/licenses/>.
 
 using namespace Base;
 
-bool RTMFPSender::run(Exception&) {
-	run();
-	if (!pQueue)
+RTMFPSender::FEC::FEC(UInt8 block, UInt8 parities) : block(block ? block : 1), parities(parities ? parities : 1), _first(0), _count(0) {
+	for (UInt8 i = 0; i < this->parities; ++i)
+		_parities.emplace_back(SET);
+}
+
+bool RTMFPSender::FEC::add(UInt64 stage, UInt8 flags, const UInt8* data, UInt32 size) {
+	if (!_count)
+		_first = stage;
+	RTMFP::XORFragment(*_parities[(stage - _first) % parities], flags, data, size);
+	return ++_count >= block;
+}
+
+void RTMFPSender::FEC::flush(UInt64 flowId, std::vector<shared<Buffer>>& chunks) {
+	for (UInt8 i = 0; i < parities && i < _count; ++i) {
+		Buffer& parity(*_parities[i]);
+		chunks.emplace_back(SET);
+		BinaryWriter writer(*chunks.back());
+		writer.write8(0x6d).write16(Binary::Get7BitSize<UInt64>(flowId) + Binary::Get7BitSize<UInt64>(_first) + 3 + parity.size());
+		writer.write7Bit<UInt64>(flowId).write7Bit<UInt64>(_first).write8(_count).write8(parities).write8(i).write(parity.data(), parity.size());
+		parity.clear();
+	}
+	_count = 0;
+}
+
+void RTMFPSender::Session::setRTT(Int64 rtt) {
+	UInt32 value = rtt <= 0 ? 1 : (rtt > 65535000 ? 65535000 : UInt32(rtt)); // 65535ms max like the ping
+
+	// Smoothed Round Trip time https://tools.ietf.org/html/rfc6298 (in usec)
+	if (!srtt) {
+		srtt = value;
+		rttvar = value / 2;
+	} else {
+		rttvar = (3 * rttvar + Base::abs(Int64(srtt) - value)) / 4;
+		srtt = (7 * srtt + value) / 8;
+	}
+	if (!minRtt || value < minRtt)
+		minRtt = value;
+
+	// ERTO https://tools.ietf.org/html/rfc7016#section-3.5.2.2 (+200ms for delayed acks)
+	UInt32 erto = (srtt + 4 * rttvar) / 1000 + 200;
+	if (erto < RTMFP::ERTO_MIN)
+		erto = RTMFP::ERTO_MIN;
+	else if (erto > Net::RTO_MAX)
+		erto = Net::RTO_MAX;
+	rto = erto;
+}
+
+bool RTMFPSender::Session::write(const Base::Packet& chunks, UInt8 marker, const SocketAddress& address) {
+	if (_pBuffer && (_marker != marker || (_pBuffer->size() + chunks.size()) > packetSize) && !flush(address))
+		return false;
+	if (!_pBuffer) {
+		RTMFP::InitBuffer(_pBuffer, initiatorTime, marker);
+		_marker = marker;
+	}
+	_pBuffer->append(chunks.data(), chunks.size());
+	return true;
+}
+
+bool RTMFPSender::Session::flush(const SocketAddress& address) {
+	if (!_pBuffer)
 		return true;
+	UInt32 size(_pBuffer->size());
+	if (!RTMFP::Send(socket, Base::Packet(pEncoder->encode(_pBuffer, farId, address)), address))
+		return false;
+	pStats->bytesSent.fetch_add(size, std::memory_order_relaxed);
+	pStats->packetsSent.fetch_add(1, std::memory_order_relaxed);
+	++packets;
+	return true;
+}
 
-	// Flush Queue!
-	while (pSession->sendable && !pQueue->empty()) {
-		TRACE("Stage ", pQueue->stageSending + 1, " sent on writer ", pQueue->id);
-		shared<Packet>& pPacket(pQueue->front());
-		if (!RTMFP::Send(pSession->socket, *pPacket, address)) {
-			pSession->sendable = 0;
-			break;
+void RTMFPSender::Session::schedule(const shared<Queue>& pQueue) {
+	if (pQueue->scheduled)
+		return;
+	pQueue->scheduled = true;
+	_queues[pQueue->priority].emplace_back(pQueue);
+}
+
+void RTMFPSender::Session::sendQueues(UInt8 marker, const SocketAddress& address) {
+	// Reschedule the queues paused, ahead of the queues scheduled since (an audio queue keeps its priority even if
+	// only the video writer is acknowledged)
+	for (UInt8 priority = 0; priority < RTMFP::PRIORITY_COUNT; ++priority) {
+		auto& paused(_paused[priority]);
+		while (!paused.empty()) {
+			shared<Queue> pQueue(paused.back().lock());
+			paused.pop_back();
+			if (!pQueue || pQueue->scheduled || pQueue->empty())
+				continue; // writer deleted, already rescheduled by its writer or nothing more to send
+			pQueue->scheduled = true;
+			_queues[priority].emplace_front(move(pQueue));
+		}
+	}
+	Int64 now(Time::Now());
+	while (sendable) {
+		// Weighted round robin, the highest priority with credits first, credits are reloaded when all are exhausted
+		UInt8 priority(0);
+		while (priority < RTMFP::PRIORITY_COUNT && (_queues[priority].empty() || !_credits[priority]))
+			++priority;
+		if (priority == RTMFP::PRIORITY_COUNT) {
+			bool waiting(false);
+			for (priority = 0; priority < RTMFP::PRIORITY_COUNT; ++priority) {
+				_credits[priority] = 1 << (RTMFP::PRIORITY_COUNT - 1 - priority);
+				waiting |= !_queues[priority].empty();
+			}
+			if (!waiting)
+				return;
+			continue;
+		}
+		--_credits[priority];
+		shared<Queue> pQueue(move(_queues[priority].front()));
+		_queues[priority].pop_front();
+		if (sendPacket(*pQueue, marker, now, address) && !pQueue->empty())
+			_queues[priority].emplace_back(move(pQueue)); // next queue of the same priority
+		else
+			pQueue->scheduled = false;
+	}
+	// Paused (sending failed or no more sendable before an ack), keep the queues waiting by weak reference: their
+	// writers repeat only when the queue is not referenced elsewhere, and the next sending of the session resumes them
+	for (UInt8 priority = 0; priority < RTMFP::PRIORITY_COUNT; ++priority) {
+		for (shared<Queue>& pQueue : _queues[priority]) {
+			pQueue->scheduled = false;
+			_paused[priority].emplace_back(pQueue);
+		}
+		_queues[priority].clear();
+	}
+}
+
+bool RTMFPSender::Session::sendPacket(Queue& queue, UInt8 marker, Int64 now, const SocketAddress& address) {
+	shared<Packet>& pPacket(queue.front());
+	// Flow control, do not exceed the receiver window (if closed send just one packet to probe it)
+	if (queue.sendingSize && (queue.sendingSize + pPacket->size()) > queue.window)
+		return false;
+	if (!pPacket->fragments) {
+		// FEC parities, never dropped nor repeated
+		if (!write(*pPacket, marker, address)) {
+			sendable = 0; // pause sending, the packet stays in the queue
+			return true;
+		}
+		--sendable;
+		sendByteRate += pPacket->size();
+		queueing -= pPacket->size();
+		queue.pop_front();
+		return true;
+	}
+	bool drop(false);
+	if (pPacket->key)
+		queue.shedding = false; // video key frame, the next inter frames are decodable again
+	if (pPacket->deadline && (drop = pPacket->expired(now) || (queue.shedding && pPacket->dependent))) {
+		// Too late, drop it like a lost unreliable packet (it will be abandoned by the repeater)
+		DEBUG("Stage ", queue.stageSending + 1, " dropped on writer ", queue.id, pPacket->expired(now) ? " (deadline exceeded)" : " (waiting key frame)");
+		if (pPacket->dependent)
+			queue.shedding = true;
+		pPacket->reliable = false;
+		sendLostRate += pPacket->size();
+		pStats->drops.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (!drop) {
+		TRACE("Stage ", queue.stageSending + 1, " sent on writer ", queue.id);
+		if (!write(*pPacket, marker, address)) {
+			sendable = 0; // pause sending, the packet stays in the queue
+			return true;
 		}
-		--pSession->sendable;
-		pSession->sendTime = Time::Now();
-		pSession->sendByteRate += pPacket->size();
-		pSession->queueing -= pPacket->size();
-		pPacket->setSent();
-		pQueue->stageSending += pPacket->fragments;
-		pQueue->sending.emplace_back(pPacket);
-		pSession->sendingSize += pPacket->size();
-		pQueue->pop_front();
+		--sendable;
+		sendTime = Time::Now();
+		sendByteRate += pPacket->size();
+		HISTOGRAM_ADD(*pStats, HISTOGRAM_SEND, pPacket->origin, RTMFP::MicroNow())
 	}
+	queueing -= pPacket->size();
+	queue.stageSending += pPacket->fragments;
+	if (pPacket->reliable || !queue.sending.empty()) {
+		if (drop)
+			pPacket->reset(); // never sent, it takes no place in the receiver window (and it is already counted as lost)
+		else {
+			pPacket->setSent(packets + 1); // index from 1 of the current packet
+			queue.sendingSize += pPacket->sizeSent();
+			sendingSize += pPacket->size();
+		}
+		queue.sending.emplace_back(pPacket);
+	} else // unreliable without packet waiting ack => not buffered, abandoned immediatly (by the next packets header or the repeater)
+		queue.stageAck = queue.stageSending;
+	queue.pop_front();
+	return true;
+}
+
+bool RTMFPSender::run(Exception&) {
+	run();
+
+	// Flush Queues!
+	if (pQueue && !pQueue->empty())
+		pSession->schedule(pQueue);
+	pSession->sendQueues(_marker, address);
+
+	// Last sender of the session => send the current packet
+	if (!--pSession->pending && !pSession->flush(address))
+		pSession->sendable = 0;
 	return true;
 }
 
 void RTMFPCmdSender::run() {
 	// COMMAND
-	shared<Buffer> pBuffer;
-	BinaryWriter(RTMFP::InitBuffer(pBuffer, pSession->initiatorTime, _marker)).write24(UInt32(_cmd << 16));
-	RTMFP::Send(pSession->socket, Base::Packet(pSession->pEncoder->encode(pBuffer, pSession->farId, address)), address);
+	shared<Buffer> pBuffer(SET);
+	BinaryWriter(*pBuffer).write24(UInt32(_cmd << 16));
+	pSession->write(Base::Packet(pBuffer), _marker, address);
+}
+
+void RTMFPChunkSender::run() {
+	if (_chunks)
+		pSession->write(_chunks, _marker, address);
 }
 
 void RTMFPAcquiter::run() {
@@ -64,35 +240,146 @@ void RTMFPAcquiter::run() {
 		ERROR("stageAck ", _stageAck, " superior to sending stage ", pQueue->stageSending, " on writer ", pQueue->id);
 		_stageAck = pQueue->stageSending;
 	}
+	Int64 sendTime(0); // send time of the last packet acknowledged by this ack (0 if repeated, Karn's rule)
+	UInt32 packets(0); // session packets acknowledged by this ack
+	UInt64 packet(0);
 	while (!pQueue->sending.empty() && _stageAck > pQueue->stageAck) {
 		shared<Packet>& pPacket(pQueue->sending.front());
+		if (!pPacket->acked) {
+			sendTime = pPacket->repeated ? 0 : pPacket->sendTime();
+			if (pPacket->packet() != packet) {
+				packet = pPacket->packet();
+				++packets;
+			}
+		}
 		pQueue->stageAck += pPacket->fragments;		
+		pQueue->sendingSize -= pPacket->sizeSent();
 		pSession->sendingSize -= pPacket->size();
 		pQueue->sending.pop_front();
 		pSession->sendable = RTMFP::SENDABLE_MAX; // has progressed, can send max!
 	}
+	pQueue->window = _window;
+	if (_stageAck > pQueue->stageReceived) {
+		pQueue->stageReceived = _stageAck;
+		pSession->sendable = RTMFP::SENDABLE_MAX; // has progressed (unreliable stages are not buffered), can send max!
+	}
+
+	// SACK! mark the packets received out of order and fast repeat the holes
+	UInt64 stage = pQueue->stageAck;
+	UInt8 sendable(RTMFP::SENDABLE_MAX);
+	Int64 now(Time::Now());
+	auto itRange = _ranges.begin();
+	for (shared<Packet>& pPacket : pQueue->sending) {
+		if (itRange == _ranges.end())
+			break; // nothing received after this packet
+		UInt64 first = stage + 1;
+		stage += pPacket->fragments;
+		while (itRange != _ranges.end() && itRange->second < first)
+			++itRange;
+		if (itRange == _ranges.end() || pPacket->acked)
+			continue;
+		if (itRange->first <= first && stage <= itRange->second) {
+			pPacket->acked = true;
+			sendTime = pPacket->repeated ? 0 : pPacket->sendTime();
+			continue;
+		}
+		// a later stage has been received while this one is missing
+		if (pPacket->missed == RTMFP::DUPACK_THRESHOLD || ++pPacket->missed < RTMFP::DUPACK_THRESHOLD)
+			continue; // already fast repeated or not yet considered as lost
+		if (!pPacket->reliable || pPacket->expired(now) || !sendable)
+			continue; // unreliable (or too late) packets are abandoned below, the reliable ones wait the repeater if nothing more is sendable
+		DEBUG("Stage ", first, " fast repeated on writer ", pQueue->id, " (", address, ")");
+		if (!pSession->write(*pPacket, _marker, address)) {
+			pSession->sendable = 0; // pause sending!
+			break;
+		}
+		pPacket->repeated = true;
+		pSession->pStats->retransmissions.fetch_add(1, std::memory_order_relaxed);
+		--sendable;
+	}
+
+	// ABANDON right away the unreliable stages lost, the receiver delivers in order and would wait the repeater (RTO) otherwise.
+	// One abandon by hole, because an abandon drops the stages received before it, and again on each ack reporting the hole
+	// (the abandon can be lost too)
+	UInt64 abandonStage(0);
+	auto abandon = [&]() {
+		if (abandonStage)
+			sendAbandon(abandonStage);
+		abandonStage = 0;
+	};
+	// the stages not buffered (unreliable) missing before a stage received
+	stage = _stageAck;
+	for (auto& range : _ranges) {
+		if (stage >= pQueue->stageAck)
+			break;
+		if (range.first > (stage + 1)) {
+			abandonStage = range.first - 1 < pQueue->stageAck ? range.first - 1 : pQueue->stageAck;
+			abandon();
+		}
+		stage = range.second;
+	}
+	// the unreliable (or too late) packets buffered and missing after RTMFP::DUPACK_THRESHOLD acks, until a packet to repeat or not yet lost
+	if (!_ranges.empty()) {
+		stage = pQueue->stageAck;
+		for (shared<Packet>& pPacket : pQueue->sending) {
+			stage += pPacket->fragments;
+			if (pPacket->acked) {
+				abandon();
+				continue;
+			}
+			if ((pPacket->reliable && !pPacket->expired(now)) || pPacket->missed < RTMFP::DUPACK_THRESHOLD)
+				break;
+			abandonStage = stage;
+		}
+		abandon();
+	}
+
+	// RTT sample only if the peer has acknowledged at once, a gap or "ackPackets" packets received, otherwise the ack
+	// may have waited its delayed acknowledgment timer and the sample would include it
+	if (sendTime && (!_ranges.empty() || packets >= pSession->ackPackets))
+		pSession->setRTT(_time - sendTime);
 }
 
 void RTMFPRepeater::run() {
 
+	// FEC, send the parities of the block in progress before abandoning its stages
+	if (pQueue->pFEC) {
+		std::vector<shared<Buffer>> parities;
+		pQueue->pFEC->flush(pQueue->id, parities);
+		for (shared<Buffer>& pParity : parities)
+			pSession->write(Base::Packet(pParity), _marker, address);
+	}
+
+	// ABANDON in bulk the unreliable packets not buffered and not received
+	if (pQueue->sending.empty()) {
+		if (pQueue->stageReceived < pQueue->stageAck)
+			sendAbandon(pQueue->stageAck);
+		return;
+	}
+
 	// REPEAT
 	bool oneReliable = false;
 	UInt64 abandonStage = 0;
 	UInt64 stage = pQueue->stageAck;
 	UInt8 sendable(RTMFP::SENDABLE_MAX);
+	Int64 now(Time::Now());
 	for (shared<Packet>& pPacket : pQueue->sending) {
-		DEBUG("Stage ", stage + 1, " repeated (", address, ")");
 		stage += pPacket->fragments;
-		if (pPacket->reliable) {
-			oneReliable = true;
+		if ((pPacket->reliable && !pPacket->expired(now)) || pPacket->acked) { // a reliable media frame too late is abandoned
+			oneReliable = true; // a packet acknowledged out of order must not be abandoned
 			if (abandonStage) {
 				sendAbandon(abandonStage);
 				abandonStage = 0;
 			}
-			if (!RTMFP::Send(pSession->socket, *pPacket, address)) {
+			if (pPacket->acked)
+				continue; // already received, nothing to repeat
+			DEBUG("Stage ", stage - pPacket->fragments + 1, " repeated (", address, ")");
+			if (!pSession->write(*pPacket, _marker, address)) {
 				pSession->sendable = 0; // pause sending!
 				break;
 			}
+			pPacket->repeated = true;
+			pSession->pStats->retransmissions.fetch_add(1, std::memory_order_relaxed);
 			if (!--sendable)
 				break;
 		}
@@ -100,22 +387,18 @@ void RTMFPRepeater::run() {
 			abandonStage = stage;
 			pSession->sendLostRate += pPacket->sizeSent();
 		}
-		if (_fragments) {
-			if (pPacket->fragments >= _fragments)
-				break;
-			_fragments -= pPacket->fragments;
-		}
 	}
 	if (abandonStage)
 		sendAbandon(abandonStage);
 }
 
-void RTMFPRepeater::sendAbandon(UInt64 stage) {
-	shared<Buffer> pBuffer;
-	BinaryWriter writer(RTMFP::InitBuffer(pBuffer, pSession->initiatorTime, _marker));
+void RTMFPSender::sendAbandon(UInt64 stage) {
+	shared<Buffer> pBuffer(SET);
+	BinaryWriter writer(*pBuffer);
 	writer.write8(0x10).write16(2 + Binary::Get7BitSize<UInt64>(pQueue->id) + Binary::Get7BitSize<UInt64>(stage));
 	writer.write8(RTMFP::MESSAGE_ABANDON).write7Bit<UInt64>(pQueue->id).write7Bit<UInt64>(stage).write8(0);
-	RTMFP::Send(pSession->socket, Base::Packet(pSession->pEncoder->encode(pBuffer, pSession->farId, address)), address);
+	pSession->write(Base::Packet(pBuffer), _marker, address);
+	pSession->pStats->abandons.fetch_add(1, std::memory_order_relaxed);
 }
 
 
@@ -123,12 +406,15 @@ UInt32 RTMFPMessenger::headerSize() { // max size header = 50
 	UInt32 size = Binary::Get7BitSize<UInt64>(pQueue->id);
 	size += Binary::Get7BitSize<UInt64>(pQueue->stage);
 	size += Binary::Get7BitSize<UInt64>(pQueue->stage - pQueue->stageAck);
-	size += pQueue->stageAck ? 0 : (pQueue->signature.size() + (pQueue->flowId ? (4 + Binary::Get7BitSize<UInt64>(pQueue->flowId)) : 2));
+	size += pQueue->stageReceived ? 0 : (pQueue->signature.size() + (pQueue->flowId ? (4 + Binary::Get7BitSize<UInt64>(pQueue->flowId)) : 2));
 	return size;
 }
 
 
 void RTMFPMessenger::run() {
+	_packetSize = pSession->packetSize;
+	if (pQueue->pFEC && pSession->fec)
+		_packetSize -= RTMFP::FEC_OVERHEAD; // room for the parity chunks
 	for (Message& message : _messages)
 		write(message);
 	flush();
@@ -137,8 +423,11 @@ void RTMFPMessenger::run() {
 void RTMFPMessenger::flush() {
 	if (!_pBuffer)
 		return;
-	// encode and add to pQueue
-	pQueue->emplace_back(SET, pSession->pEncoder->encode(_pBuffer, pSession->farId, address), _fragments, _flags&RTMFP::MESSAGE_RELIABLE ? true : false);
+	// add to pQueue, the chunks will be bundled and encoded at sending
+	pQueue->emplace_back(SET, _pBuffer, _fragments, _flags&RTMFP::MESSAGE_RELIABLE ? true : false, _deadline, _dependent, _key);
+#if defined(LIBRTMFP_HISTOGRAMS)
+	pQueue->back()->origin = _origin;
+#endif
 	pSession->queueing += pQueue->back()->size();	
 	if (!pSession->congested && pSession->isCongested()) // Important : test congestion after queuing, otherwise it can give a false negative
 		pSession->congested = true;
@@ -167,7 +456,7 @@ void RTMFPMessenger::write(const Message& message) {
 		if (header)
 			headerSize += this->headerSize();
 
-		UInt32 availableToWrite(RTMFP::SIZE_PACKET);
+		UInt32 availableToWrite(_packetSize); // RTMFP header is counted in headerSize
 		if (_pBuffer)
 			availableToWrite -= _pBuffer->size();
 		// headerSize+16 to avoid a useless fragment (without payload data)
@@ -178,17 +467,32 @@ void RTMFPMessenger::write(const Message& message) {
 				headerSize += this->headerSize();
 				header = true;
 			}
-			RTMFP::InitBuffer(_pBuffer, pSession->initiatorTime, _marker);
+			_pBuffer.set();
 			_fragments = 1;
+			_deadline = message.deadline;
+			_dependent = message.dependent;
+			_key = message.key;
+#if defined(LIBRTMFP_HISTOGRAMS)
+			_origin = message.origin;
+#endif
 
-			if ((headerSize + contentSize) > RTMFP::SIZE_PACKET)
-				contentSize = RTMFP::SIZE_PACKET - headerSize;
+			if ((headerSize + contentSize) > _packetSize)
+				contentSize = _packetSize - headerSize;
 
 		}
 		else {
 			if ((headerSize + contentSize)>availableToWrite)
 				contentSize = availableToWrite - headerSize;
 			++_fragments;
+			// the buffer can be dropped only if all its messages can be dropped
+			if (!message.deadline || (_deadline && message.deadline < _deadline))
+				_deadline = message.deadline;
+			_dependent |= message.dependent;
+			_key |= message.key;
+#if defined(LIBRTMFP_HISTOGRAMS)
+			if (message.origin && (!_origin || message.origin < _origin))
+				_origin = message.origin;
+#endif
 		}
 
 		size -= contentSize;
@@ -198,7 +502,7 @@ void RTMFPMessenger::write(const Message& message) {
 			_flags = RTMFP::MESSAGE_ABANDON | RTMFP::MESSAGE_END; // MESSAGE_END is always with MESSAGE_ABANDON otherwise flash client can crash
 		else {
 			_flags = (_flags&RTMFP::MESSAGE_WITH_AFTERPART) ? RTMFP::MESSAGE_WITH_BEFOREPART : 0;
-			if (!pQueue->stageAck && header)
+			if (!pQueue->stageReceived && header)
 				_flags |= RTMFP::MESSAGE_OPTIONS;
 			if (size > 0)
 				_flags |= RTMFP::MESSAGE_WITH_AFTERPART;
@@ -217,7 +521,7 @@ void RTMFPMessenger::write(const Message& message) {
 			writer.write7Bit<UInt64>(pQueue->stage - pQueue->stageAck);
 			header = false;
 			// signature
-			if (!pQueue->stageAck) {
+			if (!pQueue->stageReceived) {
 				writer.write8(UInt8(pQueue->signature.size())).write(pQueue->signature);
 				// No write this in the case where it's a new flow (create on server side)
 				if (pQueue->flowId) {
@@ -243,5 +547,17 @@ void RTMFPMessenger::write(const Message& message) {
 			available -= contentSize;
 		}
 
+		// FEC, the parities of a complete block are sent just after it
+		if (pQueue->pFEC && pSession->fec && pQueue->pFEC->add(pQueue->stage, _flags & ~RTMFP::MESSAGE_RELIABLE, _pBuffer->data() + _pBuffer->size() - contentSize, contentSize)) {
+			flush();
+			_pBuffer.reset();
+			std::vector<shared<Buffer>> parities;
+			pQueue->pFEC->flush(pQueue->id, parities);
+			for (shared<Buffer>& pParity : parities) {
+				pQueue->emplace_back(SET, pParity, 0, false);
+				pSession->queueing += pQueue->back()->size();
+			}
+		}
+
 	} while (size);
 }
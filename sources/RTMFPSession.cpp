@@ -39,7 +39,7 @@ UInt32 RTMFPSession::RTMFPSessionCounter = 0x02000000;
 
 RTMFPSession::RTMFPSession(UInt32 id, Invoker& invoker, RTMFPConfig config) :
 	_id(id), _rawId(PEER_ID_SIZE + 2, '\0'), _flashVer(EXPAND("WIN 20,0,0,286")), _app("live"), _handshaker(this), _threadRcv(0), flags(0),
-	FlowManager(false, invoker, config.pOnStatusEvent), _pOnMedia(config.pOnMedia), socketIPV4(_invoker.sockets), socketIPV6(_invoker.sockets),
+	FlowManager(false, invoker, config.pOnStatusEvent, shared<RTMFP::Stats>(SET)), _pOnMedia(config.pOnMedia), socketIPV4(_invoker.sockets), socketIPV6(_invoker.sockets),
 	_interruptCb(config.interruptCb), _interruptArg(config.interruptArg) {
 
 	socketIPV6.onPacket = socketIPV4.onPacket = [this](Base::shared<Buffer>& pBuffer, const SocketAddress& address) {
@@ -71,7 +71,9 @@ RTMFPSession::RTMFPSession(UInt32 id, Invoker& invoker, RTMFPConfig config) :
 			return;
 		}
 
+		HISTOGRAM_ORIGIN(HISTOGRAM_NOW()) // reception time of the packet for the latency histograms
 		_invoker.decode(_id, idSession, address, pEngine, pBuffer, _threadRcv);
+		HISTOGRAM_ORIGIN(0)
 	};
 	socketIPV6.onError = socketIPV4.onError = [this](const Exception& ex) {
 		SocketAddress address;
@@ -307,6 +309,19 @@ bool RTMFPSession::connect2Group(const string& streamName, RTMFPGroupConfig* par
 		return false;
 	}
 
+	// Already connected to the group : subscribe to the stream with the same peers
+	if (_group) {
+		if (_group->idHex != groupHex) {
+			WARN("Already connected to the group ", _group->idTxt, "00, only one group can be connected")
+			return false;
+		}
+		if (parameters->isPublisher) {
+			WARN("Unable to publish the stream ", streamName, ", the group is already connected")
+			return false;
+		}
+		return _group->addStream(mediaCount, streamName, audioReliable, videoReliable);
+	}
+
 	if (parameters->isPublisher) {
 		if (_pPublisher) {
 			WARN("A publisher already exists (name : ", _pPublisher->name(), "), command ignored")
@@ -408,9 +423,35 @@ bool RTMFPSession::manage(Int64 now) {
 		}
 	}
 
+	updateStats();
 	return !failed();
 }
 
+void RTMFPSession::updateStats() {
+	RTMFP::Stats& stats(*_pStats);
+
+	stats.sendLostRate.store(sendLostRate(), memory_order_relaxed);
+	stats.sendByteRate.store((UInt32)sendByteRate(), memory_order_relaxed);
+	stats.srtt.store(srtt(), memory_order_relaxed);
+	stats.rto.store(rto(), memory_order_relaxed);
+	stats.queueing.store(sendQueueing(), memory_order_relaxed);
+
+	UInt64 fragmentation(FlowManager::fragmentation());
+	UInt32 p2pSessions(0);
+	for (auto& itPeer : _mapPeersById) {
+		fragmentation += itPeer.second->fragmentation();
+		if (itPeer.second->status == RTMFP::CONNECTED)
+			++p2pSessions;
+	}
+	stats.fragmentation.store(fragmentation, memory_order_relaxed);
+	stats.p2pSessions.store(p2pSessions, memory_order_relaxed);
+
+	if (_group)
+		_group->updateStats(stats);
+	else
+		stats.groupPeers.store(0, memory_order_relaxed);
+}
+
 bool RTMFPSession::addStream(UInt8 mask, const string& streamName, bool audioReliable, bool videoReliable, UInt16 mediaCount) {
 
 	if (_pPublisher && (mask & RTMFP_PUBLISHED)) { // TODO: handle multiple publishers
@@ -444,6 +485,10 @@ bool RTMFPSession::addStream(UInt8 mask, const string& streamName, bool audioRel
 
 bool RTMFPSession::closeStream(UInt16 mediaCount) {
 
+	// NetGroup stream? Unsubscribe
+	if (_group && _group->removeStream(mediaCount))
+		return true;
+
 	auto itWriter = _mapStreamWriters.find(mediaCount);
 	if (itWriter == _mapStreamWriters.end())
 		return false;
@@ -616,6 +661,10 @@ const string& RTMFPSession::groupIdTxt() {
 	return _group->idTxt;
 }
 
+UInt64 RTMFPSession::readQueueSize() {
+	return _invoker.readQueueSize(_id);
+}
+
 void RTMFPSession::buildPeerID(const UInt8* data, UInt32 size) {
 	if (!_peerTxtId.empty())
 		return;
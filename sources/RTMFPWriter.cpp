@@ -30,7 +30,7 @@ using namespace std;
 using namespace Base;
 
 RTMFPWriter::RTMFPWriter(UInt8 marker, UInt64 id, UInt64 flowId, const Packet& signature, RTMFP::Output& output) :
-	_marker(marker), _repeatDelay(0), _output(output), _stageAck(0), _lostCount(0), id(id), flowId(flowId), signature(signature) {
+	_marker(marker), _repeatDelay(0), _output(output), _stageAck(0), _window(RTMFP::WINDOW_MAX), _mediaDeadline(RTMFP::Parameters().getNumber<UInt32>("mediaDeadline")), _timeRef(0), id(id), flowId(flowId), signature(signature) {
 	_pQueue.set(id, flowId, signature);
 }
 
@@ -51,44 +51,41 @@ void RTMFPWriter::close(Int32 error, const char* reason) {
 	_state = (_state>=NEAR_CLOSED) ? CLOSED : NEAR_CLOSED; // before flush to get MESSAGE_END!
 }
 
-void RTMFPWriter::acquit(UInt64 stageAck, UInt32 lostCount) {
-	TRACE("Ack ", stageAck, " on writer ", _pQueue->id, " (lostCount=", lostCount, ")");
+void RTMFPWriter::acquit(UInt64 stageAck, UInt64 window, RTMFPSender::Ranges&& ranges) {
+	TRACE("Ack ", stageAck, " on writer ", _pQueue->id, " (window=", window, ", ranges=", ranges.size(), ")");
 	// have to continue to become consumed even if writer closed!
 	if (stageAck > _stageAck) {
 		// progress!
 		_stageAck = stageAck;
-		_lostCount = 0;
 		// reset repeat time on progression!
 		_repeatDelay = _output.rto();
 		_repeatTime.update();
 		// continue sending
-		_output.send(make_shared<RTMFPAcquiter>(_marker, _pQueue, _stageAck));
+		_window = window;
+		_output.send(make_shared<RTMFPAcquiter>(_marker, _pQueue, _stageAck, _window, move(ranges)));
 		return;
 	}
-	if (!lostCount) {
-		DEBUG("Ack ", stageAck, " obsolete on writer ", _pQueue->id);
+	if (window != _window) {
+		// no progress but window update (receiver has consumed its data), continue sending
+		_window = window;
+		_output.send(make_shared<RTMFPAcquiter>(_marker, _pQueue, _stageAck, _window, move(ranges)));
 		return;
 	}
-	if (lostCount > _lostCount) {
-		/// emulate ERTO-timeout=ping if lost infos =>
-		// repeating is caused by a gap in ack-range, it can be a packet lost or an non-ordering transfer
-		// to avoid a self-sustaining congestion repeated just the first missing packet if lost infos are present
-		// and just once time (raising=true, to emulate first RTMFP ERTO=ping), let do the trigger after
-		repeatMessages(_lostCount = lostCount);
+	if (ranges.empty()) {
+		DEBUG("Ack ", stageAck, " obsolete on writer ", _pQueue->id);
+		return;
 	}
+	// no progress but some stages have been received out of order (gap in ack-range, it can be a packet lost or an non-ordering transfer),
+	// the acquiter will mark them as received and repeat just the holes reported by RTMFP::DUPACK_THRESHOLD acks (fast repeat)
+	_output.send(make_shared<RTMFPAcquiter>(_marker, _pQueue, _stageAck, _window, move(ranges)));
 }
 
-void RTMFPWriter::repeatMessages(UInt32 lostCount) {
-	if (lostCount) {
-		// means that there is something lost! We can start a repeation without wait end of current sending
-		_output.send(make_shared<RTMFPRepeater>(_marker, _pQueue, lostCount>0xFF ? 0xFF : lostCount));
-		return;
-	}
+void RTMFPWriter::repeatMessages() {
 	if (!_pQueue.unique())
 		return; // wait next! is sending, wait before to repeat packets
 				// REPEAT!
-	if (_pQueue->empty()) {
-		// nothing to repeat, stop repeat
+	if (_pQueue->empty() && _stageAck >= _pQueue->stageSending) {
+		// nothing to repeat or abandon, stop repeat
 		_repeatDelay = 0;
 		return;
 	}
@@ -116,19 +113,30 @@ void RTMFPWriter::flush() {
 	_pSender.reset();
 }
 
-AMFWriter& RTMFPWriter::newMessage(bool reliable, const Packet& packet) {
+AMFWriter& RTMFPWriter::newMessage(bool reliable, const Packet& packet, Int64 deadline, bool dependent, bool key) {
 	if (closed())
 		return AMFWriter::Null();
 	if (!_pSender)
 		_pSender.set<RTMFPMessenger>(_marker, _pQueue);
-	return ((RTMFPMessenger&)*_pSender).newMessage(reliable, packet);
+	return ((RTMFPMessenger&)*_pSender).newMessage(reliable, packet, deadline, dependent, key);
 }
 
 AMFWriter& RTMFPWriter::write(AMF::Type type, UInt32 time, RTMFP::DataType packetType, const Packet& packet, bool reliable) {
 	if (type < AMF::TYPE_AUDIO || type > AMF::TYPE_VIDEO)
 		time = 0; // Because it can "dropped" the packet otherwise (like if the Writer was not reliable!)
 
-	AMFWriter& writer = newMessage(reliable, packet);
+	// Deadline of the non-key frames, from the media timestamp
+	Int64 deadline(0);
+	bool dependent(false), key(type == AMF::TYPE_VIDEO && RTMFP::IsKeyFrame(packet.data(), packet.size()) && !RTMFP::IsVideoCodecInfos(packet.data(), packet.size()));
+	if (_mediaDeadline && packet && ((type == AMF::TYPE_AUDIO && !RTMFP::IsAACCodecInfos(packet.data(), packet.size())) || (type == AMF::TYPE_VIDEO && !RTMFP::IsKeyFrame(packet.data(), packet.size())))) {
+		Int64 now(Time::Now()), timeRef(now - time);
+		if (!_timeRef || timeRef < _timeRef || timeRef > (_timeRef + _mediaDeadline))
+			_timeRef = timeRef; // first frame, frame in advance or timestamp discontinuity
+		deadline = _timeRef + time + _mediaDeadline;
+		dependent = type == AMF::TYPE_VIDEO;
+	}
+
+	AMFWriter& writer = newMessage(reliable, packet, deadline, dependent, key);
 	writer->write8(type).write32(time);
 	if (type == AMF::TYPE_DATA_AMF3)
 		writer->write8(0);
@@ -69,6 +69,7 @@ void RTMFP_Init(RTMFPConfig* config, RTMFPGroupConfig* groupConfig, void(*onLog)
 	groupConfig->fetchPeriod = 2500;
 	groupConfig->windowDuration = 8000;
 	groupConfig->pushLimit = 4;
+	groupConfig->fastJoin = 1;
 }
 
 void RTMFP_Terminate() {
@@ -250,6 +251,33 @@ LIBRTMFP_API char RTMFP_WaitForEvent(unsigned int RTMFPcontext, RTMFPMask mask)
 	return (char)res;
 }
 
+char RTMFP_GetStats(unsigned int RTMFPcontext, RTMFPStats* stats) {
+	if (!GlobalInvoker) {
+		ERROR("RTMFP_Init() has not been called, please call it first")
+		return 0;
+	}
+
+	return GlobalInvoker->getStats(RTMFPcontext, *stats) ? 1 : 0;
+}
+
+char RTMFP_GetStreamStats(unsigned int RTMFPcontext, unsigned short streamId, RTMFPStreamStats* stats) {
+	if (!GlobalInvoker) {
+		ERROR("RTMFP_Init() has not been called, please call it first")
+		return 0;
+	}
+
+	return GlobalInvoker->getStreamStats(RTMFPcontext, streamId, *stats) ? 1 : 0;
+}
+
+char RTMFP_GetHistogram(unsigned int RTMFPcontext, int stage, RTMFPHistogram* histogram, int reset) {
+	if (!GlobalInvoker) {
+		ERROR("RTMFP_Init() has not been called, please call it first")
+		return 0;
+	}
+
+	return GlobalInvoker->getHistogram(RTMFPcontext, stage, *histogram, reset > 0) ? 1 : 0;
+}
+
 void RTMFP_GetPublicationAndUrlFromUri(const char* uri, char** publication) {
 	char* pos = (char*)strrchr(uri, '\\');
 	char* pos2 = (char*)strrchr(uri, '/');
@@ -276,8 +304,17 @@ void RTMFP_SetIntParameter(const char* parameter, int value) {
 		Net::SetRecvBufferSize(value);
 	else if (String::ICompare(parameter, "socketSendSize") == 0)
 		Net::SetSendBufferSize(value);
-	else if (String::ICompare(parameter, "timeoutFallback") == 0)
+	else if (String::ICompare(parameter, "timeoutFallback") == 0 || String::ICompare(parameter, "ackPackets") == 0 || String::ICompare(parameter, "ackDelay") == 0
+		|| String::ICompare(parameter, "mediaDeadline") == 0 || String::ICompare(parameter, "maxPacketSize") == 0
+		|| String::ICompare(parameter, "fecBlock") == 0 || String::ICompare(parameter, "fecParities") == 0 || String::ICompare(parameter, "deltaReports") == 0
+		|| String::ICompare(parameter, "gopCacheSize") == 0)
 		RTMFP::Parameters().setNumber(parameter, value);
+	else if (String::ICompare(parameter, "lossInjection") == 0)
+#if defined(LIBRTMFP_LOSS_INJECTION)
+		RTMFP::LossInjection = UInt8(value < 0 ? 0 : (value > 100 ? 100 : value));
+#else
+		WARN("lossInjection ignored, librtmfp is compiled without LIBRTMFP_LOSS_INJECTION (make LOSS=1)")
+#endif
 	else
 		FATAL_ERROR("Unknown parameter ", parameter)
 }